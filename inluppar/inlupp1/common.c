@@ -7,26 +7,201 @@
 bool int_eq(elem_t a, elem_t b) { return a.i == b.i; }
 bool str_eq(elem_t a, elem_t b)
 {
-    return strcmp((char *)a.p, (char *)b.p) == 0;
+    // The same pointer (e.g. two interned handles) is the same string, skip strcmp
+    return a.p == b.p || strcmp((char *)a.p, (char *)b.p) == 0;
 }
 bool ptr_eq(elem_t a, elem_t b) { return a.p == b.p; }
+bool strview_eq(elem_t a, elem_t b)
+{
+    const ioopm_str_t *x = a.p;
+    const ioopm_str_t *y = b.p;
+    return x->len == y->len && x->hash == y->hash && memcmp(x->ptr, y->ptr, x->len) == 0;
+}
 
 // === Hash functions ===
-int hash_int(elem_t key)
+uint64_t hash_int(elem_t key)
+{
+    return (uint64_t) key.u; // the table scrambles the bits when picking a bucket
+}
+
+uint64_t hash_str(elem_t key)
+{
+    const char *str = key.p;
+    return hash_bytes(str, strlen(str), 0);
+}
+
+uint64_t hash_strview(elem_t key)
+{
+    return ((const ioopm_str_t *) key.p)->hash;
+}
+
+uint64_t hash_int_seeded(elem_t key, ioopm_hash_seed_t seed)
+{
+    // One 64x64->128 bit multiply, folded; every input bit reaches every output bit
+    __uint128_t product = (__uint128_t) (key.u ^ seed.k0 ^ seed.k1 ^ 0xa0761d6478bd642full) * 0xe7037ed1a0b428dbull;
+    return (uint64_t) product ^ (uint64_t) (product >> 64);
+}
+
+uint64_t hash_str_seeded(elem_t key, ioopm_hash_seed_t seed)
+{
+    const char *str = key.p;
+    return hash_bytes(str, strlen(str), seed.k0 ^ seed.k1);
+}
+
+uint64_t hash_str_sip(elem_t key, ioopm_hash_seed_t seed)
+{
+    const char *str = key.p;
+    return siphash_bytes(str, strlen(str), seed.k0, seed.k1);
+}
+
+// === Hashing byte strings ===
+
+/// wyhash (final version 4 by Wang Yi, public domain): reads 8 or 16 bytes per step
+/// instead of one, and mixes with a 64x64->128 bit multiply.
+
+static const uint64_t wy_secret[4] = {
+    0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull
+};
+
+static inline void wy_mum(uint64_t *a, uint64_t *b)
+{
+    __uint128_t r = (__uint128_t) *a * *b;
+    *a = (uint64_t) r;
+    *b = (uint64_t) (r >> 64);
+}
+
+static inline uint64_t wy_mix(uint64_t a, uint64_t b)
 {
-    return key.i % 5; // uses same bucket count as hash_table.c
+    wy_mum(&a, &b);
+    return a ^ b;
 }
 
-int hash_str(elem_t key)
+// Unaligned little endian loads; memcpy compiles to a single mov
+static inline uint64_t wy_read8(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static inline uint64_t wy_read4(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64_t wy_read3(const uint8_t *p, size_t k)
 {
-    unsigned char *str = key.p;
-    unsigned long hash = 5381;
-    int c;
+    return ((uint64_t) p[0] << 16) | ((uint64_t) p[k >> 1] << 8) | p[k - 1];
+}
+
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed)
+{
+    const uint8_t *p = data;
+    uint64_t a, b;
+    seed ^= wy_mix(seed ^ wy_secret[0], wy_secret[1]);
+
+    if (len <= 16)
+    {
+        if (len >= 4)
+        {
+            a = (wy_read4(p) << 32) | wy_read4(p + ((len >> 3) << 2));
+            b = (wy_read4(p + len - 4) << 32) | wy_read4(p + len - 4 - ((len >> 3) << 2));
+        }
+        else if (len > 0)
+        {
+            a = wy_read3(p, len);
+            b = 0;
+        }
+        else
+        {
+            a = b = 0;
+        }
+    }
+    else
+    {
+        size_t i = len;
+        if (i > 48)
+        {
+            uint64_t see1 = seed, see2 = seed;
+            do
+            {
+                seed = wy_mix(wy_read8(p) ^ wy_secret[1], wy_read8(p + 8) ^ seed);
+                see1 = wy_mix(wy_read8(p + 16) ^ wy_secret[2], wy_read8(p + 24) ^ see1);
+                see2 = wy_mix(wy_read8(p + 32) ^ wy_secret[3], wy_read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16)
+        {
+            seed = wy_mix(wy_read8(p) ^ wy_secret[1], wy_read8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wy_read8(p + i - 16);
+        b = wy_read8(p + i - 8);
+    }
+
+    a ^= wy_secret[1];
+    b ^= seed;
+    wy_mum(&a, &b);
+    return wy_mix(a ^ wy_secret[0] ^ len, b ^ wy_secret[1]);
+}
+
+/// SipHash-2-4 (Aumasson and Bernstein). Slower than wyhash, but with a secret key an
+/// attacker cannot build inputs that all land in the same bucket.
+
+#define Sip_Rotl(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define Sip_Round(v0, v1, v2, v3)                                         \
+    do {                                                                  \
+        v0 += v1; v1 = Sip_Rotl(v1, 13); v1 ^= v0; v0 = Sip_Rotl(v0, 32); \
+        v2 += v3; v3 = Sip_Rotl(v3, 16); v3 ^= v2;                        \
+        v0 += v3; v3 = Sip_Rotl(v3, 21); v3 ^= v0;                        \
+        v2 += v1; v1 = Sip_Rotl(v1, 17); v1 ^= v2; v2 = Sip_Rotl(v2, 32); \
+    } while (0)
 
-    while ((c = *str++))
+uint64_t siphash_bytes(const void *data, size_t len, uint64_t k0, uint64_t k1)
+{
+    const uint8_t *p = data;
+    uint64_t v0 = 0x736f6d6570736575ull ^ k0;
+    uint64_t v1 = 0x646f72616e646f6dull ^ k1;
+    uint64_t v2 = 0x6c7967656e657261ull ^ k0;
+    uint64_t v3 = 0x7465646279746573ull ^ k1;
+
+    const uint8_t *end = p + (len & ~(size_t) 7);
+    for (; p != end; p += 8)
     {
-        hash = ((hash << 5) + hash) + c; // hash * 33 + c
+        uint64_t m = wy_read8(p);
+        v3 ^= m;
+        Sip_Round(v0, v1, v2, v3);
+        Sip_Round(v0, v1, v2, v3);
+        v0 ^= m;
     }
 
-    return hash % 5;
+    // Last 0-7 bytes, with the length in the top byte
+    uint64_t last = (uint64_t) len << 56;
+    for (size_t i = 0; i < (len & 7); i++)
+    {
+        last |= (uint64_t) p[i] << (8 * i);
+    }
+    v3 ^= last;
+    Sip_Round(v0, v1, v2, v3);
+    Sip_Round(v0, v1, v2, v3);
+    v0 ^= last;
+
+    v2 ^= 0xff;
+    for (int i = 0; i < 4; i++) Sip_Round(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// === String views ===
+
+ioopm_str_t ioopm_str_view(const char *ptr, size_t len)
+{
+    return (ioopm_str_t) { .ptr = ptr, .len = len, .hash = hash_bytes(ptr, len, 0) };
+}
+
+ioopm_str_t *ioopm_str_dup(const ioopm_str_t *view)
+{
+    ioopm_str_t *copy = malloc(sizeof(ioopm_str_t) + view->len + 1);
+    char *bytes = (char *) (copy + 1);
+    memcpy(bytes, view->ptr, view->len);
+    bytes[view->len] = '\0';
+
+    copy->ptr = bytes;
+    copy->len = view->len;
+    copy->hash = view->hash;
+    return copy;
 }
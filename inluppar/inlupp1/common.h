@@ -2,6 +2,7 @@
 #define COMMON_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -19,6 +20,15 @@ union elem
 typedef bool ioopm_predicate(elem_t key, elem_t value, void *extra);
 typedef void ioopm_apply_function(elem_t key, elem_t *value, void *extra);
 
+/// A string key that carries its length and hash, so comparing two of them can
+/// reject on length or hash without touching the bytes. Pointed to by elem_t.p.
+typedef struct str_view
+{
+    const char *ptr;   // not necessarily NUL terminated
+    size_t len;
+    uint64_t hash;     // hash_bytes(ptr, len, 0)
+} ioopm_str_t;
+
 #define int_elem(x) (elem_t) { .i=(x) }
 #define ptr_elem(x) (elem_t) { .p=(x) }
 
@@ -26,15 +36,44 @@ typedef void ioopm_apply_function(elem_t key, elem_t *value, void *extra);
    ioopm_hash_table_insert(ht, int_elem(i), ptr_elem(s))
 
 typedef bool ioopm_eq_function(elem_t a, elem_t b);
-typedef int ioopm_hash_func(elem_t key);
+typedef uint64_t ioopm_hash_func(elem_t key); // full-width hash, the table reduces it
+/// The seed of a seeded hash: the 128-bit key of hash_str_sip, the other seeded
+/// hashes take k0 ^ k1 as their 64-bit seed
+typedef struct hash_seed
+{
+    uint64_t k0;
+    uint64_t k1;
+} ioopm_hash_seed_t;
+
+typedef uint64_t ioopm_seeded_hash_func(elem_t key, ioopm_hash_seed_t seed); // same, from a family picked by seed
 
 // === Equality function prototypes ===
 bool int_eq(elem_t a, elem_t b);
 bool str_eq(elem_t a, elem_t b);
 bool ptr_eq(elem_t a, elem_t b);
+bool strview_eq(elem_t a, elem_t b); // a.p and b.p are ioopm_str_t *
 
 // === Hash function prototypes ===
-int hash_int(elem_t key);
-int hash_str(elem_t key);
+uint64_t hash_int(elem_t key);
+uint64_t hash_str(elem_t key);      // hash_bytes over the string with seed 0
+
+// Seeded: give each table its own seed (ioopm_hash_table_options_t.seeded_hash)
+uint64_t hash_int_seeded(elem_t key, ioopm_hash_seed_t seed); // multiplicative mixer
+uint64_t hash_str_seeded(elem_t key, ioopm_hash_seed_t seed); // wyhash, 8-16 bytes per step
+uint64_t hash_str_sip(elem_t key, ioopm_hash_seed_t seed);    // SipHash-2-4, for keys from untrusted input
+
+uint64_t hash_strview(elem_t key);   // the hash cached in the ioopm_str_t
+
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed);
+uint64_t siphash_bytes(const void *data, size_t len, uint64_t k0, uint64_t k1);
+
+// === String views ===
+
+/// A view of len bytes at ptr (a slice of a bigger buffer is fine), hashed once here
+ioopm_str_t ioopm_str_view(const char *ptr, size_t len);
+
+/// A malloc'ed copy of the view and its bytes in one block (NUL terminated), so a
+/// single free releases both. Use it for keys the table should own.
+ioopm_str_t *ioopm_str_dup(const ioopm_str_t *view);
 
 #endif // COMMON_H
@@ -0,0 +1,374 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include "common.h"
+#include "hash_table.h"
+#include "hash_table_internal.h"
+#include "concurrent_hash_table.h"
+#include "epoch.h"
+
+/// Readers never lock, so every pointer and value a reader can see is written with an
+/// atomic release store and read with an atomic acquire load. An entry is complete
+/// before it is linked in, its next pointer is left alone when it is unlinked (a reader
+/// standing on it can walk on), and nothing unlinked is freed before the epoch says so.
+
+    /// ---------------------- Stripes ----------------------
+
+    static inline ioopm_concurrent_stripe_t *stripe_for(ioopm_concurrent_hash_table_t *ht, uint64_t hash)
+    {
+        return &ht->stripes[home_index(hash, 64 - Concurrent_Stripe_Bits)];
+    }
+
+    static void lock_all(ioopm_concurrent_hash_table_t *ht)
+    {
+        // Always in the same order, so two threads locking everything cannot deadlock
+        for (int i = 0; i < Concurrent_Stripes; i++) pthread_mutex_lock(&ht->stripes[i].lock);
+    }
+
+    static void unlock_all(ioopm_concurrent_hash_table_t *ht)
+    {
+        for (int i = Concurrent_Stripes - 1; i >= 0; i--) pthread_mutex_unlock(&ht->stripes[i].lock);
+    }
+
+    /// ---------------------- Atomic access ----------------------
+
+    static inline ioopm_concurrent_buckets_t *load_buckets(ioopm_concurrent_stripe_t *stripe)
+    {
+        return __atomic_load_n(&stripe->buckets, __ATOMIC_ACQUIRE);
+    }
+
+    static inline entry_t *load_link(entry_t **link)
+    {
+        return __atomic_load_n(link, __ATOMIC_ACQUIRE);
+    }
+
+    static inline void publish_link(entry_t **link, entry_t *entry)
+    {
+        __atomic_store_n(link, entry, __ATOMIC_RELEASE);
+    }
+
+    static inline elem_t load_value(entry_t *entry)
+    {
+        elem_t value;
+        __atomic_load(&entry->value, &value, __ATOMIC_ACQUIRE);
+        return value;
+    }
+
+    static inline void store_value(entry_t *entry, elem_t value)
+    {
+        __atomic_store(&entry->value, &value, __ATOMIC_RELEASE);
+    }
+
+    /// ---------------------- Reclamation ----------------------
+
+    static void reclaim_entry(void *entry, void *should_free_keys)
+    {
+        if (should_free_keys && ((entry_t *) entry)->key.p != NULL) free(((entry_t *) entry)->key.p);
+        free(entry);
+    }
+
+    static void reclaim_buckets(void *buckets, void *unused)
+    {
+        (void) unused;
+        free(((ioopm_concurrent_buckets_t *) buckets)->heads);
+        free(buckets);
+    }
+
+    /// An array replaced by grow, along with the entries that were copied out of it
+    static void reclaim_copied_buckets(void *buckets, void *unused)
+    {
+        ioopm_concurrent_buckets_t *old = buckets;
+        for (size_t i = 0; i < old->no_buckets; i++)
+        {
+            entry_t *entry = old->heads[i];
+            while (entry != NULL)
+            {
+                entry_t *next = entry->next;
+                free(entry); // its key lives on in the copy
+                entry = next;
+            }
+        }
+        reclaim_buckets(old, unused);
+    }
+
+    /// ---------------------- Buckets (writers, caller holds the stripe lock) ----------------------
+
+    static ioopm_concurrent_buckets_t *new_buckets(size_t no_buckets)
+    {
+        ioopm_concurrent_buckets_t *buckets = malloc(sizeof(ioopm_concurrent_buckets_t));
+        buckets->heads = calloc(no_buckets, sizeof(entry_t *));
+        buckets->no_buckets = no_buckets;
+        buckets->bucket_shift = shift_for(no_buckets);
+        return buckets;
+    }
+
+    /// The link pointing at the entry for key, or at the NULL ending its chain
+    static entry_t **find_link(ioopm_concurrent_hash_table_t *ht, ioopm_concurrent_stripe_t *stripe,
+                               elem_t key, uint64_t hash)
+    {
+        ioopm_concurrent_buckets_t *buckets = stripe->buckets; // stable while we hold its lock
+        entry_t **link = &buckets->heads[home_index(hash, buckets->bucket_shift)];
+        while (*link != NULL && !((*link)->hash == hash && ht->eq_func((*link)->key, key)))
+        {
+            link = &(*link)->next;
+        }
+        return link;
+    }
+
+    static void add_entry(ioopm_concurrent_hash_table_t *ht, entry_t **link, elem_t key, uint64_t hash, elem_t value)
+    {
+        entry_t *entry = malloc(sizeof(entry_t));
+        entry->key = key;
+        entry->value = value;
+        entry->hash = hash;
+        entry->next = NULL;
+        publish_link(link, entry);
+        stripe_for(ht, hash)->size++;
+    }
+
+    /// A stripe owns no_buckets / Concurrent_Stripes buckets of every array, stripe s the
+    /// ones from s times that on
+    static inline size_t buckets_per_stripe(ioopm_concurrent_buckets_t *buckets)
+    {
+        return buckets->no_buckets / Concurrent_Stripes;
+    }
+
+    /// Grow when the stripe's share of the buckets is full
+    static inline bool stripe_overloaded(ioopm_concurrent_hash_table_t *ht, ioopm_concurrent_stripe_t *stripe)
+    {
+        return (float) stripe->size > (float) buckets_per_stripe(stripe->buckets) * ht->max_load_factor;
+    }
+
+    /// Copy the entries of stripe s into buckets and switch the stripe over to them.
+    /// Readers may still be walking the old chains, so the entries are copied rather than
+    /// relinked; the old ones are freed with the old array.
+    static void move_stripe(ioopm_concurrent_hash_table_t *ht, int s, ioopm_concurrent_buckets_t *buckets)
+    {
+        ioopm_concurrent_stripe_t *stripe = &ht->stripes[s];
+        pthread_mutex_lock(&stripe->lock);
+
+        ioopm_concurrent_buckets_t *old = stripe->buckets;
+        size_t first = s * buckets_per_stripe(old);
+        for (size_t i = first; i < first + buckets_per_stripe(old); i++)
+        {
+            for (entry_t *entry = old->heads[i]; entry != NULL; entry = entry->next)
+            {
+                entry_t *copy = malloc(sizeof(entry_t));
+                *copy = *entry;
+                entry_t **head = &buckets->heads[home_index(entry->hash, buckets->bucket_shift)];
+                copy->next = *head;
+                *head = copy;
+            }
+        }
+        __atomic_store_n(&stripe->buckets, buckets, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&stripe->lock);
+    }
+
+    /// Double the bucket array, unless another thread already did since seen_no_buckets
+    /// or is doing it now. The old array and entries are retired once every stripe has moved.
+    static void grow(ioopm_concurrent_hash_table_t *ht, size_t seen_no_buckets)
+    {
+        if (pthread_mutex_trylock(&ht->resize_lock) != 0) return;
+
+        ioopm_concurrent_buckets_t *old = ht->buckets;
+        if (old->no_buckets == seen_no_buckets)
+        {
+            ht->buckets = new_buckets(old->no_buckets * 2);
+            for (int s = 0; s < Concurrent_Stripes; s++) move_stripe(ht, s, ht->buckets);
+            ioopm_epoch_retire(ht->epoch, old, reclaim_copied_buckets, NULL);
+        }
+        pthread_mutex_unlock(&ht->resize_lock);
+    }
+
+    /// ---------------------- API ----------------------
+
+    ioopm_concurrent_hash_table_t *ioopm_concurrent_hash_table_create(ioopm_hash_func *func, ioopm_eq_function *eq_func,
+                                                                      const ioopm_hash_table_options_t *opts)
+    {
+        ioopm_epoch_domain_t *epoch = ioopm_epoch_domain_create();
+        if (epoch == NULL) return NULL;
+
+        ioopm_concurrent_hash_table_t *ht = calloc(1, sizeof(ioopm_concurrent_hash_table_t));
+        ht->epoch = epoch;
+        ht->func = func;
+        ht->eq_func = eq_func;
+        ht->should_free_keys = false;
+        ht->max_load_factor = opts && opts->max_load_factor > 0 ? opts->max_load_factor : Default_Max_Load_Factor;
+
+        size_t no_buckets = Concurrent_Stripes;
+        while (opts && (float) no_buckets * ht->max_load_factor < (float) opts->capacity)
+        {
+            no_buckets *= 2;
+        }
+        ht->buckets = new_buckets(no_buckets);
+
+        for (int i = 0; i < Concurrent_Stripes; i++)
+        {
+            pthread_mutex_init(&ht->stripes[i].lock, NULL);
+            ht->stripes[i].buckets = ht->buckets;
+        }
+        pthread_mutex_init(&ht->resize_lock, NULL);
+        return ht;
+    }
+
+    void ioopm_concurrent_hash_table_destroy(ioopm_concurrent_hash_table_t *ht)
+    {
+        if (!ht) return;
+
+        ioopm_concurrent_buckets_t *buckets = ht->buckets;
+        for (size_t i = 0; i < buckets->no_buckets; i++)
+        {
+            entry_t *entry = buckets->heads[i];
+            while (entry != NULL)
+            {
+                entry_t *next = entry->next;
+                reclaim_entry(entry, ht->should_free_keys ? ht : NULL);
+                entry = next;
+            }
+        }
+        reclaim_buckets(buckets, NULL);
+        ioopm_epoch_domain_destroy(ht->epoch); // frees whatever was still retired
+
+        for (int i = 0; i < Concurrent_Stripes; i++) pthread_mutex_destroy(&ht->stripes[i].lock);
+        pthread_mutex_destroy(&ht->resize_lock);
+        free(ht);
+    }
+
+    bool ioopm_concurrent_hash_table_upsert(ioopm_concurrent_hash_table_t *ht, elem_t key,
+                                            ioopm_update_function *update, void *arg)
+    {
+        uint64_t hash = ht->func(key);
+        ioopm_concurrent_stripe_t *stripe = stripe_for(ht, hash);
+
+        pthread_mutex_lock(&stripe->lock);
+        entry_t **link = find_link(ht, stripe, key, hash);
+        bool inserted = *link == NULL;
+        if (inserted)
+        {
+            elem_t value = { .p = NULL };
+            update(&value, true, arg);
+            add_entry(ht, link, key, hash, value);
+        }
+        else
+        {
+            // Readers see either the old or the new value, never half of an update
+            elem_t value = (*link)->value;
+            update(&value, false, arg);
+            store_value(*link, value);
+            if (ht->should_free_keys && key.p != (*link)->key.p) free(key.p);
+        }
+
+        size_t seen_no_buckets = stripe->buckets->no_buckets;
+        bool overloaded = inserted && stripe_overloaded(ht, stripe);
+        pthread_mutex_unlock(&stripe->lock);
+
+        if (overloaded) grow(ht, seen_no_buckets);
+        return inserted;
+    }
+
+    void ioopm_concurrent_hash_table_insert(ioopm_concurrent_hash_table_t *ht, elem_t key, elem_t value)
+    {
+        // Like ioopm_hash_table_insert, an existing entry keeps its key and gets the new value
+        uint64_t hash = ht->func(key);
+        ioopm_concurrent_stripe_t *stripe = stripe_for(ht, hash);
+
+        pthread_mutex_lock(&stripe->lock);
+        entry_t **link = find_link(ht, stripe, key, hash);
+        bool inserted = *link == NULL;
+        if (inserted) add_entry(ht, link, key, hash, value);
+        else store_value(*link, value);
+
+        size_t seen_no_buckets = stripe->buckets->no_buckets;
+        bool overloaded = inserted && stripe_overloaded(ht, stripe);
+        pthread_mutex_unlock(&stripe->lock);
+
+        if (overloaded) grow(ht, seen_no_buckets);
+    }
+
+    static void add_delta(elem_t *value, bool inserted, void *arg)
+    {
+        (void) inserted; // a new value starts at 0
+        int *delta = arg;
+        value->i += *delta;
+        *delta = value->i; // hand the new count back
+    }
+
+    int ioopm_concurrent_hash_table_increment(ioopm_concurrent_hash_table_t *ht, elem_t key, int delta)
+    {
+        ioopm_concurrent_hash_table_upsert(ht, key, add_delta, &delta);
+        return delta;
+    }
+
+    option_t ioopm_concurrent_hash_table_lookup(ioopm_concurrent_hash_table_t *ht, elem_t key)
+    {
+        uint64_t hash = ht->func(key);
+        option_t result = Failure();
+
+        ioopm_epoch_enter(ht->epoch);
+        ioopm_concurrent_buckets_t *buckets = load_buckets(stripe_for(ht, hash));
+        entry_t *entry = load_link(&buckets->heads[home_index(hash, buckets->bucket_shift)]);
+        for (; entry != NULL; entry = load_link(&entry->next))
+        {
+            if (entry->hash == hash && ht->eq_func(entry->key, key))
+            {
+                result = Success(load_value(entry));
+                break;
+            }
+        }
+        ioopm_epoch_exit(ht->epoch);
+        return result;
+    }
+
+    bool ioopm_concurrent_hash_table_has_key(ioopm_concurrent_hash_table_t *ht, elem_t key)
+    {
+        return ioopm_concurrent_hash_table_lookup(ht, key).success;
+    }
+
+    option_t ioopm_concurrent_hash_table_remove(ioopm_concurrent_hash_table_t *ht, elem_t key)
+    {
+        uint64_t hash = ht->func(key);
+        ioopm_concurrent_stripe_t *stripe = stripe_for(ht, hash);
+        option_t result = Failure();
+
+        pthread_mutex_lock(&stripe->lock);
+        entry_t **link = find_link(ht, stripe, key, hash);
+        entry_t *entry = *link;
+        if (entry != NULL)
+        {
+            publish_link(link, entry->next);
+            stripe->size--;
+            result = Success(entry->value);
+            ioopm_epoch_retire(ht->epoch, entry, reclaim_entry, ht->should_free_keys ? ht : NULL);
+        }
+        pthread_mutex_unlock(&stripe->lock);
+        return result;
+    }
+
+    size_t ioopm_concurrent_hash_table_size(ioopm_concurrent_hash_table_t *ht)
+    {
+        size_t size = 0;
+        lock_all(ht);
+        for (int i = 0; i < Concurrent_Stripes; i++) size += ht->stripes[i].size;
+        unlock_all(ht);
+        return size;
+    }
+
+    void ioopm_concurrent_hash_table_apply_to_all(ioopm_concurrent_hash_table_t *ht, ioopm_apply_function *apply_fun, void *arg)
+    {
+        lock_all(ht);
+        // Mid-grow some stripes are still in the old array
+        for (int s = 0; s < Concurrent_Stripes; s++)
+        {
+            ioopm_concurrent_buckets_t *buckets = ht->stripes[s].buckets;
+            size_t first = s * buckets_per_stripe(buckets);
+            for (size_t i = first; i < first + buckets_per_stripe(buckets); i++)
+            {
+                for (entry_t *entry = buckets->heads[i]; entry != NULL; entry = entry->next)
+                {
+                    elem_t value = entry->value;
+                    apply_fun(entry->key, &value, arg);
+                    store_value(entry, value);
+                }
+            }
+        }
+        unlock_all(ht);
+    }
@@ -0,0 +1,111 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "common.h"
+#include "hash_table.h"
+#include "epoch.h"
+
+/// A chained hash table that can be shared between threads.
+///
+/// Buckets are guarded by Concurrent_Stripes locks. A key's stripe is picked from the
+/// top bits of its hash and the bucket index from the top log2(no_buckets) bits, so a
+/// stripe owns one run of buckets in every bucket array and an operation only ever
+/// holds the one lock for its key. Only size and apply_to_all take them all.
+///
+/// Growing moves the table over to a bucket array twice the size one stripe at a time:
+/// the stripe is locked while its entries are copied, then its pointer is switched to
+/// the new array. Writers to that stripe wait for the copy of its entries only, the
+/// other stripes carry on. The thread that grows the table does all the copying.
+///
+/// Lookups take no lock at all. Writers publish new entries and new bucket arrays with
+/// atomic stores, and removed entries (or the whole old array after a resize) are freed
+/// through the table's epoch domain once no reader can still be looking at them.
+
+    #define Concurrent_Stripe_Bits 6
+    #define Concurrent_Stripes (1 << Concurrent_Stripe_Bits) // also the smallest bucket count
+
+    /// A bucket array, replaced when the table grows
+    typedef struct concurrent_buckets
+    {
+        entry_t **heads;         // head of each chain, NULL if the bucket is empty
+        size_t no_buckets;       // always a power of two, at least Concurrent_Stripes
+        unsigned bucket_shift;   // 64 - log2(no_buckets)
+    } ioopm_concurrent_buckets_t;
+
+    /// One lock, the array its buckets are in and the number of entries in them. Padded
+    /// to its own cache line so threads working on different stripes do not slow each other down.
+    typedef struct concurrent_stripe
+    {
+        pthread_mutex_t lock;
+        ioopm_concurrent_buckets_t *buckets; // read with an atomic load, the old array until the stripe has moved
+        size_t size;
+    } __attribute__((aligned(64))) ioopm_concurrent_stripe_t;
+
+    typedef struct concurrent_hash_table
+    {
+        ioopm_concurrent_stripe_t stripes[Concurrent_Stripes];
+        ioopm_concurrent_buckets_t *buckets; // the newest array, every stripe's once a grow is done
+        pthread_mutex_t resize_lock;         // held by the one thread growing the table
+        ioopm_epoch_domain_t *epoch;         // retired entries and arrays wait here for readers to leave
+        float max_load_factor;
+        ioopm_hash_func *func;
+        ioopm_eq_function *eq_func;
+        bool should_free_keys;   // set before the table is shared, like for ioopm_hash_table_t
+    } ioopm_concurrent_hash_table_t;
+
+/// Called with the value of a key while its stripe is locked. inserted is true when
+/// the key was just added, *value is then zeroed.
+typedef void ioopm_update_function(elem_t *value, bool inserted, void *arg);
+
+/**
+ * Create an empty concurrent hash table.
+ * Only capacity and max_load_factor of opts are used; opts may be NULL.
+ * Returns NULL if no epoch domain could be set up for it.
+ */
+ioopm_concurrent_hash_table_t *ioopm_concurrent_hash_table_create(ioopm_hash_func *func, ioopm_eq_function *eq_func,
+                                                                  const ioopm_hash_table_options_t *opts);
+
+/**
+ * Destroy the table and its entries. No other thread may be using it.
+ */
+void ioopm_concurrent_hash_table_destroy(ioopm_concurrent_hash_table_t *ht);
+
+/**
+ * Insert a key/value pair, or replace the value if the key exists.
+ */
+void ioopm_concurrent_hash_table_insert(ioopm_concurrent_hash_table_t *ht, elem_t key, elem_t value);
+
+/**
+ * Atomically read-modify-write the value of key, adding the key if it is missing.
+ * If the key was already there and should_free_keys is set, the key passed in is freed.
+ * Returns true if the key was added.
+ */
+bool ioopm_concurrent_hash_table_upsert(ioopm_concurrent_hash_table_t *ht, elem_t key,
+                                        ioopm_update_function *update, void *arg);
+
+/**
+ * Atomically add delta to the int value of key (a missing key counts as 0), the
+ * concurrent version of ioopm_hash_table_insert_freq. Key ownership as for upsert.
+ * Returns the new value.
+ */
+int ioopm_concurrent_hash_table_increment(ioopm_concurrent_hash_table_t *ht, elem_t key, int delta);
+
+/**
+ * Lock-free lookup; scales with the number of reader threads while writers run.
+ */
+option_t ioopm_concurrent_hash_table_lookup(ioopm_concurrent_hash_table_t *ht, elem_t key);
+
+bool ioopm_concurrent_hash_table_has_key(ioopm_concurrent_hash_table_t *ht, elem_t key);
+
+/**
+ * Remove key and return the value it had. If should_free_keys is set the key is freed,
+ * once concurrent lookups are done with it.
+ */
+option_t ioopm_concurrent_hash_table_remove(ioopm_concurrent_hash_table_t *ht, elem_t key);
+
+/// @brief the number of entries, as of one moment (all stripes are locked while counting)
+size_t ioopm_concurrent_hash_table_size(ioopm_concurrent_hash_table_t *ht);
+
+/// @brief apply a function to all entries while the whole table is locked
+void ioopm_concurrent_hash_table_apply_to_all(ioopm_concurrent_hash_table_t *ht, ioopm_apply_function *apply_fun, void *arg);
@@ -0,0 +1,261 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "epoch.h"
+
+#define Reclaim_Every 64 // retires between attempts to advance the epoch
+
+typedef struct epoch_record epoch_record_t;
+typedef struct retired retired_t;
+
+/// One per thread that has entered the domain. It is on two lists, the domain's and
+/// the thread's, and freed by whichever of the two lets go of it last.
+struct epoch_record
+{
+    uint64_t state;          // (epoch << 1) | 1 while inside a critical section, 0 outside
+    unsigned nesting;        // only touched by the owning thread
+    bool in_use;             // false once the thread has exited, the record can be reused
+    epoch_record_t *next;    // records are never unlinked before the domain is destroyed
+    ioopm_epoch_domain_t *domain; // NULL once the domain is destroyed
+    epoch_record_t *thread_next;  // the other records of the thread using this one
+    int refs;                // 1 for the domain, 1 for a thread using it
+};
+
+struct retired
+{
+    void *ptr;
+    ioopm_reclaim_function *reclaim;
+    void *arg;
+    retired_t *next;
+};
+
+struct epoch_domain
+{
+    uint64_t global_epoch;
+    epoch_record_t *records;      // pushed with CAS, read without locks
+
+    pthread_mutex_t limbo_lock;   // retire and reclaim come from writers, they are rare enough
+    retired_t *limbo[3];          // retired in epoch e goes in limbo[e % 3]
+    size_t pending;
+    size_t retired_since_reclaim;
+};
+
+/// One key for all domains: each thread's list of records, one per domain it has entered.
+/// A key per domain would run out after PTHREAD_KEYS_MAX tables.
+static pthread_key_t thread_records;
+static pthread_once_t thread_records_once = PTHREAD_ONCE_INIT;
+static bool thread_records_made;
+
+static void unref_record(epoch_record_t *record)
+{
+    if (__atomic_sub_fetch(&record->refs, 1, __ATOMIC_ACQ_REL) == 0) free(record);
+}
+
+/// Thread exit: give back every record the thread holds, for other threads to reuse
+static void release_records(void *records)
+{
+    epoch_record_t *record = records;
+    while (record != NULL)
+    {
+        epoch_record_t *next = record->thread_next;
+        __atomic_store_n(&record->state, 0, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&record->in_use, false, __ATOMIC_RELEASE);
+        unref_record(record);
+        record = next;
+    }
+}
+
+static void make_thread_records(void)
+{
+    thread_records_made = pthread_key_create(&thread_records, release_records) == 0;
+}
+
+ioopm_epoch_domain_t *ioopm_epoch_domain_create(void)
+{
+    pthread_once(&thread_records_once, make_thread_records);
+    if (!thread_records_made) return NULL;
+
+    ioopm_epoch_domain_t *domain = calloc(1, sizeof(ioopm_epoch_domain_t));
+    pthread_mutex_init(&domain->limbo_lock, NULL);
+    return domain;
+}
+
+static void free_list(retired_t *list)
+{
+    while (list != NULL)
+    {
+        retired_t *next = list->next;
+        list->reclaim(list->ptr, list->arg);
+        free(list);
+        list = next;
+    }
+}
+
+void ioopm_epoch_domain_destroy(ioopm_epoch_domain_t *domain)
+{
+    if (!domain) return;
+
+    for (int i = 0; i < 3; i++) free_list(domain->limbo[i]);
+
+    // A record a thread still holds is freed when the thread drops it: at exit, or
+    // when it next looks through its records and finds this one orphaned
+    epoch_record_t *record = domain->records;
+    while (record != NULL)
+    {
+        epoch_record_t *next = record->next;
+        __atomic_store_n(&record->domain, NULL, __ATOMIC_RELEASE);
+        unref_record(record);
+        record = next;
+    }
+    pthread_mutex_destroy(&domain->limbo_lock);
+    free(domain);
+}
+
+/// This thread's record in domain, NULL if it has none yet. Drops records of destroyed
+/// domains on the way and moves the one found to the front, so the common case of one
+/// domain used over and over is a single step.
+static epoch_record_t *find_record(ioopm_epoch_domain_t *domain)
+{
+    epoch_record_t *head = pthread_getspecific(thread_records);
+    epoch_record_t **link = &head;
+    epoch_record_t *found = NULL;
+
+    while (*link != NULL)
+    {
+        epoch_record_t *record = *link;
+        ioopm_epoch_domain_t *owner = __atomic_load_n(&record->domain, __ATOMIC_ACQUIRE);
+        if (owner == NULL)
+        {
+            *link = record->thread_next;
+            unref_record(record);
+            continue;
+        }
+        if (owner == domain)
+        {
+            *link = record->thread_next;
+            found = record;
+            continue; // keep going, to prune the rest too
+        }
+        link = &record->thread_next;
+    }
+
+    if (found != NULL)
+    {
+        found->thread_next = head;
+        head = found;
+    }
+    pthread_setspecific(thread_records, head);
+    return found;
+}
+
+static epoch_record_t *this_thread(ioopm_epoch_domain_t *domain)
+{
+    epoch_record_t *head = pthread_getspecific(thread_records);
+    if (head != NULL && __atomic_load_n(&head->domain, __ATOMIC_ACQUIRE) == domain) return head;
+
+    epoch_record_t *record = find_record(domain);
+    if (record != NULL) return record;
+
+    // Reuse the record of a thread that has exited, or push a new one
+    for (record = __atomic_load_n(&domain->records, __ATOMIC_ACQUIRE); record != NULL; record = record->next)
+    {
+        bool unused = false;
+        if (__atomic_compare_exchange_n(&record->in_use, &unused, true, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            __atomic_add_fetch(&record->refs, 1, __ATOMIC_ACQ_REL);
+            break;
+        }
+    }
+    if (record == NULL)
+    {
+        record = calloc(1, sizeof(epoch_record_t));
+        record->in_use = true;
+        record->domain = domain;
+        record->refs = 2;
+        record->next = __atomic_load_n(&domain->records, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&domain->records, &record->next, record, true,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+    }
+    record->nesting = 0;
+    record->thread_next = pthread_getspecific(thread_records);
+    pthread_setspecific(thread_records, record);
+    return record;
+}
+
+void ioopm_epoch_enter(ioopm_epoch_domain_t *domain)
+{
+    epoch_record_t *record = this_thread(domain);
+    if (record->nesting++ > 0) return;
+
+    uint64_t epoch = __atomic_load_n(&domain->global_epoch, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&record->state, (epoch << 1) | 1, __ATOMIC_SEQ_CST);
+    // Announce before reading any shared pointer
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void ioopm_epoch_exit(ioopm_epoch_domain_t *domain)
+{
+    epoch_record_t *record = this_thread(domain); // the front record, it was just entered
+    if (--record->nesting > 0) return;
+
+    __atomic_store_n(&record->state, 0, __ATOMIC_RELEASE);
+}
+
+/// The epoch can move on once no thread is still inside an older one. Caller holds limbo_lock.
+static bool try_advance(ioopm_epoch_domain_t *domain)
+{
+    uint64_t epoch = __atomic_load_n(&domain->global_epoch, __ATOMIC_SEQ_CST);
+
+    for (epoch_record_t *record = __atomic_load_n(&domain->records, __ATOMIC_ACQUIRE); record != NULL; record = record->next)
+    {
+        uint64_t state = __atomic_load_n(&record->state, __ATOMIC_SEQ_CST);
+        if ((state & 1) && (state >> 1) != epoch) return false;
+    }
+
+    __atomic_store_n(&domain->global_epoch, epoch + 1, __ATOMIC_SEQ_CST);
+
+    // Readers are now all in epoch + 1 or epoch, so nothing retired in epoch - 1 is reachable
+    retired_t *safe = domain->limbo[(epoch + 2) % 3];
+    domain->limbo[(epoch + 2) % 3] = NULL;
+    for (retired_t *r = safe; r != NULL; r = r->next) domain->pending--;
+    free_list(safe);
+    return true;
+}
+
+void ioopm_epoch_retire(ioopm_epoch_domain_t *domain, void *ptr, ioopm_reclaim_function *reclaim, void *arg)
+{
+    retired_t *retired = malloc(sizeof(retired_t));
+    retired->ptr = ptr;
+    retired->reclaim = reclaim;
+    retired->arg = arg;
+
+    pthread_mutex_lock(&domain->limbo_lock);
+    uint64_t epoch = __atomic_load_n(&domain->global_epoch, __ATOMIC_SEQ_CST);
+    retired->next = domain->limbo[epoch % 3];
+    domain->limbo[epoch % 3] = retired;
+    domain->pending++;
+
+    if (++domain->retired_since_reclaim >= Reclaim_Every)
+    {
+        domain->retired_since_reclaim = 0;
+        try_advance(domain);
+    }
+    pthread_mutex_unlock(&domain->limbo_lock);
+}
+
+void ioopm_epoch_reclaim(ioopm_epoch_domain_t *domain)
+{
+    pthread_mutex_lock(&domain->limbo_lock);
+    // Two steps take everything retired so far out of reach, if no reader is in the way
+    if (try_advance(domain)) try_advance(domain);
+    pthread_mutex_unlock(&domain->limbo_lock);
+}
+
+size_t ioopm_epoch_pending(ioopm_epoch_domain_t *domain)
+{
+    pthread_mutex_lock(&domain->limbo_lock);
+    size_t pending = domain->pending;
+    pthread_mutex_unlock(&domain->limbo_lock);
+    return pending;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+/// Epoch based memory reclamation.
+///
+/// Readers wrap every access to shared nodes in ioopm_epoch_enter/ioopm_epoch_exit and
+/// take no locks. A writer that unlinks a node hands it to ioopm_epoch_retire instead of
+/// freeing it. The node is freed once every thread that might still be looking at it
+/// has left its critical section, i.e. two global epochs later.
+
+typedef struct epoch_domain ioopm_epoch_domain_t;
+
+/// Frees a retired pointer, arg is whatever was passed to ioopm_epoch_retire
+typedef void ioopm_reclaim_function(void *ptr, void *arg);
+
+/**
+ * Create a domain. Threads register themselves the first time they enter it.
+ * Returns NULL if the thread-specific key all domains share could not be made.
+ */
+ioopm_epoch_domain_t *ioopm_epoch_domain_create(void);
+
+/**
+ * Free everything still waiting to be reclaimed and the domain itself.
+ * No thread may be inside the domain.
+ */
+void ioopm_epoch_domain_destroy(ioopm_epoch_domain_t *domain);
+
+/**
+ * Start a read-side critical section. Pointers read from shared nodes stay valid until
+ * the matching ioopm_epoch_exit. Sections may be nested.
+ */
+void ioopm_epoch_enter(ioopm_epoch_domain_t *domain);
+
+void ioopm_epoch_exit(ioopm_epoch_domain_t *domain);
+
+/**
+ * Free ptr with reclaim(ptr, arg) once no reader can reach it any more.
+ * ptr must already be unlinked from every shared structure.
+ */
+void ioopm_epoch_retire(ioopm_epoch_domain_t *domain, void *ptr, ioopm_reclaim_function *reclaim, void *arg);
+
+/**
+ * Try to advance the global epoch and free what has become safe to free.
+ * Retire does this every now and then on its own.
+ */
+void ioopm_epoch_reclaim(ioopm_epoch_domain_t *domain);
+
+/// @brief number of retired pointers not yet freed
+size_t ioopm_epoch_pending(ioopm_epoch_domain_t *domain);
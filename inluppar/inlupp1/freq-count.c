@@ -1,6 +1,7 @@
 #define _POSIX_C_SOURCE 200809L
 #include "common.h"
 #include "hash_table.h"
+#include "hash_table_file.h"
 #include "iterator.h"
 #include "linked_list.h"
 
@@ -11,12 +12,12 @@
 
 #define Delimiters "+-#@()[]{}.,:;!? \t\n\r"
 
-// Comparison function for qsort
+// Comparison function for qsort, keys are the table's ioopm_str_t copies (NUL terminated)
 int cmp_str(const void *a, const void *b)
 {
-    const elem_t *x = a;
-    const elem_t *y = b;
-    return strcmp((char *)x->p, (char *)y->p);
+    const ioopm_str_t *x = ((const elem_t *) a)->p;
+    const ioopm_str_t *y = ((const elem_t *) b)->p;
+    return strcmp(x->ptr, y->ptr);
 }
 
 static void lowercase_inplace(char *s)
@@ -27,28 +28,21 @@ static void lowercase_inplace(char *s)
     }
 }
 
-// Convert hash table keys into a sorted array
-elem_t *get_keys(ioopm_hash_table_t *ht, size_t *out_size)
-{
-    ioopm_list_t *keys_list = ioopm_hash_table_keys(ht);
-    size_t size = keys_list->size;
+static bool is_delimiter[256];
 
-    if (size == 0)
-    {
-        ioopm_linked_list_destroy(keys_list);
-        *out_size = 0;
-        return NULL;
-    }
+static void init_delimiters(void)
+{
+    for (const char *d = Delimiters; *d; d++) is_delimiter[(unsigned char) *d] = true;
+    is_delimiter[0] = true;
+}
 
-    elem_t *arr = calloc(size, sizeof(elem_t));
-    for (size_t i = 0; i < size; i++)
-    {
-        arr[i] = ioopm_linked_list_get(keys_list, i);
-    }
+// Copy the hash table keys into an array (sorted by the caller)
+elem_t *get_keys(ioopm_hash_table_t *ht, size_t *out_size)
+{
+    *out_size = ioopm_hash_table_size(ht);
+    if (*out_size == 0) return NULL;
 
-    ioopm_linked_list_destroy(keys_list);
-    *out_size = size;
-    return arr;
+    return ioopm_hash_table_keys_array(ht, NULL);
 }
 
 // Print one key-frequency pair
@@ -57,30 +51,24 @@ void print_key_frequency(ioopm_hash_table_t *ht, elem_t key)
     option_t result = ioopm_hash_table_lookup(ht, key);
     if (result.success)
     {
-        printf("%s: %d\n", (char *)key.p, result.value.i);
+        printf("%s: %d\n", ((ioopm_str_t *) key.p)->ptr, result.value.i);
     }
 }
 
-// Sort array of keys lexicographically
-void sort_keys(elem_t *arr, size_t size)
+// Combine the counts of a word found in two tables
+static elem_t add_counts(elem_t a, elem_t b, void *arg)
 {
-    qsort(arr, size, sizeof(elem_t), cmp_str);
+    (void) arg;
+    return int_elem(a.i + b.i);
 }
 
-/// Insert a single word into the hash table
-void process_word(const char *word, ioopm_hash_table_t *ht)
+// Sort array of keys lexicographically
+void sort_keys(elem_t *arr, size_t size)
 {
-    char *key_copy = strdup(word);
-    if (!key_copy) {
-        fprintf(stderr, "Memory allocation failed for word: %s\n", word);
-        exit(EXIT_FAILURE);
-    }
-
-    lowercase_inplace(key_copy); 
-    ioopm_hash_table_insert_freq(ht, ptr_elem(key_copy));
+    qsort(arr, size, sizeof(elem_t), cmp_str);
 }
 
-/// Read a file and process all words
+/// Read a file and process all words, one line at a time
 void process_file(const char *filename, ioopm_hash_table_t *ht)
 {
     FILE *f = fopen(filename, "r");
@@ -91,21 +79,40 @@ void process_file(const char *filename, ioopm_hash_table_t *ht)
 
     char *buf = NULL;
     size_t len = 0;
+    ssize_t line_len;
+    ioopm_str_t *views = NULL; // the words of one line, slices of buf
+    elem_t *words = NULL;   // pointers to the views, handed to the table as a batch
+    size_t capacity = 0;
 
-    while (getline(&buf, &len, f) != -1)
+    while ((line_len = getline(&buf, &len, f)) != -1)
     {
-        // Tokenize the line using delimiters
-        for (char *word = strtok(buf, Delimiters);
-             word != NULL;
-             word = strtok(NULL, Delimiters))
+        size_t count = 0;
+        lowercase_inplace(buf);
+
+        // Split the line into slices of the buffer, nothing is copied or NUL terminated yet
+        for (char *p = buf, *end = buf + line_len; p < end; )
         {
-            if (*word)  // skip empty tokens
-            {
-                process_word(word, ht);
+            while (p < end && is_delimiter[(unsigned char) *p]) p++;
+            char *word = p;
+            while (p < end && !is_delimiter[(unsigned char) *p]) p++;
+            if (p == word) continue;
+
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                views = realloc(views, capacity * sizeof(ioopm_str_t));
+                words = realloc(words, capacity * sizeof(elem_t));
             }
+            views[count++] = ioopm_str_view(word, p - word);
         }
+
+        // The table copies the words it has not seen, nothing is malloc'ed for the others
+        for (size_t i = 0; i < count; i++) words[i] = ptr_elem(&views[i]);
+
+        ioopm_hash_table_insert_freq_batch(ht, words, count);
     }
 
+    free(words);
+    free(views);
     free(buf);   // free the line buffer
     fclose(f);
 }
@@ -113,20 +120,57 @@ void process_file(const char *filename, ioopm_hash_table_t *ht)
 int main(int argc, char *argv[])
 {   
     for(int i = 0; i < 1; i++){
-        if (argc < 2)
+        // --save FILE: also write the counts as a table file that can be mmap'ed later
+        // --stats: print the shape of the table (and its counters, if built with STATS=1) to stderr
+        const char *save_path = NULL;
+        bool print_stats = false;
+        int first_file = 1;
+        while (first_file < argc)
         {
-            puts("Usage: freq-count file1 ... filen");
+            if (strcmp(argv[first_file], "--stats") == 0)
+            {
+                print_stats = true;
+                first_file++;
+            }
+            else if (strcmp(argv[first_file], "--save") == 0 && first_file + 1 < argc)
+            {
+                save_path = argv[first_file + 1];
+                first_file += 2;
+            }
+            else break;
+        }
+
+        if (argc <= first_file)
+        {
+            puts("Usage: freq-count [--stats] [--save table-file] file1 ... filen");
             return 1;
         }
 
         // Create hash table
-        ioopm_hash_table_t *ht = ioopm_hash_table_create(hash_str, str_eq);
-        ht->should_free_keys = true;
+        // Every entry lives until the end, so take them from a slab and free them in one go.
+        // Words are copied into their entries, short ones (most of them) with no malloc of their own.
+        ioopm_hash_table_options_t opts = { .pooled_entries = true, .copy_keys = IOOPM_KEYS_COPY_STRVIEW };
+        ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_strview, strview_eq, &opts);
+
+        // The first file is counted straight into the total. Every other file is counted in a
+        // table of its own and merged in, the way partial counts from several threads would
+        // be. The tables are alike, so the merge relinks their entries and joins their slabs,
+        // no word is copied or hashed again. It also adds up their counters for --stats.
+        init_delimiters();
+        process_file(argv[first_file], ht);
+        for (int i = first_file + 1; i < argc; i++)
+        {
+            ioopm_hash_table_t *file_counts = ioopm_hash_table_create_with(hash_strview, strview_eq, &opts);
+            process_file(argv[i], file_counts);
+            ioopm_hash_table_merge(ht, file_counts, add_counts, NULL);
+            ioopm_hash_table_destroy(file_counts);
+        }
 
-        // Process all input files
-        for (int i = 1; i < argc; i++)
+        if (print_stats) ioopm_hash_table_print_stats(ht, stderr);
+
+        if (save_path && !ioopm_hash_table_save(ht, save_path, IOOPM_FILE_STRVIEW, IOOPM_FILE_INT))
         {
-            process_file(argv[i], ht);
+            perror(save_path);
         }
 
         // Extract keys and sort them
@@ -142,17 +186,11 @@ int main(int argc, char *argv[])
             {
                 print_key_frequency(ht, keys[i]);
             }   
-            
-            // CLEANUP: Remove each entry from hash table and free the strdup'ed key
-            for (size_t i = 0; i < size; i++)
-            {
-                ioopm_hash_table_remove(ht, keys[i]);
-                free(keys[i].p);  // Free the strdup'ed string
-            }
             free(keys); 
         }
 
-        // Destroy hash table (now empty, so no leaks)
+        // Destroy hash table: one pass frees the copied keys and the slab the entries are in,
+        // no key is hashed or looked up again
         ioopm_hash_table_destroy(ht);
     }
     return 0;
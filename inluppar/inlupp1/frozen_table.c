@@ -0,0 +1,243 @@
+#include <stdlib.h>
+#include <string.h>
+#include "frozen_table.h"
+#include "hash_table_internal.h"
+
+#define Direct_Slot 0x80000000u   // a displacement with this bit set is the slot of a lone key
+#define Max_Attempts (1u << 20)   // displacements tried for a group before trying another salt
+#define Max_Salts 8
+
+struct frozen_table
+{
+    size_t size;              // keys, and slots
+    size_t no_groups;
+    uint64_t salt;            // picks how keys are split into groups
+    uint32_t *displacements;  // one per group
+    elem_t *keys;             // slot i holds keys[i] => values[i]
+    elem_t *values;
+    ioopm_hash_func *func;
+    ioopm_seeded_hash_func *seeded_func;
+    ioopm_hash_seed_t seed;
+    ioopm_eq_function *eq_func;
+};
+
+/// Map a 64 bit number onto 0 .. n - 1 (no division, uses the high bits)
+static inline size_t scale(uint64_t x, size_t n)
+{
+    return (size_t) (((__uint128_t) x * n) >> 64);
+}
+
+/// splitmix64's finalizer, every bit of x affects every bit of the result
+static inline uint64_t mix(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+/// The group of a key. Mixed rather than Fibonacci hashed: the group sizes have to vary,
+/// so that the last groups to be placed, when the table is nearly full, are lone keys.
+static inline size_t group_of(uint64_t hash, uint64_t salt, size_t no_groups)
+{
+    return scale(mix(hash + salt), no_groups);
+}
+
+/// Where displacement d sends a key with this hash
+static inline size_t slot_of(uint64_t hash, uint32_t d, size_t size)
+{
+    return scale(mix(hash ^ ((uint64_t) d * Fib_Multiplier)), size);
+}
+
+/// ---------------------- Building ----------------------
+
+static int compare_hashes(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/// Two keys with the same full hash go to the same slot with every displacement and
+/// every salt; find them by sorting rather than by trying all of those
+static bool has_equal_hashes(const uint64_t *hashes, size_t size)
+{
+    uint64_t *sorted = malloc((size + 1) * sizeof(uint64_t));
+    memcpy(sorted, hashes, size * sizeof(uint64_t));
+    qsort(sorted, size, sizeof(uint64_t), compare_hashes);
+
+    bool equal = false;
+    for (size_t i = 1; !equal && i < size; i++) equal = sorted[i] == sorted[i - 1];
+    free(sorted);
+    return equal;
+}
+
+/// Find a displacement that puts every key of a group in a free slot of its own
+static bool place_group(const uint64_t *hashes, const size_t *members, size_t count,
+                        bool *taken, size_t size, size_t *slots, uint32_t *displacement)
+{
+    for (uint32_t d = 0; d < Max_Attempts; d++)
+    {
+        size_t placed = 0;
+        for (; placed < count; placed++)
+        {
+            size_t slot = slot_of(hashes[members[placed]], d, size);
+            if (taken[slot]) break;
+            taken[slot] = true; // also catches two keys of the group on the same slot
+            slots[placed] = slot;
+        }
+        if (placed == count)
+        {
+            *displacement = d;
+            return true;
+        }
+        for (size_t j = 0; j < placed; j++) taken[slots[j]] = false;
+    }
+    return false;
+}
+
+/// Split the keys into groups with ft->salt and place them, biggest groups first
+static bool layout(ioopm_frozen_table_t *ft, const uint64_t *hashes, const elem_t *pairs)
+{
+    size_t size = ft->size;
+    size_t no_groups = ft->no_groups;
+
+    // Sort the keys by group (counting sort), members[start[g] .. start[g + 1]) are in group g
+    size_t *start = calloc(no_groups + 1, sizeof(size_t));
+    size_t *members = malloc((size + 1) * sizeof(size_t));
+    for (size_t i = 0; i < size; i++) start[group_of(hashes[i], ft->salt, no_groups) + 1]++;
+    size_t largest = 0;
+    for (size_t g = 0; g < no_groups; g++)
+    {
+        if (start[g + 1] > largest) largest = start[g + 1];
+        start[g + 1] += start[g];
+    }
+    size_t *fill = malloc(no_groups * sizeof(size_t));
+    memcpy(fill, start, no_groups * sizeof(size_t));
+    for (size_t i = 0; i < size; i++) members[fill[group_of(hashes[i], ft->salt, no_groups)]++] = i;
+
+    // Biggest groups first, while there is still room for them (counting sort again)
+    size_t *by_size = calloc(largest + 2, sizeof(size_t));
+    size_t *order = malloc(no_groups * sizeof(size_t));
+    for (size_t g = 0; g < no_groups; g++) by_size[largest - (start[g + 1] - start[g]) + 1]++;
+    for (size_t s = 0; s <= largest; s++) by_size[s + 1] += by_size[s];
+    for (size_t g = 0; g < no_groups; g++) order[by_size[largest - (start[g + 1] - start[g])]++] = g;
+
+    bool *taken = calloc(size + 1, sizeof(bool));
+    size_t *slots = malloc((largest + 1) * sizeof(size_t));
+    size_t next_free = 0;
+    bool ok = true;
+
+    for (size_t k = 0; ok && k < no_groups; k++)
+    {
+        size_t g = order[k];
+        size_t count = start[g + 1] - start[g];
+        const size_t *group = members + start[g];
+        if (count == 0) break; // the rest are empty too
+
+        if (count == 1)
+        {
+            // Lone keys go straight to a free slot, no search while the table is nearly full
+            while (taken[next_free]) next_free++;
+            taken[next_free] = true;
+            slots[0] = next_free;
+            ft->displacements[g] = Direct_Slot | (uint32_t) next_free;
+        }
+        else
+        {
+            ok = place_group(hashes, group, count, taken, size, slots, &ft->displacements[g]);
+            if (!ok) break;
+        }
+
+        for (size_t j = 0; j < count; j++)
+        {
+            ft->keys[slots[j]] = pairs[2 * group[j]];
+            ft->values[slots[j]] = pairs[2 * group[j] + 1];
+        }
+    }
+
+    free(slots);
+    free(taken);
+    free(order);
+    free(by_size);
+    free(fill);
+    free(members);
+    free(start);
+    return ok;
+}
+
+ioopm_frozen_table_t *ioopm_hash_table_freeze(ioopm_hash_table_t *ht)
+{
+    size_t size = ioopm_hash_table_size(ht);
+    if (size >= Direct_Slot) return NULL;
+
+    ioopm_frozen_table_t *ft = calloc(1, sizeof(ioopm_frozen_table_t));
+    ft->size = size;
+    ft->no_groups = size / Frozen_Group_Size + 1;
+    ft->displacements = calloc(ft->no_groups, sizeof(uint32_t));
+    ft->keys = malloc((size + 1) * sizeof(elem_t));
+    ft->values = malloc((size + 1) * sizeof(elem_t));
+    ft->func = ht->func;
+    ft->seeded_func = ht->seeded_func;
+    ft->seed = ht->seed;
+    ft->eq_func = ht->eq_func;
+
+    elem_t *pairs = ioopm_hash_table_pairs_array(ht, NULL);
+    uint64_t *hashes = malloc((size + 1) * sizeof(uint64_t));
+    for (size_t i = 0; i < size; i++) hashes[i] = hash_of(ht, pairs[2 * i]);
+
+    // A split that leaves a group with nowhere to go is very unlikely, try another one
+    bool ok = false;
+    bool separable = !has_equal_hashes(hashes, size);
+    for (uint64_t salt = 0; separable && !ok && salt < Max_Salts; salt++)
+    {
+        ft->salt = salt * Fib_Multiplier;
+        ok = layout(ft, hashes, pairs);
+    }
+
+    free(hashes);
+    free(pairs);
+    if (!ok)
+    {
+        ioopm_frozen_table_destroy(ft);
+        return NULL;
+    }
+    return ft;
+}
+
+void ioopm_frozen_table_destroy(ioopm_frozen_table_t *ft)
+{
+    if (!ft) return;
+    free(ft->displacements);
+    free(ft->keys);
+    free(ft->values);
+    free(ft);
+}
+
+/// ---------------------- Reading ----------------------
+
+option_t ioopm_frozen_table_lookup(ioopm_frozen_table_t *ft, elem_t key)
+{
+    if (ft->size == 0) return Failure();
+
+    uint64_t hash = ft->seeded_func ? ft->seeded_func(key, ft->seed) : ft->func(key);
+    hash = hash != 0 ? hash : 1; // as hash_of does
+    uint32_t d = ft->displacements[group_of(hash, ft->salt, ft->no_groups)];
+    size_t slot = d & Direct_Slot ? d & ~Direct_Slot : slot_of(hash, d, ft->size);
+
+    if (ft->eq_func(ft->keys[slot], key)) return Success(ft->values[slot]);
+    return Failure();
+}
+
+bool ioopm_frozen_table_has_key(ioopm_frozen_table_t *ft, elem_t key)
+{
+    return ioopm_frozen_table_lookup(ft, key).success;
+}
+
+size_t ioopm_frozen_table_size(ioopm_frozen_table_t *ft)
+{
+    return ft->size;
+}
+
+void ioopm_frozen_table_apply_to_all(ioopm_frozen_table_t *ft, ioopm_apply_function *apply_fun, void *arg)
+{
+    for (size_t i = 0; i < ft->size; i++) apply_fun(ft->keys[i], &ft->values[i], arg);
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include "common.h"
+#include "hash_table.h"
+
+/// An immutable snapshot of a hash table for tables that are only read once built,
+/// e.g. a stop-word set or a loaded catalog.
+///
+/// ioopm_hash_table_freeze builds a minimal perfect hash over the keys (CHD: hash,
+/// displace and compress). Keys are split into small groups and every group gets a
+/// displacement that sends its keys to distinct slots, so n keys fill exactly n slots
+/// and a lookup is one slot and one eq_func call, never more, whatever the keys are.
+/// Besides the keys and values there are only 4 bytes per Frozen_Group_Size keys.
+
+#define Frozen_Group_Size 4 // average keys per displacement; larger is smaller but slower to build
+
+typedef struct frozen_table ioopm_frozen_table_t;
+
+/**
+ * Build a frozen table with the keys, values, hash and eq functions of ht.
+ * Keys are shared with ht, not copied: the frozen table never frees them.
+ * Returns NULL if two keys have the same full hash (they can not be told apart; this
+ * is found by sorting the hashes, before any placement is tried), or for 2^31 keys or more.
+ */
+ioopm_frozen_table_t *ioopm_hash_table_freeze(ioopm_hash_table_t *ht);
+
+void ioopm_frozen_table_destroy(ioopm_frozen_table_t *ft);
+
+/// @brief one probe and one key compare
+option_t ioopm_frozen_table_lookup(ioopm_frozen_table_t *ft, elem_t key);
+
+bool ioopm_frozen_table_has_key(ioopm_frozen_table_t *ft, elem_t key);
+
+size_t ioopm_frozen_table_size(ioopm_frozen_table_t *ft);
+
+/// @brief apply a function to all entries; it may change values but not keys
+void ioopm_frozen_table_apply_to_all(ioopm_frozen_table_t *ft, ioopm_apply_function *apply_fun, void *arg);
@@ -7,333 +7,1840 @@
     #include "linked_list.h"
     #include "common.h"
     #include "hash_table.h"
+    #include "hash_table_internal.h"
 
-    #define No_Buckets 5  
+    #define Max_Open_Load_Factor 0.95f // open addressing needs at least one empty slot
 
+    /// Smallest power of two bucket count that keeps `entries` under the load factor
+    static size_t buckets_for(size_t entries, float max_load_factor)
+    {
+        size_t n = Min_Buckets;
+        while ((float) entries > (float) n * max_load_factor) n <<= 1;
+        return n;
+    }
+
+    /// ---------------------- Copied keys ----------------------
+
+    /// Copy a key the table is going to own into area if it fits in room bytes, otherwise
+    /// into a block of its own. Copies are NUL terminated so they print like any string.
+    static elem_t copy_key(ioopm_hash_table_t *ht, elem_t key, void *area, size_t room)
+    {
+        if (ht->copy_keys == IOOPM_KEYS_COPY_STRVIEW)
+        {
+            const ioopm_str_t *view = key.p;
+            if (sizeof(ioopm_str_t) + view->len + 1 > room) return ptr_elem(ioopm_str_dup(view));
+
+            ioopm_str_t *copy = area;
+            char *chars = (char *) (copy + 1);
+            memcpy(chars, view->ptr, view->len);
+            chars[view->len] = '\0';
+            *copy = (ioopm_str_t) { .ptr = chars, .len = view->len, .hash = view->hash };
+            return ptr_elem(copy);
+        }
 
-    /// Find the previous entry for a given key in a bucket
-    static entry_t* find_previous_entry_for_key(ioopm_hash_table_t *ht ,entry_t *bucket_head, elem_t key)
+        size_t size = strlen(key.p) + 1;
+        char *copy = size <= room ? area : malloc(size);
+        memcpy(copy, key.p, size);
+        return ptr_elem(copy);
+    }
+
+    /// ---------------------- Chained backend ----------------------
+
+    /// A short copied key sits right after its entry and goes away with it
+    static inline bool key_is_inline(entry_t *entry)
+    {
+        return entry->key.p == (void *) (entry + 1);
+    }
+
+    /// Find the previous entry for a given key in a bucket.
+    /// Entries with a different cached hash are skipped without calling eq_func.
+    static entry_t* find_previous_entry_for_key(ioopm_hash_table_t *ht ,entry_t *bucket_head, elem_t key, uint64_t hash)
     {
         entry_t *current = bucket_head; // bucket_head should be dummy
         while (current->next != NULL)
         {
-            if (ht->eq_func(current->next->key, key))
+            if (current->next->hash == hash && Eq(ht, current->next->key, key))
                 return current; // previous entry
             current = current->next;
         }
         return NULL;
     }
 
+    static elem_t *chained_find(ioopm_hash_table_t *ht, elem_t key, uint64_t hash)
+    {
+        entry_t *current = ht->buckets[home_index(hash, ht->bucket_shift)].next; // skip dummy head
+
+        while (current != NULL)
+        {
+            if (current->hash == hash && Eq(ht, current->key, key))
+            {
+                return &current->value;
+            }
+            current = current->next;
+        }
+        return NULL;
+    }
+
+    static inline entry_t *alloc_entry(ioopm_hash_table_t *ht)
+    {
+        return ht->entry_slab ? ioopm_slab_alloc(ht->entry_slab) : malloc(sizeof(entry_t) + ht->inline_key_room);
+    }
+
+    static inline void free_entry(ioopm_hash_table_t *ht, entry_t *entry)
+    {
+        if (ht->entry_slab) ioopm_slab_free(ht->entry_slab, entry);
+        else free(entry);
+    }
+
     // Enters a value into the hashtable
-    static void entry_input(ioopm_hash_table_t *ht, elem_t key, elem_t value)
+    static elem_t *entry_input(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t value)
     {
-        int bucket = ht->func(key);
+        size_t bucket = home_index(hash, ht->bucket_shift);
 
-        entry_t *new_entry = malloc(sizeof(entry_t));
-        new_entry->key = key;
+        entry_t *new_entry = alloc_entry(ht);
+        new_entry->key = ht->copy_keys ? copy_key(ht, key, new_entry + 1, ht->inline_key_room) : key;
         new_entry->value = value;
+        new_entry->hash = hash;
 
         // Attach after dummy head
         new_entry->next = ht->buckets[bucket].next;
         ht->buckets[bucket].next = new_entry;
+        return &new_entry->value;
     }
 
-    // Creates a new hash table with calloc, and sets dummy values.
-    ioopm_hash_table_t *ioopm_hash_table_create(ioopm_hash_func *func, ioopm_eq_function *eq_func)
+    static bool chained_remove(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t *removed_key, elem_t *removed_value)
     {
-        ioopm_hash_table_t *ht = calloc(1, sizeof(ioopm_hash_table_t));
-        ht->func = func;
-        ht->eq_func = eq_func;
-        ht->size = 0; 
-        ht->should_free_keys = false;
-        return ht;
+        entry_t *prev = find_previous_entry_for_key(ht, &ht->buckets[home_index(hash, ht->bucket_shift)], key, hash);
+        if (prev == NULL) return false;
+
+        entry_t *target = prev->next;
+        prev->next = target->next;
+        *removed_key = key_is_inline(target) ? ptr_elem(NULL) : target->key;
+        *removed_value = target->value;
+        free_entry(ht, target);
+        return true;
     }
 
-void ioopm_hash_table_destroy(ioopm_hash_table_t *ht)
-{
-    if (!ht) return;
-    
-    for (int i = 0; i < No_Buckets; i++)
+    /// Move every entry into a freshly allocated bucket array of new_no_buckets
+    static void rehash(ioopm_hash_table_t *ht, size_t new_no_buckets)
     {
-        entry_t *current = ht->buckets[i].next;
-        while (current != NULL)
+        entry_t *old_buckets = ht->buckets;
+        size_t old_no_buckets = ht->no_buckets;
+
+        ht->buckets = calloc(new_no_buckets, sizeof(entry_t));
+        ht->no_buckets = new_no_buckets;
+        ht->bucket_shift = shift_for(new_no_buckets);
+
+        for (size_t i = 0; i < old_no_buckets; i++)
         {
-            entry_t *next = current->next;
-            
-            // Only free keys if the flag is set
-            if (ht->should_free_keys && current->key.p != NULL) {
-                free(current->key.p);
+            entry_t *current = old_buckets[i].next;
+            while (current != NULL)
+            {
+                entry_t *next = current->next;
+                size_t bucket = home_index(current->hash, ht->bucket_shift); // no rehashing of keys
+                current->next = ht->buckets[bucket].next;
+                ht->buckets[bucket].next = current;
+                current = next;
             }
-            
-            free(current);
-            current = next;
         }
-        ht->buckets[i].next = NULL;
+        free(old_buckets);
     }
-    
-    free(ht);
-}
 
-
-    // Inserts a new value into the hashtable
-    void ioopm_hash_table_insert(ioopm_hash_table_t *ht, elem_t key, elem_t value)
+    static bool chained_each(ioopm_hash_table_t *ht, size_t from, size_t to, entry_visitor *visit, void *arg)
     {
-        int bucket = ht->func(key);
-        entry_t *current = ht->buckets[bucket].next; // skip dummy head
-
-        while (current != NULL)
+        for (size_t i = from; i < to; i++)
         {
-            if (ht->eq_func(current->key, key))
+            entry_t *current = ht->buckets[i].next;
+            while (current != NULL)
             {
-                // Key exists → update value
-                current->value = value;
-                return;
+                if (!visit(current->key, &current->value, arg)) return false;
+                current = current->next;
             }
-            current = current->next;
         }
-
-        entry_input(ht, key, value);
-        ht->size++;
+        return true;
     }
 
-
-    // Inserts a new value into the hashtable
-    void ioopm_hash_table_insert_freq(ioopm_hash_table_t *ht, elem_t key)
+    // Frees every entry (and key, if the table owns them) but keeps the bucket array
+    static void chained_clear(ioopm_hash_table_t *ht)
     {
-        int bucket = ht->func(key);
-        entry_t *current = ht->buckets[bucket].next; // skip dummy head
-
-        while (current != NULL)
+        if (ht->owns_entry_slab)
         {
-            if (ht->eq_func(current->key, key))
+            // Only walk the chains if there are keys to free, the entries go back in one go
+            if (ht->should_free_keys)
             {
-                // Key exists → increment frequency
-                current->value.i++;
-                free(key.p);  // only if key.p was dynamically allocated!
-                return;
+                for (size_t i = 0; i < ht->no_buckets; i++)
+                {
+                    for (entry_t *current = ht->buckets[i].next; current != NULL; current = current->next)
+                    {
+                        if (current->key.p != NULL && !key_is_inline(current)) free(current->key.p);
+                    }
+                }
             }
-            current = current->next;
+            memset(ht->buckets, 0, ht->no_buckets * sizeof(entry_t));
+            ioopm_slab_reset(ht->entry_slab);
+            return;
         }
 
-        // Key not found → insert new entry with frequency 1
-        entry_input(ht, key, int_elem(1));
-        ht->size++;
-    }
-    //Om ett värde finns lägg till ett på valuet, annars sätt value till 0, iterera genom ht till vi kommer till slutet.
-
-    // Gets a value from the hashtable, same as lookup but used for testing
-    elem_t ioopm_hash_table_get(ioopm_hash_table_t *ht, elem_t key)
-    {
-        int bucket = ht->func(key);
-        entry_t *current = ht->buckets[bucket].next;
-
-        while (current != NULL)
+        for (size_t i = 0; i < ht->no_buckets; i++)
         {
-            if (ht->eq_func(current->key, key))
+            entry_t *current = ht->buckets[i].next;
+            while (current != NULL)
             {
-                return current->value;
+                entry_t *tmp = current;
+                current = current->next;
+
+                // FREE THE KEY if should_free_keys is set
+                if (ht->should_free_keys && tmp->key.p != NULL && !key_is_inline(tmp)) {
+                    free(tmp->key.p);
+                }
+
+                free_entry(ht, tmp);
             }
-            current = current->next;
+            ht->buckets[i].next = NULL; // reset bucket
         }
-        return (elem_t){ .p = NULL };
     }
 
-    #define SuccessElem(e)   (option_t){ .success = true,  .value = (e) }
-    #define SuccessInt(i)    (option_t){ .success = true,  .value = (elem_t){ .i = (i) } }
-    #define SuccessPtr(p)    (option_t){ .success = true,  .value = (elem_t){ .p = (p) } }
-    #define Failure()        (option_t){ .success = false, .value = (elem_t){ .p = NULL } }
-    #define Successful(o)    ((o).success == true)
-    #define Unsuccessful(o)  ((o).success == false)
+    /// ---------------------- Backend dispatch ----------------------
 
+    static void init_storage(ioopm_hash_table_t *ht, size_t no_buckets)
+    {
+        switch (ht->backend)
+        {
+        case IOOPM_HT_ROBIN_HOOD:
+            ioopm_robin_init(ht, no_buckets);
+            break;
+        case IOOPM_HT_SWISS:
+            ioopm_swiss_init(ht, no_buckets);
+            break;
+        case IOOPM_HT_ORDERED:
+            ioopm_ordered_init(ht, no_buckets);
+            break;
+        default:
+            ht->no_buckets = no_buckets;
+            ht->bucket_shift = shift_for(no_buckets);
+            ht->buckets = calloc(no_buckets, sizeof(entry_t));
+        }
+    }
 
-    option_t ioopm_hash_table_lookup(ioopm_hash_table_t *ht, elem_t key)
+    static void free_storage(ioopm_hash_table_t *ht)
     {
-        entry_t *prev = find_previous_entry_for_key(ht, &ht->buckets[ht->func(key)], key);
+        switch (ht->backend)
+        {
+        case IOOPM_HT_ROBIN_HOOD:
+            ioopm_robin_free(ht);
+            break;
+        case IOOPM_HT_SWISS:
+            ioopm_swiss_free(ht);
+            break;
+        case IOOPM_HT_ORDERED:
+            ioopm_ordered_free(ht);
+            break;
+        default:
+            free(ht->buckets);
+        }
+    }
 
-        if (prev != NULL)
+    static inline elem_t *backend_find(ioopm_hash_table_t *ht, elem_t key, uint64_t hash)
+    {
+        switch (ht->backend)
         {
-            entry_t *curr = prev->next;
-            if (curr && ht->eq_func(curr->key, key))
-            {
-                return SuccessElem(curr->value);   // return the union directly
-            }
+        case IOOPM_HT_ROBIN_HOOD:
+            return ioopm_robin_find(ht, key, hash);
+        case IOOPM_HT_SWISS:
+            return ioopm_swiss_find(ht, key, hash);
+        case IOOPM_HT_ORDERED:
+            return ioopm_ordered_find(ht, key, hash);
+        default:
+            return chained_find(ht, key, hash);
         }
+    }
 
-        return Failure();
+    static void backend_resize(ioopm_hash_table_t *ht, size_t no_buckets)
+    {
+        switch (ht->backend)
+        {
+        case IOOPM_HT_ROBIN_HOOD:
+            ioopm_robin_resize(ht, no_buckets);
+            break;
+        case IOOPM_HT_SWISS:
+            ioopm_swiss_resize(ht, no_buckets);
+            break;
+        case IOOPM_HT_ORDERED:
+            ioopm_ordered_resize(ht, no_buckets);
+            break;
+        default:
+            rehash(ht, no_buckets);
+        }
     }
 
-    // Removes a value from the hashtable, and frees the memory used
-    void ioopm_hash_table_remove(ioopm_hash_table_t *ht, elem_t key)
+    static inline elem_t *backend_insert(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t value)
     {
-        entry_t *prev = find_previous_entry_for_key(ht, &ht->buckets[ht->func(key)], key);
+        switch (ht->backend)
+        {
+        case IOOPM_HT_ROBIN_HOOD:
+            return ioopm_robin_insert_new(ht, key, hash, value);
+        case IOOPM_HT_SWISS:
+            return ioopm_swiss_insert_new(ht, key, hash, value);
+        case IOOPM_HT_ORDERED:
+            return ioopm_ordered_insert_new(ht, key, hash, value);
+        default:
+            return entry_input(ht, key, hash, value);
+        }
+    }
 
-        if (prev != NULL)
+    /// Start loading the first cache line(s) a find for hash will touch
+    static inline void backend_prefetch(ioopm_hash_table_t *ht, uint64_t hash)
+    {
+        switch (ht->backend)
         {
-            entry_t *target = prev->next; 
+        case IOOPM_HT_ROBIN_HOOD:
+            ioopm_robin_prefetch(ht, hash);
+            break;
+        case IOOPM_HT_SWISS:
+            ioopm_swiss_prefetch(ht, hash);
+            break;
+        case IOOPM_HT_ORDERED:
+            ioopm_ordered_prefetch(ht, hash);
+            break;
+        default:
+            __builtin_prefetch(&ht->buckets[home_index(hash, ht->bucket_shift)]);
+        }
+    }
 
-            if (target && ht->eq_func(target->key, key))
-            {
-                prev->next = target->next; 
-                
-                // FREE THE KEY if should_free_keys is set
-                if (ht->should_free_keys && target->key.p != NULL) {
-                    free(target->key.p);
-                }
-                
-                free(target);
-                ht->size--;
-            }
+    static bool backend_remove(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t *removed_key, elem_t *removed_value)
+    {
+        switch (ht->backend)
+        {
+        case IOOPM_HT_ROBIN_HOOD:
+            return ioopm_robin_remove(ht, key, hash, removed_key, removed_value);
+        case IOOPM_HT_SWISS:
+            return ioopm_swiss_remove(ht, key, hash, removed_key, removed_value);
+        case IOOPM_HT_ORDERED:
+            return ioopm_ordered_remove(ht, key, hash, removed_key, removed_value);
+        default:
+            return chained_remove(ht, key, hash, removed_key, removed_value);
         }
     }
-    /// @brief returns the number of key => value entries in the hash table
-    size_t ioopm_hash_table_size(ioopm_hash_table_t *ht)
+
+    /// Where backend_each positions end: entries for IOOPM_HT_ORDERED, buckets/slots otherwise
+    static inline size_t storage_length(ioopm_hash_table_t *ht)
     {
-        return ht->size;
+        return ht->backend == IOOPM_HT_ORDERED ? ht->entries_used : ht->no_buckets;
     }
 
-    /// @brief checks if the hash table is empty
-    bool ioopm_hash_table_is_empty(ioopm_hash_table_t *ht)
+    /// Visit the entries of buckets/slots (IOOPM_HT_ORDERED: entry positions) from .. to - 1
+    static bool backend_each(ioopm_hash_table_t *ht, size_t from, size_t to, entry_visitor *visit, void *arg)
     {
-        return ioopm_hash_table_size(ht) == 0;
+        switch (ht->backend)
+        {
+        case IOOPM_HT_ROBIN_HOOD:
+            return ioopm_robin_each(ht, from, to, visit, arg);
+        case IOOPM_HT_SWISS:
+            return ioopm_swiss_each(ht, from, to, visit, arg);
+        case IOOPM_HT_ORDERED:
+            return ioopm_ordered_each(ht, from, to, visit, arg);
+        default:
+            return chained_each(ht, from, to, visit, arg);
+        }
     }
 
-    // Removes all entries from the hashtable but keeps the table itself
-    void ioopm_hash_table_clear(ioopm_hash_table_t *ht)
+    static void backend_clear(ioopm_hash_table_t *ht)
     {
-        for (int i = 0; i < No_Buckets; i++)
+        switch (ht->backend)
         {
-            entry_t *current = ht->buckets[i].next;
-            while (current != NULL)
-            {
-                entry_t *tmp = current;
-                current = current->next;
-                
-                // FREE THE KEY if should_free_keys is set
-                if (ht->should_free_keys && tmp->key.p != NULL) {
-                    free(tmp->key.p);
-                }
-                
-                free(tmp);
-            }
-            ht->buckets[i].next = NULL; // reset bucket
+        case IOOPM_HT_ROBIN_HOOD:
+            ioopm_robin_clear(ht);
+            break;
+        case IOOPM_HT_SWISS:
+            ioopm_swiss_clear(ht);
+            break;
+        case IOOPM_HT_ORDERED:
+            ioopm_ordered_clear(ht);
+            break;
+        default:
+            chained_clear(ht);
         }
-        ht->size = 0;
     }
 
-    /// @brief return the keys for all entries in a hash map (in no particular order)
-    ioopm_list_t *ioopm_hash_table_keys(ioopm_hash_table_t *ht)
+    /// ---------------------- Incremental resizing ----------------------
+
+    /// With incremental_resize a resize only allocates the new storage. The old storage is
+    /// kept in a shadow table (ht->migrating_from) and every insert of a new key and every
+    /// remove moves a bounded number of its entries over, so no single operation pays for
+    /// the whole table. Lookups and removes check the new storage first and the old one
+    /// second. Lookups never move anything, so a value slot stays where it is until the
+    /// table is next changed.
+
+    #define Migrate_Work_Per_Op 32 // entries moved or empty buckets skipped per operation
+
+    /// Move one entry (or skip one empty bucket/slot) of the old storage, false if it was empty
+    static bool migrate_one(ioopm_hash_table_t *ht, ioopm_hash_table_t *old)
     {
-        size_t total_keys = ioopm_hash_table_size(ht);
-        if (total_keys == 0) return NULL;
+        if (ht->backend == IOOPM_HT_CHAINED)
+        {
+            // Relink the entry itself, no allocation and no eq_func calls
+            entry_t *head = &old->buckets[old->migrate_pos];
+            entry_t *moved = head->next;
+            if (moved == NULL) return false;
 
-        ioopm_list_t *list = ioopm_linked_list_create(ht->eq_func);
+            head->next = moved->next;
+            size_t bucket = home_index(moved->hash, ht->bucket_shift);
+            moved->next = ht->buckets[bucket].next;
+            ht->buckets[bucket].next = moved;
+            return true;
+        }
 
-        for (int i = 0; i < No_Buckets; i++)
+        elem_t key, value;
+        uint64_t hash;
+        bool taken;
+        switch (ht->backend)
         {
-            entry_t *current = ht->buckets[i].next;
-            while (current != NULL)
-            {
-                ioopm_linked_list_append(list, current->key);
-                current = current->next;
-            }
+        case IOOPM_HT_ROBIN_HOOD:
+            taken = ioopm_robin_take_at(old, old->migrate_pos, &key, &value, &hash);
+            break;
+        case IOOPM_HT_SWISS:
+            taken = ioopm_swiss_take_at(old, old->migrate_pos, &key, &value, &hash);
+            break;
+        default:
+            // In entry order, so the moved entries stay ahead of the ones inserted since
+            taken = ioopm_ordered_take_at(old, old->migrate_pos, &key, &value, &hash);
         }
+        if (!taken) return false;
 
-        return list;
+        backend_insert(ht, key, hash, value);
+        return true;
     }
 
-    /// @brief return the values for all entries in a hash map (in no particular order)
-    ioopm_list_t *ioopm_hash_table_values(ioopm_hash_table_t *ht)
+    static void free_old_storage(ioopm_hash_table_t *ht)
     {
-        size_t total_keys = ioopm_hash_table_size(ht);
-        if (!total_keys) return NULL;
+        ht->counters.eq_calls += ht->migrating_from->counters.eq_calls;
+        free_storage(ht->migrating_from);
+        free(ht->migrating_from);
+        ht->migrating_from = NULL;
+    }
 
-        ioopm_list_t *list = ioopm_linked_list_create(ht->eq_func);
+    /// Do up to `work` units of migration, and drop the old storage once it is empty
+    static void migrate_step(ioopm_hash_table_t *ht, size_t work)
+    {
+        ioopm_hash_table_t *old = ht->migrating_from;
 
-        for (int i = 0; i < No_Buckets; i++)
+        while (work > 0 && old->size > 0)
         {
-            entry_t *current = ht->buckets[i].next;
-            while (current != NULL)
+            if (migrate_one(ht, old)) old->size--;
+            else old->migrate_pos++;
+            work--;
+        }
+
+        if (old->size == 0) free_old_storage(ht);
+    }
+
+    /// Finish any migration in progress, for operations that want a single storage
+    static void finish_migration(ioopm_hash_table_t *ht)
+    {
+        if (ht->migrating_from != NULL) migrate_step(ht, SIZE_MAX);
+    }
+
+    static void start_migration(ioopm_hash_table_t *ht, size_t no_buckets)
+    {
+        finish_migration(ht);
+
+        ioopm_hash_table_t *old = malloc(sizeof(ioopm_hash_table_t));
+        *old = *ht;                    // takes over the current storage
+        old->counters = (ioopm_hash_table_counters_t) { 0 };
+        old->owns_entry_slab = false;  // a shared slab stays with ht
+        old->filter = NULL;            // so does the key filter, it covers both storages
+        old->migrate_pos = 0;
+
+        init_storage(ht, no_buckets);
+        ht->migrating_from = old;
+        migrate_step(ht, Migrate_Work_Per_Op);
+    }
+
+    /// ---------------------- Key filter ----------------------
+
+    #define Filter_Stale_Slack 32 // removes tolerated on top of size / 2 before a rebuild
+
+    /// Add the cached hash of every entry in storage (ht itself or the one being migrated from)
+    static void filter_storage(ioopm_hash_table_t *ht, ioopm_hash_table_t *storage)
+    {
+        switch (storage->backend)
+        {
+        case IOOPM_HT_ROBIN_HOOD:
+            for (size_t i = 0; i < storage->no_buckets; i++)
             {
-                ioopm_linked_list_append(list, current->value);
-                current = current->next;
+                if (storage->slot_hashes[i] != 0) ioopm_filter_add(ht, storage->slot_hashes[i]);
+            }
+            break;
+        case IOOPM_HT_SWISS:
+            for (size_t i = 0; i < storage->no_buckets; i++)
+            {
+                if (!(storage->ctrl[i] & 0x80)) ioopm_filter_add(ht, storage->slot_hashes[i]);
+            }
+            break;
+        case IOOPM_HT_ORDERED:
+            for (size_t e = 0; e < storage->entries_used; e++)
+            {
+                if (storage->slot_hashes[e] != 0) ioopm_filter_add(ht, storage->slot_hashes[e]);
+            }
+            break;
+        default:
+            for (size_t i = 0; i < storage->no_buckets; i++)
+            {
+                for (entry_t *current = storage->buckets[i].next; current != NULL; current = current->next)
+                {
+                    ioopm_filter_add(ht, current->hash);
+                }
             }
         }
+    }
 
-        return list;
+    /// Build the filter afresh, sized for as many keys as the buckets take before the next grow
+    static void rebuild_filter(ioopm_hash_table_t *ht)
+    {
+        ioopm_filter_init(ht, (size_t) ((float) ht->no_buckets * ht->max_load_factor) + 1);
+        filter_storage(ht, ht);
+        if (ht->migrating_from != NULL) filter_storage(ht, ht->migrating_from);
     }
 
-    /// @brief check if a hash table has an entry with a given key
-bool ioopm_hash_table_has_key(ioopm_hash_table_t *ht, elem_t key)
-{
-    // More efficient: direct lookup without creating key list
-    int bucket = ht->func(key);
-    entry_t *current = ht->buckets[bucket].next;
-    
-    while (current != NULL) {
-        if (ht->eq_func(current->key, key)) {
-            return true;
+    /// ---------------------- Table operations on top of the backends ----------------------
+
+    static void resize(ioopm_hash_table_t *ht, size_t no_buckets)
+    {
+        Count(ht, resizes);
+        if (ht->incremental_resize)
+        {
+            start_migration(ht, no_buckets);
+        }
+        else
+        {
+            backend_resize(ht, no_buckets);
         }
-        current = current->next;
+        if (ht->filter != NULL) rebuild_filter(ht); // resized for the new capacity, and rid of removed keys
     }
-    return false;
-}
 
+    /// Lookup while a migration is in progress
+    static elem_t *find_migrating(ioopm_hash_table_t *ht, elem_t key, uint64_t hash)
+    {
+        elem_t *slot = backend_find(ht, key, hash);
+        if (slot == NULL && ht->migrating_from != NULL)
+        {
+            slot = backend_find(ht->migrating_from, key, hash);
+        }
+        return slot;
+    }
 
-    /// @brief check if a hash table has an entry with a given value
-bool ioopm_hash_table_has_value(ioopm_hash_table_t *ht, elem_t value)
-{
-    // More efficient: iterate directly through buckets
-    for (int i = 0; i < No_Buckets; i++) {
-        entry_t *current = ht->buckets[i].next;
-        while (current != NULL) {
-            if (ht->eq_func(current->value, value)) {
-                return true;
-            }
-            current = current->next;
+    /// Pointer to the value stored under key, or NULL if key is not in the table.
+    /// The pointer is only valid until the table is changed.
+    static inline elem_t *find_value(ioopm_hash_table_t *ht, elem_t key, uint64_t hash)
+    {
+        if (ht->filter != NULL && !filter_may_contain(ht, hash))
+        {
+            Count(ht, filter_rejects);
+            Count(ht, misses);
+            return NULL;
         }
+
+        elem_t *slot = ht->migrating_from != NULL ? find_migrating(ht, key, hash) : backend_find(ht, key, hash);
+        if (slot != NULL) Count(ht, hits);
+        else Count(ht, misses);
+        if (slot == NULL && ht->filter != NULL) Count(ht, filter_false_positives);
+        return slot;
     }
-    return false;
-}
 
-    void ioopm_hash_table_apply_to_all(ioopm_hash_table_t *ht, ioopm_apply_function *func, void *arg)
+    /// Grow when one more entry would take the table above its load factor.
+    /// Done before inserting so slot pointers handed out by insert_new stay valid.
+    static void maybe_grow(ioopm_hash_table_t *ht)
     {
-        for (int i = 0; i < No_Buckets; i++) {
-            entry_t *current = ht->buckets[i].next;
-            while (current != NULL) {
-                func(current->key, &current->value, arg);
-                current = current->next; 
-            }
+        if ((float) (ht->size + 1) > (float) ht->no_buckets * ht->max_load_factor)
+        {
+            resize(ht, ht->no_buckets * 2);
+        }
+        else if (ht->backend == IOOPM_HT_ORDERED && ht->entries_used == ht->entries_room &&
+                 ht->tombstones < ht->entries_used / 4)
+        {
+            // Full entry arrays compact in place, but so few dead entries would only buy
+            // room for a few inserts before the next compaction; grow (and compact) now
+            resize(ht, ht->no_buckets * 2);
         }
     }
 
-    /// @brief check if a predicate is satisfied by all entries in a hash table
-    bool ioopm_hash_table_all(ioopm_hash_table_t *ht, ioopm_predicate *pred, void *arg){
-        for (int i = 0; i < No_Buckets; i++)
+    /// Shrink when the table has gone below its minimum load factor
+    static void maybe_shrink(ioopm_hash_table_t *ht)
+    {
+        if (ht->no_buckets > ht->min_buckets &&
+            (float) ht->size < (float) ht->no_buckets * ht->min_load_factor)
         {
-            entry_t *current = ht->buckets[i].next;
-            while (current != NULL)
-            {
-                if(!pred(current->key, current->value, arg)){
-                    return false;
-                }
-                current = current->next;
-            }
+            resize(ht, ht->no_buckets / 2);
         }
-        return true;
     }
 
-    /// @brief check if a predicate is satisfied by any entry in a hash table
-    bool ioopm_hash_table_any(ioopm_hash_table_t *ht, ioopm_predicate *pred, void *arg){
-        for (int i = 0; i < No_Buckets; i++)
+    /// Unlink the entry for key; its key and value are handed back so the caller decides who frees the key
+    static bool remove_entry(ioopm_hash_table_t *ht, elem_t key, elem_t *removed_key, elem_t *removed_value)
+    {
+        uint64_t hash = hash_of(ht, key);
+
+        if (ht->filter != NULL && !filter_may_contain(ht, hash))
         {
-            entry_t *current = ht->buckets[i].next;
-            while (current != NULL)
-            {
-                if(pred(current->key, current->value, arg)){
-                    return true;
-                }
-                current = current->next;
-            }
+            Count(ht, filter_rejects);
+            Count(ht, misses);
+            return false;
+        }
+
+        if (ht->migrating_from != NULL) migrate_step(ht, Migrate_Work_Per_Op);
+
+        bool removed = backend_remove(ht, key, hash, removed_key, removed_value);
+        if (!removed && ht->migrating_from != NULL)
+        {
+            removed = backend_remove(ht->migrating_from, key, hash, removed_key, removed_value);
+            if (removed) ht->migrating_from->size--;
+        }
+        if (removed) ht->size--;
+        if (removed) Count(ht, hits);
+        else Count(ht, misses);
+
+        // The removed key's bits stay set; rebuild before they make the filter useless
+        if (removed && ht->filter != NULL && ++ht->filter_stale > ht->size / 2 + Filter_Stale_Slack)
+        {
+            rebuild_filter(ht);
+        }
+        return removed;
+    }
+
+    static bool each_entry(ioopm_hash_table_t *ht, entry_visitor *visit, void *arg)
+    {
+        ioopm_hash_table_t *old = ht->migrating_from;
+        // Old storage first: for IOOPM_HT_ORDERED everything still in it was inserted earlier
+        if (old != NULL && !backend_each(old, 0, storage_length(old), visit, arg))
+        {
+            return false;
+        }
+        return backend_each(ht, 0, storage_length(ht), visit, arg);
+    }
+
+    /// ---------------------- Value index ----------------------
+
+    /// The value index (options.value_index) maps each value to the set of keys that have
+    /// it. The sets compare keys with ht's eq_func and hold copies of them if ht copies
+    /// keys; otherwise they hold the keys ht holds. insert, insert_freq and remove keep the
+    /// index up to date. upsert, lookup_slot and apply_to_all hand out value slots the
+    /// index can not watch, so they only mark it stale and the next query rebuilds it.
+
+    #define Key_Set_Array_Max 8 // keys a set keeps in a plain array, more go in a table
+
+    /// The keys with one value. Most values belong to a key or two (one merch per name,
+    /// say), and those keys sit in an array sized to fit. A value shared by more keys gets
+    /// a table of them instead, so that taking one key out does not scan them all.
+    typedef struct key_set
+    {
+        uint32_t count;            // keys in keys[], while table is NULL
+        uint32_t room;
+        ioopm_hash_table_t *table; // the keys once there are more than Key_Set_Array_Max
+        elem_t keys[];
+    } key_set_t;
+
+    static inline bool index_live(ioopm_hash_table_t *ht)
+    {
+        return ht->value_index != NULL && !ht->value_index_stale;
+    }
+
+    static inline void values_exposed(ioopm_hash_table_t *ht)
+    {
+        if (ht->value_index != NULL) ht->value_index_stale = true;
+    }
+
+    /// The key set of value, NULL if no key has it
+    static key_set_t *keys_with(ioopm_hash_table_t *ht, elem_t value)
+    {
+        elem_t *set = find_value(ht->value_index, value, hash_of(ht->value_index, value));
+        return set != NULL ? set->p : NULL;
+    }
+
+    static void free_key_set(ioopm_hash_table_t *ht, key_set_t *set)
+    {
+        if (set->table != NULL)
+        {
+            ioopm_hash_table_destroy(set->table); // frees the copies, if they are ours
+        }
+        else if (ht->copy_keys)
+        {
+            for (uint32_t i = 0; i < set->count; i++) free(set->keys[i].p);
+        }
+        free(set);
+    }
+
+    /// Move the keys of a full array into a table; the struct shrinks to its header
+    static key_set_t *keys_to_table(ioopm_hash_table_t *ht, key_set_t *set)
+    {
+        ioopm_hash_table_options_t opts = {
+            .capacity = 2 * Key_Set_Array_Max, .seeded_hash = ht->seeded_func, .hash_seed = ht->seed
+        };
+        set->table = ioopm_hash_table_create_with(ht->func, ht->eq_func, &opts);
+        set->table->should_free_keys = ht->copy_keys != IOOPM_KEYS_SHARED;
+        for (uint32_t i = 0; i < set->count; i++) ioopm_hash_table_insert(set->table, set->keys[i], ptr_elem(NULL));
+        set->count = set->room = 0;
+        return realloc(set, sizeof(key_set_t));
+    }
+
+    static void index_add(ioopm_hash_table_t *ht, elem_t key, elem_t value)
+    {
+        bool inserted;
+        elem_t *slot = ioopm_hash_table_upsert(ht->value_index, value, NULL, NULL, &inserted);
+        if (inserted)
+        {
+            key_set_t *set = malloc(sizeof(key_set_t) + sizeof(elem_t));
+            *set = (key_set_t) { .room = 1 };
+            slot->p = set;
+        }
+
+        key_set_t *set = slot->p;
+        if (set->table == NULL && set->count == set->room)
+        {
+            if (set->room < Key_Set_Array_Max)
+            {
+                set->room *= 2;
+                set = realloc(set, sizeof(key_set_t) + set->room * sizeof(elem_t));
+            }
+            else
+            {
+                set = keys_to_table(ht, set);
+            }
+            slot->p = set;
+        }
+
+        // A copied key may live in an entry that goes away before the set forgets it
+        if (ht->copy_keys) key = copy_key(ht, key, NULL, 0);
+        if (set->table != NULL) ioopm_hash_table_insert(set->table, key, ptr_elem(NULL));
+        else set->keys[set->count++] = key;
+    }
+
+    /// Take key out of the set of value, dropping the set once it is empty.
+    /// Returns the key the set held (already freed if the set had its own copy).
+    static elem_t index_take(ioopm_hash_table_t *ht, elem_t key, elem_t value)
+    {
+        key_set_t *set = keys_with(ht, value);
+        assert(set != NULL); // every key is in the set of its value
+        elem_t stored = key;
+        bool empty;
+
+        if (set->table != NULL)
+        {
+            elem_t unused;
+            bool found = remove_entry(set->table, key, &stored, &unused);
+            assert(found);
+            (void) found;
+            maybe_shrink(set->table);
+            empty = set->table->size == 0;
+        }
+        else
+        {
+            uint32_t i = 0;
+            while (i < set->count && !ht->eq_func(set->keys[i], key)) i++;
+            assert(i < set->count);
+            stored = set->keys[i];
+            set->keys[i] = set->keys[--set->count];
+            empty = set->count == 0;
+        }
+
+        if (ht->copy_keys) free(stored.p);
+        if (empty)
+        {
+            free_key_set(ht, set);
+            ioopm_hash_table_remove(ht->value_index, value);
+        }
+        return stored;
+    }
+
+    /// key's value changes from one value to another
+    static void index_move(ioopm_hash_table_t *ht, elem_t key, elem_t from, elem_t to)
+    {
+        elem_t stored = index_take(ht, key, from);
+        // A shared key has to be the one ht holds, the caller's may be freed after this
+        index_add(ht, ht->copy_keys ? key : stored, to);
+    }
+
+    static bool destroy_key_set(elem_t value, elem_t *set, void *ht)
+    {
+        (void) value;
+        free_key_set(ht, set->p);
+        return true;
+    }
+
+    static void clear_value_index(ioopm_hash_table_t *ht)
+    {
+        each_entry(ht->value_index, destroy_key_set, ht);
+        ioopm_hash_table_clear(ht->value_index);
+        ht->value_index_stale = false;
+    }
+
+    static bool index_visitor(elem_t key, elem_t *value, void *ht)
+    {
+        index_add(ht, key, *value);
+        return true;
+    }
+
+    /// Bring a stale index up to date before answering from it
+    static void refresh_value_index(ioopm_hash_table_t *ht)
+    {
+        if (!ht->value_index_stale) return;
+        clear_value_index(ht);
+        each_entry(ht, index_visitor, ht);
+    }
+
+    /// Add an entry for a key that is known not to be in the table
+    static elem_t *insert_new(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t value)
+    {
+        if (ht->migrating_from != NULL) migrate_step(ht, Migrate_Work_Per_Op);
+        maybe_grow(ht);
+        if (ht->copy_keys && ht->backend != IOOPM_HT_CHAINED)
+        {
+            key = copy_key(ht, key, NULL, 0); // slots move around, a key can not live in one
+        }
+        elem_t *slot = backend_insert(ht, key, hash, value);
+        ht->size++;
+        if (ht->filter != NULL) ioopm_filter_add(ht, hash);
+        if (index_live(ht)) index_add(ht, key, value);
+        return slot;
+    }
+
+    static void clear_entries(ioopm_hash_table_t *ht)
+    {
+        // The old storage first: with a shared slab ht's clear resets all of it
+        if (ht->migrating_from != NULL)
+        {
+            backend_clear(ht->migrating_from);
+            free_old_storage(ht);
+        }
+        backend_clear(ht);
+        ht->size = 0;
+        if (ht->filter != NULL) ioopm_filter_clear(ht);
+        if (ht->value_index != NULL) clear_value_index(ht);
+    }
+
+    /// ---------------------- Bulk removal ----------------------
+
+    struct bulk_remove
+    {
+        ioopm_hash_table_t *ht;
+        ioopm_predicate *pred;        // NULL takes every entry
+        ioopm_drain_function *taken;  // NULL frees the keys like remove does
+        void *arg;
+        bool free_keys;
+        uint64_t hash;                // of the entry being handed over
+    };
+
+    /// Decide about one entry and, if it goes, hand it over. Called before the entry is
+    /// unlinked, so a copied key is still alive.
+    static bool hand_over(struct bulk_remove *bulk, elem_t key, elem_t value, uint64_t hash)
+    {
+        if (bulk->pred != NULL && !bulk->pred(key, value, bulk->arg)) return false;
+
+        bulk->hash = hash;
+        // A drain clears the whole value index at the end instead
+        if (bulk->pred != NULL && index_live(bulk->ht)) index_take(bulk->ht, key, value);
+        if (bulk->taken != NULL) bulk->taken(key, value, bulk->arg);
+        return true;
+    }
+
+    static bool slot_in_use(ioopm_hash_table_t *ht, size_t i)
+    {
+        return ht->backend == IOOPM_HT_SWISS ? !(ht->ctrl[i] & 0x80) : ht->slot_hashes[i] != 0;
+    }
+
+    static void take_slot(ioopm_hash_table_t *ht, size_t i, elem_t *key)
+    {
+        elem_t value;
+        uint64_t hash;
+        switch (ht->backend)
+        {
+        case IOOPM_HT_ROBIN_HOOD:
+            ioopm_robin_take_at(ht, i, key, &value, &hash);
+            break;
+        case IOOPM_HT_SWISS:
+            ioopm_swiss_take_at(ht, i, key, &value, &hash);
+            break;
+        default:
+            ioopm_ordered_take_at(ht, i, key, &value, &hash);
+        }
+    }
+
+    /// One pass over the storage, unlinking the entries hand_over lets go; returns how many
+    static size_t take_entries(struct bulk_remove *bulk)
+    {
+        ioopm_hash_table_t *ht = bulk->ht;
+        size_t taken = 0;
+
+        if (ht->backend == IOOPM_HT_CHAINED)
+        {
+            for (size_t b = 0; b < ht->no_buckets; b++)
+            {
+                entry_t *prev = &ht->buckets[b];
+                while (prev->next != NULL)
+                {
+                    entry_t *current = prev->next;
+                    if (!hand_over(bulk, current->key, current->value, current->hash))
+                    {
+                        prev = current;
+                        continue;
+                    }
+                    prev->next = current->next;
+                    if (bulk->free_keys && !key_is_inline(current) && current->key.p != NULL) free(current->key.p);
+                    free_entry(ht, current);
+                    taken++;
+                }
+            }
+            return taken;
+        }
+
+        // Robin Hood removes pull the following entries back a slot. Starting at an empty
+        // slot, which is then the last one looked at, no entry already seen is pulled back.
+        size_t length = storage_length(ht);
+        size_t start = 0;
+        if (ht->backend == IOOPM_HT_ROBIN_HOOD)
+        {
+            while (ht->slot_hashes[start] != 0) start++;
+        }
+
+        for (size_t n = 0; n < length; )
+        {
+            size_t i = start + n < length ? start + n : start + n - length;
+            if (!slot_in_use(ht, i) || !hand_over(bulk, ht->slot_keys[i], ht->slot_values[i], ht->slot_hashes[i]))
+            {
+                n++;
+                continue;
+            }
+            elem_t key;
+            take_slot(ht, i, &key);
+            if (bulk->free_keys && key.p != NULL) free(key.p);
+            taken++; // slot i is looked at again, Robin Hood may have pulled an entry into it
+        }
+        return taken;
+    }
+
+    /// ---------------------- API ----------------------
+
+    // Creates a new hash table with calloc, and sets dummy values.
+    ioopm_hash_table_t *ioopm_hash_table_create(ioopm_hash_func *func, ioopm_eq_function *eq_func)
+    {
+        return ioopm_hash_table_create_with(func, eq_func, NULL);
+    }
+
+    // Creates a new hash table sized for opts->capacity entries
+    ioopm_hash_table_t *ioopm_hash_table_create_with(ioopm_hash_func *func, ioopm_eq_function *eq_func,
+                                                     const ioopm_hash_table_options_t *opts)
+    {
+        ioopm_hash_table_options_t defaults = { 0 };
+        if (opts == NULL) opts = &defaults;
+
+        ioopm_hash_table_t *ht = calloc(1, sizeof(ioopm_hash_table_t));
+        ht->func = func;
+        ht->eq_func = eq_func;
+        ht->size = 0;
+        ht->should_free_keys = false;
+        ht->backend = opts->backend;
+        ht->incremental_resize = opts->incremental_resize;
+        ht->seeded_func = opts->seeded_hash;
+        ht->seed = opts->hash_seed;
+        ht->copy_keys = opts->copy_keys;
+        if (ht->copy_keys) ht->should_free_keys = true; // the copies are ours
+
+        if (ht->backend == IOOPM_HT_CHAINED)
+        {
+            ht->entry_slab = opts->entry_slab;
+            // A shared slab has entries of plain size, then every copy goes to the heap
+            if (ht->copy_keys && ht->entry_slab == NULL)
+            {
+                ht->inline_key_room = Inline_Key_Size;
+                if (ht->copy_keys == IOOPM_KEYS_COPY_STRVIEW) ht->inline_key_room += sizeof(ioopm_str_t);
+            }
+            if (ht->entry_slab == NULL && opts->pooled_entries)
+            {
+                ht->entry_slab = ioopm_slab_create(sizeof(entry_t) + ht->inline_key_room);
+                ht->owns_entry_slab = true;
+            }
+        }
+
+        ht->max_load_factor = opts->max_load_factor > 0 ? opts->max_load_factor : Default_Max_Load_Factor;
+        if (ht->backend != IOOPM_HT_CHAINED && ht->max_load_factor > Max_Open_Load_Factor)
+        {
+            ht->max_load_factor = Max_Open_Load_Factor;
+        }
+        ht->min_load_factor = opts->min_load_factor > 0 ? opts->min_load_factor : ht->max_load_factor / 4;
+        assert(ht->min_load_factor < ht->max_load_factor / 2); // or grow/shrink would ping-pong
+
+        ht->min_buckets = opts->capacity > 0 ? buckets_for(opts->capacity, ht->max_load_factor) : Default_Buckets;
+        if (ht->backend == IOOPM_HT_SWISS && ht->min_buckets < Swiss_Group_Size)
+        {
+            ht->min_buckets = Swiss_Group_Size;
+        }
+        init_storage(ht, ht->min_buckets);
+        if (opts->key_filter) rebuild_filter(ht);
+        if (opts->value_index)
+        {
+            assert(opts->value_hash != NULL && opts->value_eq != NULL);
+            ht->value_index = ioopm_hash_table_create(opts->value_hash, opts->value_eq);
+        }
+        return ht;
+    }
+
+void ioopm_hash_table_destroy(ioopm_hash_table_t *ht)
+{
+    if (!ht) return;
+
+    clear_entries(ht);
+    free_storage(ht);
+    ioopm_filter_free(ht);
+    ioopm_hash_table_destroy(ht->value_index);
+    if (ht->owns_entry_slab) ioopm_slab_destroy(ht->entry_slab);
+    free(ht);
+}
+
+
+    // Inserts a new value into the hashtable
+    void ioopm_hash_table_insert(ioopm_hash_table_t *ht, elem_t key, elem_t value)
+    {
+        uint64_t hash = hash_of(ht, key);
+        elem_t *slot = find_value(ht, key, hash);
+
+        if (slot != NULL)
+        {
+            // Key exists → update value
+            if (index_live(ht)) index_move(ht, key, *slot, value);
+            *slot = value;
+            return;
+        }
+
+        insert_new(ht, key, hash, value);
+    }
+
+
+    /// Find the slot of a key already hashed, adding an entry for it if it is missing
+    static elem_t *upsert_hashed(ioopm_hash_table_t *ht, elem_t key, uint64_t hash,
+                                 ioopm_key_materialise *materialise, void *arg, bool *inserted)
+    {
+        elem_t *slot = find_value(ht, key, hash);
+        if (inserted) *inserted = slot == NULL;
+        if (slot != NULL) return slot;
+
+        if (materialise) key = materialise(key, arg);
+        return insert_new(ht, key, hash, (elem_t) { .p = NULL });
+    }
+
+    /// The counting step of insert_freq
+    static void count_one(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, bool *inserted)
+    {
+        elem_t *count = upsert_hashed(ht, key, hash, NULL, NULL, inserted);
+        if (index_live(ht)) index_move(ht, key, *count, int_elem(count->i + 1));
+        count->i++;
+    }
+
+    elem_t *ioopm_hash_table_upsert(ioopm_hash_table_t *ht, elem_t key, ioopm_key_materialise *materialise,
+                                    void *arg, bool *inserted)
+    {
+        values_exposed(ht);
+        return upsert_hashed(ht, key, hash_of(ht, key), materialise, arg, inserted);
+    }
+
+    elem_t *ioopm_hash_table_lookup_slot(ioopm_hash_table_t *ht, elem_t key)
+    {
+        values_exposed(ht);
+        return find_value(ht, key, hash_of(ht, key));
+    }
+
+    // Counts one more occurrence of key, a key already counted is freed
+    void ioopm_hash_table_insert_freq(ioopm_hash_table_t *ht, elem_t key)
+    {
+        bool inserted;
+        count_one(ht, key, hash_of(ht, key), &inserted);
+
+        if (!inserted && !ht->copy_keys) free(key.p);  // only if key.p was dynamically allocated!
+    }
+    //Om ett värde finns lägg till ett på valuet, annars sätt value till 0, iterera genom ht till vi kommer till slutet.
+
+    // Gets a value from the hashtable, same as lookup but used for testing
+    elem_t ioopm_hash_table_get(ioopm_hash_table_t *ht, elem_t key)
+    {
+        elem_t *slot = find_value(ht, key, hash_of(ht, key));
+        return slot != NULL ? *slot : (elem_t){ .p = NULL };
+    }
+
+    #define SuccessElem(e)   (option_t){ .success = true,  .value = (e) }
+    #define SuccessInt(i)    (option_t){ .success = true,  .value = (elem_t){ .i = (i) } }
+    #define SuccessPtr(p)    (option_t){ .success = true,  .value = (elem_t){ .p = (p) } }
+    #define Failure()        (option_t){ .success = false, .value = (elem_t){ .p = NULL } }
+    #define Successful(o)    ((o).success == true)
+    #define Unsuccessful(o)  ((o).success == false)
+
+
+    option_t ioopm_hash_table_lookup(ioopm_hash_table_t *ht, elem_t key)
+    {
+        elem_t *slot = find_value(ht, key, hash_of(ht, key));
+
+        if (slot != NULL)
+        {
+            return SuccessElem(*slot);   // return the union directly
+        }
+
+        return Failure();
+    }
+
+    // Removes a value from the hashtable, and frees the memory used
+    void ioopm_hash_table_remove(ioopm_hash_table_t *ht, elem_t key)
+    {
+        elem_t removed_key, removed_value;
+
+        if (remove_entry(ht, key, &removed_key, &removed_value))
+        {
+            if (index_live(ht)) index_take(ht, key, removed_value);
+
+            // FREE THE KEY if should_free_keys is set
+            if (ht->should_free_keys && removed_key.p != NULL) {
+                free(removed_key.p);
+            }
+            maybe_shrink(ht);
+        }
+    }
+    // Removes every entry pred holds for, in one pass over the buckets
+    size_t ioopm_hash_table_remove_if(ioopm_hash_table_t *ht, ioopm_predicate *pred,
+                                      ioopm_drain_function *taken, void *arg)
+    {
+        finish_migration(ht);
+
+        // Copies are the table's whoever sees them, shared keys go to whoever takes them
+        struct bulk_remove bulk = {
+            .ht = ht, .pred = pred, .taken = taken, .arg = arg,
+            .free_keys = ht->copy_keys || (taken == NULL && ht->should_free_keys)
+        };
+        size_t removed = take_entries(&bulk);
+        ht->size -= removed;
+        if (pred == NULL && ht->value_index != NULL) clear_value_index(ht);
+
+        if (ht->no_buckets > ht->min_buckets &&
+            (float) ht->size < (float) ht->no_buckets * ht->min_load_factor)
+        {
+            // All the way down at once, maybe_shrink would only halve
+            size_t fit = buckets_for(ht->size, ht->max_load_factor);
+            resize(ht, fit > ht->min_buckets ? fit : ht->min_buckets);
+        }
+        else if (ht->filter != NULL)
+        {
+            ht->filter_stale += removed;
+            if (ht->size == 0) ioopm_filter_clear(ht);
+            else if (ht->filter_stale > ht->size / 2 + Filter_Stale_Slack) rebuild_filter(ht);
+        }
+        return removed;
+    }
+
+    void ioopm_hash_table_drain(ioopm_hash_table_t *ht, ioopm_drain_function *taken, void *arg)
+    {
+        ioopm_hash_table_remove_if(ht, NULL, taken, arg);
+    }
+
+    struct merge
+    {
+        ioopm_hash_table_t *dst;
+        ioopm_hash_table_t *src;
+        ioopm_combine_function *combine;
+        void *arg;
+        bool same_hash;               // src's cached hashes are valid in dst
+        struct bulk_remove bulk;
+    };
+
+    /// Combine src's value into dst's entry for key, if there is one
+    static bool merge_existing(struct merge *merge, elem_t key, uint64_t hash, elem_t value)
+    {
+        ioopm_hash_table_t *dst = merge->dst;
+        elem_t *slot = find_value(dst, key, hash);
+        if (slot == NULL) return false;
+
+        elem_t combined = merge->combine(*slot, value, merge->arg);
+        if (index_live(dst)) index_move(dst, key, *slot, combined);
+        *slot = combined;
+        return true;
+    }
+
+    /// Both chained, with entries from the same allocator (or slabs that can be joined)
+    static bool entries_movable(ioopm_hash_table_t *dst, ioopm_hash_table_t *src)
+    {
+        if (dst->backend != IOOPM_HT_CHAINED || src->backend != IOOPM_HT_CHAINED) return false;
+        if (dst->inline_key_room != src->inline_key_room) return false;
+        return src->entry_slab == dst->entry_slab || (src->owns_entry_slab && dst->owns_entry_slab);
+    }
+
+    /// Relink every entry of src into dst, allocating nothing
+    static void move_entries(struct merge *merge)
+    {
+        ioopm_hash_table_t *dst = merge->dst;
+        ioopm_hash_table_t *src = merge->src;
+
+        // From now on src's entries are freed to dst's slab
+        if (src->entry_slab != dst->entry_slab) ioopm_slab_adopt(dst->entry_slab, src->entry_slab);
+
+        for (size_t b = 0; b < src->no_buckets; b++)
+        {
+            entry_t *head = &src->buckets[b];
+            while (head->next != NULL)
+            {
+                entry_t *moved = head->next;
+                head->next = moved->next;
+                if (!merge->same_hash) moved->hash = hash_of(dst, moved->key);
+
+                if (merge_existing(merge, moved->key, moved->hash, moved->value))
+                {
+                    if (src->should_free_keys && !key_is_inline(moved) && moved->key.p != NULL) free(moved->key.p);
+                    free_entry(dst, moved);
+                    continue;
+                }
+
+                maybe_grow(dst);
+                size_t bucket = home_index(moved->hash, dst->bucket_shift);
+                moved->next = dst->buckets[bucket].next;
+                dst->buckets[bucket].next = moved;
+                dst->size++;
+                if (dst->filter != NULL) ioopm_filter_add(dst, moved->hash);
+                if (index_live(dst)) index_add(dst, moved->key, moved->value);
+            }
+        }
+        src->size = 0;
+    }
+
+    /// Any other pair of tables: take src's entries out one at a time and insert them.
+    /// Shared keys and (hashed alike) the cached hashes carry over, copied keys are copied again.
+    static void merge_taken(elem_t key, elem_t value, void *arg)
+    {
+        struct merge *merge = arg;
+        uint64_t hash = merge->same_hash ? merge->bulk.hash : hash_of(merge->dst, key);
+
+        if (merge_existing(merge, key, hash, value))
+        {
+            if (!merge->src->copy_keys && merge->src->should_free_keys && key.p != NULL) free(key.p);
+            return;
+        }
+        insert_new(merge->dst, key, hash, value);
+    }
+
+    // Moves every entry of src into dst, combining the values of keys in both
+    void ioopm_hash_table_merge(ioopm_hash_table_t *dst, ioopm_hash_table_t *src,
+                                ioopm_combine_function *combine, void *arg)
+    {
+        assert(dst != src);
+        assert(dst->copy_keys == src->copy_keys); // both own copies, or both hold the caller's keys
+
+        finish_migration(src);
+        struct merge merge = {
+            .dst = dst, .src = src, .combine = combine, .arg = arg,
+            .same_hash = dst->func == src->func && dst->seeded_func == src->seeded_func &&
+                         dst->seed.k0 == src->seed.k0 && dst->seed.k1 == src->seed.k1
+        };
+
+        if (entries_movable(dst, src))
+        {
+            move_entries(&merge);
+        }
+        else
+        {
+            merge.bulk = (struct bulk_remove) {
+                .ht = src, .taken = merge_taken, .arg = &merge, .free_keys = src->copy_keys != IOOPM_KEYS_SHARED
+            };
+            src->size -= take_entries(&merge.bulk);
+        }
+
+        // src is empty now, reset its filter, value index and bucket array
+        ioopm_hash_table_clear(src);
+
+        // dst's stats go on to describe the work src did too
+        dst->counters.hits += src->counters.hits;
+        dst->counters.misses += src->counters.misses;
+        dst->counters.eq_calls += src->counters.eq_calls;
+        dst->counters.resizes += src->counters.resizes;
+        dst->counters.filter_rejects += src->counters.filter_rejects;
+        dst->counters.filter_false_positives += src->counters.filter_false_positives;
+        src->counters = (ioopm_hash_table_counters_t) { 0 };
+    }
+
+    /// @brief returns the number of key => value entries in the hash table
+    size_t ioopm_hash_table_size(ioopm_hash_table_t *ht)
+    {
+        return ht->size;
+    }
+
+    /// @brief checks if the hash table is empty
+    bool ioopm_hash_table_is_empty(ioopm_hash_table_t *ht)
+    {
+        return ioopm_hash_table_size(ht) == 0;
+    }
+
+    // Removes all entries from the hashtable but keeps the table itself
+    void ioopm_hash_table_clear(ioopm_hash_table_t *ht)
+    {
+        clear_entries(ht);
+
+        // Give back the memory of a table that has grown, every bucket is empty anyway
+        if (ht->no_buckets > ht->min_buckets)
+        {
+            free_storage(ht);
+            init_storage(ht, ht->min_buckets);
+            if (ht->filter != NULL) rebuild_filter(ht);
+        }
+    }
+
+    static bool append_key(elem_t key, elem_t *value, void *list)
+    {
+        (void) value;
+        ioopm_linked_list_append(list, key);
+        return true;
+    }
+
+    static bool append_value(elem_t key, elem_t *value, void *list)
+    {
+        (void) key;
+        ioopm_linked_list_append(list, *value);
+        return true;
+    }
+
+    /// A list for keys or values; a table that pools its entries pools the links too
+    static ioopm_list_t *result_list(ioopm_hash_table_t *ht)
+    {
+        if (ht->entry_slab != NULL) return ioopm_linked_list_create_pooled(ht->eq_func, NULL);
+        return ioopm_linked_list_create(ht->eq_func);
+    }
+
+    /// @brief return the keys for all entries in a hash map (in no particular order)
+    ioopm_list_t *ioopm_hash_table_keys(ioopm_hash_table_t *ht)
+    {
+        size_t total_keys = ioopm_hash_table_size(ht);
+        if (total_keys == 0) return NULL;
+
+        ioopm_list_t *list = result_list(ht);
+        each_entry(ht, append_key, list);
+        return list;
+    }
+
+    /// @brief return the values for all entries in a hash map (in no particular order)
+    ioopm_list_t *ioopm_hash_table_values(ioopm_hash_table_t *ht)
+    {
+        size_t total_keys = ioopm_hash_table_size(ht);
+        if (!total_keys) return NULL;
+
+        ioopm_list_t *list = result_list(ht);
+        each_entry(ht, append_value, list);
+        return list;
+    }
+
+    /// Where the next exported element goes
+    static bool export_key(elem_t key, elem_t *value, void *arg)
+    {
+        (void) value;
+        elem_t **out = arg;
+        *(*out)++ = key;
+        return true;
+    }
+
+    static bool export_value(elem_t key, elem_t *value, void *arg)
+    {
+        (void) key;
+        elem_t **out = arg;
+        *(*out)++ = *value;
+        return true;
+    }
+
+    static bool export_pair(elem_t key, elem_t *value, void *arg)
+    {
+        elem_t **out = arg;
+        *(*out)++ = key;
+        *(*out)++ = *value;
+        return true;
+    }
+
+    /// dense: for IOOPM_HT_ORDERED, the slot array holding what visit would export
+    static elem_t *export_entries(ioopm_hash_table_t *ht, elem_t *buf, size_t per_entry, entry_visitor *visit,
+                                  const elem_t *dense)
+    {
+        if (buf == NULL)
+        {
+            // One extra element so an empty table still gets a pointer the caller can free
+            buf = malloc((ht->size * per_entry + 1) * sizeof(elem_t));
+        }
+
+        // Nothing removed and no migration: the entries are exactly the first size slots
+        if (ht->backend == IOOPM_HT_ORDERED && ht->tombstones == 0 && ht->migrating_from == NULL && dense)
+        {
+            memcpy(buf, dense, ht->size * sizeof(elem_t));
+            return buf;
+        }
+
+        elem_t *out = buf;
+        each_entry(ht, visit, &out);
+        return buf;
+    }
+
+    elem_t *ioopm_hash_table_keys_array(ioopm_hash_table_t *ht, elem_t *buf)
+    {
+        return export_entries(ht, buf, 1, export_key, ht->slot_keys);
+    }
+
+    elem_t *ioopm_hash_table_values_array(ioopm_hash_table_t *ht, elem_t *buf)
+    {
+        return export_entries(ht, buf, 1, export_value, ht->slot_values);
+    }
+
+    elem_t *ioopm_hash_table_pairs_array(ioopm_hash_table_t *ht, elem_t *buf)
+    {
+        return export_entries(ht, buf, 2, export_pair, NULL);
+    }
+
+    /// @brief check if a hash table has an entry with a given key
+bool ioopm_hash_table_has_key(ioopm_hash_table_t *ht, elem_t key)
+{
+    // More efficient: direct lookup without creating key list
+    return find_value(ht, key, hash_of(ht, key)) != NULL;
+}
+
+struct value_search
+{
+    ioopm_eq_function *eq_func;
+    elem_t value;
+    ioopm_list_t *keys; // keys_for_value without an index: where the matches go
+};
+
+static bool value_differs(elem_t key, elem_t *value, void *arg)
+{
+    (void) key;
+    struct value_search *search = arg;
+    return !search->eq_func(*value, search->value);
+}
+
+    /// @brief check if a hash table has an entry with a given value
+bool ioopm_hash_table_has_value(ioopm_hash_table_t *ht, elem_t value)
+{
+    if (ht->value_index != NULL)
+    {
+        refresh_value_index(ht);
+        return keys_with(ht, value) != NULL;
+    }
+
+    // More efficient: iterate directly through buckets, stops at the first match
+    struct value_search search = { .eq_func = ht->eq_func, .value = value };
+    return !each_entry(ht, value_differs, &search);
+}
+
+static bool collect_key_with_value(elem_t key, elem_t *value, void *arg)
+{
+    struct value_search *search = arg;
+    if (search->eq_func(*value, search->value)) ioopm_linked_list_append(search->keys, key);
+    return true;
+}
+
+    /// @brief the keys of all entries with a given value
+ioopm_list_t *ioopm_hash_table_keys_for_value(ioopm_hash_table_t *ht, elem_t value)
+{
+    if (ht->value_index != NULL)
+    {
+        refresh_value_index(ht);
+        key_set_t *set = keys_with(ht, value);
+        if (set == NULL) return NULL;
+
+        ioopm_list_t *keys = result_list(ht);
+        if (set->table != NULL) each_entry(set->table, append_key, keys);
+        for (uint32_t i = 0; i < set->count; i++) ioopm_linked_list_append(keys, set->keys[i]);
+        return keys;
+    }
+
+    struct value_search search = { .eq_func = ht->eq_func, .value = value };
+    search.keys = result_list(ht);
+    each_entry(ht, collect_key_with_value, &search);
+    if (ioopm_linked_list_size(search.keys) == 0)
+    {
+        ioopm_linked_list_destroy(search.keys);
+        return NULL;
+    }
+    return search.keys;
+}
+
+    struct apply_closure
+    {
+        ioopm_apply_function *apply_fun;
+        ioopm_predicate *pred;
+        void *arg;
+    };
+
+    static bool apply_visitor(elem_t key, elem_t *value, void *arg)
+    {
+        struct apply_closure *closure = arg;
+        closure->apply_fun(key, value, closure->arg);
+        return true;
+    }
+
+    static bool all_visitor(elem_t key, elem_t *value, void *arg)
+    {
+        struct apply_closure *closure = arg;
+        return closure->pred(key, *value, closure->arg);
+    }
+
+    static bool any_visitor(elem_t key, elem_t *value, void *arg)
+    {
+        struct apply_closure *closure = arg;
+        return !closure->pred(key, *value, closure->arg);
+    }
+
+    void ioopm_hash_table_apply_to_all(ioopm_hash_table_t *ht, ioopm_apply_function *func, void *arg)
+    {
+        values_exposed(ht);
+        struct apply_closure closure = { .apply_fun = func, .arg = arg };
+        each_entry(ht, apply_visitor, &closure);
+    }
+
+    /// @brief check if a predicate is satisfied by all entries in a hash table
+    bool ioopm_hash_table_all(ioopm_hash_table_t *ht, ioopm_predicate *pred, void *arg){
+        struct apply_closure closure = { .pred = pred, .arg = arg };
+        return each_entry(ht, all_visitor, &closure);
+    }
+
+    /// @brief check if a predicate is satisfied by any entry in a hash table
+    bool ioopm_hash_table_any(ioopm_hash_table_t *ht, ioopm_predicate *pred, void *arg){
+        struct apply_closure closure = { .pred = pred, .arg = arg };
+        return !each_entry(ht, any_visitor, &closure);
+    }
+
+    /// ---------------------- Parallel traversal ----------------------
+
+    /// The bucket array is cut into chunks, a few per thread so uneven chunks even out,
+    /// and the pool walks them. Every entry is visited by exactly one task, so apply_fun
+    /// may change the value it is given without locking. A migration is finished first.
+
+    #define Chunks_Per_Thread 4
+    #define Min_Chunk 256 // buckets; a smaller chunk costs more to hand out than to walk
+
+    struct parallel_walk
+    {
+        ioopm_hash_table_t *ht;
+        size_t chunk;
+        entry_visitor *visit;
+        ioopm_apply_function *apply_fun;
+        ioopm_predicate *pred;
+        ioopm_reduce_function *reduce;
+        void *arg;
+        bool stop;          // set by the task that decides all/any, the others give up
+        elem_t *partials;   // reduce: one accumulator per chunk
+    };
+
+    /// What a visitor gets: the walk and which chunk it is in
+    struct walk_task
+    {
+        struct parallel_walk *walk;
+        size_t task;
+    };
+
+    static bool stopped(struct parallel_walk *walk)
+    {
+        return __atomic_load_n(&walk->stop, __ATOMIC_RELAXED);
+    }
+
+    static bool parallel_apply_visitor(elem_t key, elem_t *value, void *arg)
+    {
+        struct parallel_walk *walk = ((struct walk_task *) arg)->walk;
+        walk->apply_fun(key, value, walk->arg);
+        return true;
+    }
+
+    static bool parallel_all_visitor(elem_t key, elem_t *value, void *arg)
+    {
+        struct parallel_walk *walk = ((struct walk_task *) arg)->walk;
+        if (stopped(walk)) return false;
+        if (walk->pred(key, *value, walk->arg)) return true;
+
+        __atomic_store_n(&walk->stop, true, __ATOMIC_RELAXED); // found one that fails
+        return false;
+    }
+
+    static bool parallel_any_visitor(elem_t key, elem_t *value, void *arg)
+    {
+        struct parallel_walk *walk = ((struct walk_task *) arg)->walk;
+        if (stopped(walk)) return false;
+        if (!walk->pred(key, *value, walk->arg)) return true;
+
+        __atomic_store_n(&walk->stop, true, __ATOMIC_RELAXED); // found one that holds
+        return false;
+    }
+
+    static bool parallel_reduce_visitor(elem_t key, elem_t *value, void *arg)
+    {
+        struct walk_task *state = arg;
+        struct parallel_walk *walk = state->walk;
+        walk->partials[state->task] = walk->reduce(walk->partials[state->task], key, *value, walk->arg);
+        return true;
+    }
+
+    static void walk_chunk(size_t task, void *arg)
+    {
+        struct parallel_walk *walk = arg;
+        if (stopped(walk)) return;
+
+        size_t from = task * walk->chunk;
+        size_t length = storage_length(walk->ht);
+        size_t to = from + walk->chunk < length ? from + walk->chunk : length;
+        struct walk_task state = { .walk = walk, .task = task };
+        backend_each(walk->ht, from, to, walk->visit, &state);
+    }
+
+    /// Cut the table into chunks for the pool (NULL: one thread), returns the number of chunks
+    static size_t plan_walk(ioopm_hash_table_t *ht, ioopm_thread_pool_t *pool, struct parallel_walk *walk)
+    {
+        finish_migration(ht);
+
+        size_t threads = pool ? ioopm_thread_pool_size(pool) : 1;
+        size_t length = storage_length(ht);
+        size_t chunk = length / (threads * Chunks_Per_Thread);
+        walk->ht = ht;
+        walk->chunk = chunk > Min_Chunk ? chunk : Min_Chunk;
+        return length > 0 ? (length + walk->chunk - 1) / walk->chunk : 1;
+    }
+
+    static void run_walk(ioopm_thread_pool_t *pool, struct parallel_walk *walk, size_t tasks)
+    {
+        if (pool == NULL || tasks == 1)
+        {
+            for (size_t i = 0; i < tasks; i++) walk_chunk(i, walk);
+        }
+        else
+        {
+            ioopm_thread_pool_run(pool, tasks, walk_chunk, walk);
+        }
+    }
+
+    void ioopm_hash_table_apply_to_all_parallel(ioopm_hash_table_t *ht, ioopm_thread_pool_t *pool,
+                                                ioopm_apply_function *apply_fun, void *arg)
+    {
+        values_exposed(ht);
+        struct parallel_walk walk = { .visit = parallel_apply_visitor, .apply_fun = apply_fun, .arg = arg };
+        run_walk(pool, &walk, plan_walk(ht, pool, &walk));
+    }
+
+    bool ioopm_hash_table_all_parallel(ioopm_hash_table_t *ht, ioopm_thread_pool_t *pool, ioopm_predicate *pred, void *arg)
+    {
+        struct parallel_walk walk = { .visit = parallel_all_visitor, .pred = pred, .arg = arg };
+        run_walk(pool, &walk, plan_walk(ht, pool, &walk));
+        return !walk.stop;
+    }
+
+    bool ioopm_hash_table_any_parallel(ioopm_hash_table_t *ht, ioopm_thread_pool_t *pool, ioopm_predicate *pred, void *arg)
+    {
+        struct parallel_walk walk = { .visit = parallel_any_visitor, .pred = pred, .arg = arg };
+        run_walk(pool, &walk, plan_walk(ht, pool, &walk));
+        return walk.stop;
+    }
+
+    elem_t ioopm_hash_table_reduce_parallel(ioopm_hash_table_t *ht, ioopm_thread_pool_t *pool,
+                                            ioopm_reduce_function *reduce, ioopm_combine_function *combine,
+                                            elem_t init, void *arg)
+    {
+        struct parallel_walk walk = { .visit = parallel_reduce_visitor, .reduce = reduce, .arg = arg };
+        size_t tasks = plan_walk(ht, pool, &walk);
+
+        walk.partials = malloc(tasks * sizeof(elem_t));
+        for (size_t i = 0; i < tasks; i++) walk.partials[i] = init;
+        run_walk(pool, &walk, tasks);
+
+        // Partials are combined in chunk order, so the result does not depend on timing
+        elem_t result = walk.partials[0];
+        for (size_t i = 1; i < tasks; i++) result = combine(result, walk.partials[i], arg);
+        free(walk.partials);
+        return result;
+    }
+
+    /// ---------------------- Statistics ----------------------
+
+    static void histogram_add(ioopm_hash_table_stats_t *stats, size_t length)
+    {
+        stats->histogram[length < Stats_Histogram_Size ? length : Stats_Histogram_Size - 1]++;
+    }
+
+    /// Add the chain or probe lengths of one storage (ht itself or the one being migrated from)
+    static void measure_storage(ioopm_hash_table_t *ht, ioopm_hash_table_stats_t *stats)
+    {
+        size_t max = 0;
+
+        for (size_t i = 0; i < ht->no_buckets; i++)
+        {
+            size_t length;
+            if (ht->backend == IOOPM_HT_CHAINED)
+            {
+                length = 0;
+                for (entry_t *current = ht->buckets[i].next; current != NULL; current = current->next) length++;
+                histogram_add(stats, length);
+            }
+            else if (ht->backend == IOOPM_HT_ORDERED)
+            {
+                // Index slots, counting the ones that point at a live entry
+                if (ht->entry_index[i] == 0 || ht->slot_hashes[ht->entry_index[i] - 1] == 0) continue;
+
+                length = ioopm_ordered_probe_length(ht, i);
+                histogram_add(stats, length - 1);
+            }
+            else
+            {
+                bool full = ht->backend == IOOPM_HT_ROBIN_HOOD ? ht->slot_hashes[i] != 0 : !(ht->ctrl[i] & 0x80);
+                if (!full) continue;
+
+                length = ht->backend == IOOPM_HT_ROBIN_HOOD
+                    ? ((i - home_index(ht->slot_hashes[i], ht->bucket_shift)) & (ht->no_buckets - 1)) + 1
+                    : ioopm_swiss_probe_length(ht, i);
+                histogram_add(stats, length - 1);
+            }
+            if (length > max) max = length;
+        }
+        if (max > stats->max_chain) stats->max_chain = max;
+    }
+
+    void ioopm_hash_table_stats(ioopm_hash_table_t *ht, ioopm_hash_table_stats_t *stats)
+    {
+        *stats = (ioopm_hash_table_stats_t) { 0 };
+        stats->size = ht->size;
+        stats->no_buckets = ht->no_buckets;
+        stats->load_factor = (float) ht->size / (float) ht->no_buckets;
+
+        measure_storage(ht, stats);
+        if (ht->migrating_from != NULL) measure_storage(ht->migrating_from, stats);
+
+        if (ht->filter != NULL)
+        {
+            stats->filtered = true;
+            stats->filter_bytes = ht->filter_blocks * Filter_Block_Words * sizeof(uint64_t);
+            stats->filter_fp_estimate = ioopm_filter_fp_estimate(ht);
+        }
+
+        stats->counters = ht->counters;
+        if (ht->migrating_from != NULL) stats->counters.eq_calls += ht->migrating_from->counters.eq_calls;
+    #ifdef IOOPM_HT_STATS
+        stats->counting = true;
+    #endif
+    }
+
+    void ioopm_hash_table_print_stats(ioopm_hash_table_t *ht, FILE *out)
+    {
+        static const char *names[] = { "chained", "robin hood", "swiss", "ordered" };
+        ioopm_hash_table_stats_t stats;
+        ioopm_hash_table_stats(ht, &stats);
+
+        fprintf(out, "backend:     %s\n", names[ht->backend]);
+        fprintf(out, "entries:     %zu in %zu buckets (load factor %.2f)\n", stats.size, stats.no_buckets, stats.load_factor);
+        fprintf(out, "%s\n", ht->backend == IOOPM_HT_CHAINED ? "chain length: buckets"
+                             : ht->backend == IOOPM_HT_SWISS ? "groups from home: entries" : "slots from home: entries");
+        for (size_t i = 0; i < Stats_Histogram_Size; i++)
+        {
+            if (stats.histogram[i] == 0) continue;
+            fprintf(out, "  %2zu%s %zu\n", i, i == Stats_Histogram_Size - 1 ? "+:" : ":", stats.histogram[i]);
+        }
+        fprintf(out, "longest:     %zu\n", stats.max_chain);
+        if (stats.filtered)
+        {
+            fprintf(out, "key filter:  %zu bytes, %.2f%% false positives expected\n",
+                    stats.filter_bytes, 100 * stats.filter_fp_estimate);
+        }
+
+        if (!stats.counting)
+        {
+            fprintf(out, "(build with -DIOOPM_HT_STATS for hits, misses, eq calls and resizes)\n");
+            return;
+        }
+        size_t finds = stats.counters.hits + stats.counters.misses;
+        fprintf(out, "hits:        %zu\n", stats.counters.hits);
+        fprintf(out, "misses:      %zu\n", stats.counters.misses);
+        fprintf(out, "eq calls:    %zu (%.2f per find)\n", stats.counters.eq_calls,
+                finds ? (double) stats.counters.eq_calls / (double) finds : 0.0);
+        fprintf(out, "resizes:     %zu\n", stats.counters.resizes);
+        if (stats.filtered)
+        {
+            // Of the misses that reached the filter, the share it failed to answer
+            size_t tested = stats.counters.filter_rejects + stats.counters.filter_false_positives;
+            fprintf(out, "filtered:    %zu misses, %zu false positives (%.2f%%)\n",
+                    stats.counters.filter_rejects, stats.counters.filter_false_positives,
+                    tested ? 100.0 * (double) stats.counters.filter_false_positives / (double) tested : 0.0);
+        }
+    }
+
+    /// ---------------------- Batches ----------------------
+
+    /// Keys are handled Batch_Size at a time: hash them all and prefetch where they live,
+    /// then resolve them one by one. By the time a key is resolved its bucket has usually
+    /// arrived in the cache, so the misses of a batch overlap instead of adding up.
+
+    #define Batch_Size 16
+
+    static void hash_and_prefetch(ioopm_hash_table_t *ht, const elem_t *keys, size_t n, uint64_t *hashes)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            hashes[i] = hash_of(ht, keys[i]);
+            backend_prefetch(ht, hashes[i]);
+        }
+
+        if (ht->backend == IOOPM_HT_CHAINED)
+        {
+            // The heads are (mostly) in cache now, go one step further down the chains
+            for (size_t i = 0; i < n; i++)
+            {
+                entry_t *first = ht->buckets[home_index(hashes[i], ht->bucket_shift)].next;
+                if (first != NULL) __builtin_prefetch(first);
+            }
+        }
+    }
+
+    void ioopm_hash_table_lookup_batch(ioopm_hash_table_t *ht, const elem_t *keys, size_t n, option_t *results)
+    {
+        uint64_t hashes[Batch_Size];
+
+        for (size_t start = 0; start < n; start += Batch_Size)
+        {
+            size_t count = n - start < Batch_Size ? n - start : Batch_Size;
+            hash_and_prefetch(ht, keys + start, count, hashes);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                elem_t *slot = find_value(ht, keys[start + i], hashes[i]);
+                results[start + i] = slot != NULL ? SuccessElem(*slot) : Failure();
+            }
+        }
+    }
+
+    void ioopm_hash_table_insert_batch(ioopm_hash_table_t *ht, const elem_t *keys, const elem_t *values, size_t n)
+    {
+        uint64_t hashes[Batch_Size];
+
+        for (size_t start = 0; start < n; start += Batch_Size)
+        {
+            size_t count = n - start < Batch_Size ? n - start : Batch_Size;
+            hash_and_prefetch(ht, keys + start, count, hashes);
+
+            // Same as ioopm_hash_table_insert; a resize half way only makes later prefetches miss
+            for (size_t i = 0; i < count; i++)
+            {
+                elem_t *slot = find_value(ht, keys[start + i], hashes[i]);
+                if (slot != NULL)
+                {
+                    if (index_live(ht)) index_move(ht, keys[start + i], *slot, values[start + i]);
+                    *slot = values[start + i];
+                }
+                else insert_new(ht, keys[start + i], hashes[i], values[start + i]);
+            }
+        }
+    }
+
+    void ioopm_hash_table_insert_freq_batch(ioopm_hash_table_t *ht, const elem_t *keys, size_t n)
+    {
+        uint64_t hashes[Batch_Size];
+
+        for (size_t start = 0; start < n; start += Batch_Size)
+        {
+            size_t count = n - start < Batch_Size ? n - start : Batch_Size;
+            hash_and_prefetch(ht, keys + start, count, hashes);
+
+            // Same as ioopm_hash_table_insert_freq, including freeing keys already counted
+            // (unless the table copies keys, then the caller's keys are never ours)
+            for (size_t i = 0; i < count; i++)
+            {
+                bool inserted;
+                count_one(ht, keys[start + i], hashes[i], &inserted);
+                if (!inserted && !ht->copy_keys) free(keys[start + i].p);
+            }
         }
-        return false;
     }
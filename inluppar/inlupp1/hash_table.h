@@ -1,8 +1,14 @@
 #pragma once
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include "linked_list.h"
+#include "slab.h"
+#include "thread_pool.h"
 
-    #define No_Buckets 5 
+    #define Default_Buckets 16
+    #define Min_Buckets 8
+    #define Default_Max_Load_Factor 0.75f
 
 
 
@@ -12,16 +18,102 @@
     {
         elem_t key;       // holds the key
         elem_t value;     // holds the value
+        uint64_t hash;    // full hash of key, checked before eq_func and reused on resize
         entry_t *next;    // points to the next entry (possibly NULL)
     };
 
+    /// How a table stores its entries, picked once at create time
+    typedef enum hash_table_backend
+    {
+        IOOPM_HT_CHAINED = 0,   // one malloc'ed entry_t per key, chained from a dummy head per bucket
+        IOOPM_HT_ROBIN_HOOD,    // open addressing in flat arrays, Robin Hood probing
+        IOOPM_HT_SWISS,         // open addressing with a control byte per slot, probed 16 (AVX2: 32) at a time
+        IOOPM_HT_ORDERED,       // dense entry arrays in insertion order plus an index, iterates in that order
+    } ioopm_hash_backend_t;
+
+    #define Inline_Key_Size 16 // copied string keys shorter than this (with the NUL) live in the entry
+
+    /// Whether the table keeps the keys it is given or copies of them
+    typedef enum hash_key_copy
+    {
+        IOOPM_KEYS_SHARED = 0,  // store the elem_t as given, freed on remove if should_free_keys
+        IOOPM_KEYS_COPY_STR,    // char * keys: the table stores its own copy, the caller keeps theirs
+        IOOPM_KEYS_COPY_STRVIEW, // ioopm_str_t * keys: as above, the copy is NUL terminated
+    } ioopm_key_copy_t;
+
+    /// Event counts, only kept up to date when built with -DIOOPM_HT_STATS (make STATS=1)
+    typedef struct hash_table_counters
+    {
+        size_t hits;        // finds that found the key, including the ones insert and remove do
+        size_t misses;
+        size_t eq_calls;    // calls to eq_func, each one a hash match
+        size_t resizes;
+        size_t filter_rejects;         // finds the key filter answered on its own
+        size_t filter_false_positives; // finds the filter let through that then missed
+    } ioopm_hash_table_counters_t;
+
+    /// Options for ioopm_hash_table_create_with. Zeroed fields mean "use the default",
+    /// so callers can write (ioopm_hash_table_options_t){ .capacity = 50000 }.
+    typedef struct hash_table_options
+    {
+        size_t capacity;         // expected number of entries, used to size the bucket array up front
+        float max_load_factor;   // grow when size / no_buckets goes above this (default 0.75)
+        float min_load_factor;   // shrink when size / no_buckets goes below this (default max / 4)
+        ioopm_hash_backend_t backend;
+        bool pooled_entries;     // IOOPM_HT_CHAINED: take entries from a slab owned by the table,
+                                 // the lists from keys/values get their links from a slab too
+        ioopm_slab_t *entry_slab; // IOOPM_HT_CHAINED: or from this slab shared with other tables (caller frees it)
+        bool incremental_resize; // spread the work of a resize over the following inserts and removes
+        ioopm_seeded_hash_func *seeded_hash; // used instead of func when set, e.g. hash_str_seeded
+        ioopm_hash_seed_t hash_seed; // passed to seeded_hash; for hash_str_sip both words are the secret key
+        ioopm_key_copy_t copy_keys; // IOOPM_HT_CHAINED keeps short copies inline, no malloc per key
+        bool key_filter;         // keep a Bloom filter of the keys, so most lookups of missing keys touch no bucket
+        bool value_index;        // keep a map from each value to its keys, for has_value and keys_for_value
+        ioopm_hash_func *value_hash;   // value_index: hashes a value
+        ioopm_eq_function *value_eq;   // value_index: compares two values
+    } ioopm_hash_table_options_t;
+
     typedef struct hash_table
     {
-        entry_t buckets[No_Buckets]; // dummy heads for each bucket
+        ioopm_hash_backend_t backend;
+        entry_t *buckets;        // IOOPM_HT_CHAINED: dummy heads for each bucket, no_buckets long
+        ioopm_slab_t *entry_slab; // IOOPM_HT_CHAINED: where entries come from, NULL means malloc
+        bool owns_entry_slab;    // destroy/clear release the whole slab at once
+        elem_t *slot_keys;       // open addressing: no_buckets slots in parallel arrays
+        elem_t *slot_values;
+        uint64_t *slot_hashes;   // cached hash per slot, 0 marks an empty Robin Hood slot (or dead ordered entry)
+        uint8_t *ctrl;           // IOOPM_HT_SWISS: control byte per slot (empty, deleted or 7 hash bits)
+        size_t tombstones;       // IOOPM_HT_SWISS: deleted slots not yet reused, IOOPM_HT_ORDERED: dead entries
+        uint32_t *entry_index;   // IOOPM_HT_ORDERED: no_buckets slots, 0 or position + 1 in the slot arrays
+        size_t entries_used;     // IOOPM_HT_ORDERED: entries appended since the last compaction, dead ones included
+        size_t entries_room;     // IOOPM_HT_ORDERED: length of the slot arrays
+        size_t no_buckets;       // always a power of two
+        unsigned bucket_shift;   // 64 - log2(no_buckets), used to reduce a hash to a bucket
+        size_t min_buckets;      // never shrink below the size asked for at create time
+        float max_load_factor;
+        float min_load_factor;
         ioopm_hash_func *func;
+        ioopm_seeded_hash_func *seeded_func; // overrides func when not NULL
+        ioopm_hash_seed_t seed;
         ioopm_eq_function *eq_func;
         size_t size;
         bool should_free_keys;
+        ioopm_key_copy_t copy_keys;
+        size_t inline_key_room;  // IOOPM_HT_CHAINED: bytes after each entry for a copied key, 0 if none
+
+        uint64_t *filter;        // key_filter: blocked Bloom filter of the cached hashes, NULL if off
+        size_t filter_blocks;    // a power of two
+        unsigned filter_shift;   // 64 - log2(filter_blocks)
+        size_t filter_stale;     // removes since the filter was built, their bits are still set
+
+        struct hash_table *value_index; // value_index: value -> the set of keys with it, NULL if off
+        bool value_index_stale;  // a value slot was handed out, rebuild before the next query
+
+        bool incremental_resize;
+        struct hash_table *migrating_from; // old storage still being moved over, NULL when not resizing
+        size_t migrate_pos;      // in the old storage: next bucket/slot to move
+
+        ioopm_hash_table_counters_t counters;
 
     } ioopm_hash_table_t;
 
@@ -36,11 +128,21 @@ typedef struct hash_table ioopm_hash_table_t;
 /// ---------------------- API ----------------------
 
 /**
- * Create a new hash table with 17 buckets (each with a dummy head)
+ * Create a new hash table with the default number of buckets (each with a dummy head)
+ * The table grows and shrinks on its own as entries are added and removed.
  * Returns a pointer to the allocated hash table
  */
 ioopm_hash_table_t *ioopm_hash_table_create(ioopm_hash_func *func, ioopm_eq_function *eq_func);
 
+/**
+ * Create a new hash table with a capacity hint and load factor thresholds.
+ * func must return a full-width hash, the table reduces it to a bucket itself.
+ * func may be NULL if opts->seeded_hash is set.
+ * opts may be NULL, which is the same as ioopm_hash_table_create
+ */
+ioopm_hash_table_t *ioopm_hash_table_create_with(ioopm_hash_func *func, ioopm_eq_function *eq_func,
+                                                 const ioopm_hash_table_options_t *opts);
+
 /**
  * Destroy a hash table and free all dynamically allocated memory
  */
@@ -49,6 +151,8 @@ void ioopm_hash_table_destroy(ioopm_hash_table_t *ht);
 /**
  * Insert a key/value pair into the hash table.
  * If the key exists, updates the value.
+ * With copy_keys the table stores a copy of a new key, so key may point into a
+ * buffer the caller reuses; keys handed out later (keys, apply_to_all, ...) are the copies.
  */
 void ioopm_hash_table_insert(ioopm_hash_table_t *ht, elem_t key, elem_t value);
 
@@ -70,6 +174,22 @@ struct option
 option_t ioopm_hash_table_lookup(ioopm_hash_table_t *ht, elem_t key);
 void ioopm_hash_table_remove(ioopm_hash_table_t *ht, elem_t key);
 
+/// Receives an entry as it is taken out of a table
+typedef void ioopm_drain_function(elem_t key, elem_t value, void *arg);
+
+/// @brief remove every entry pred holds for, in one pass over the buckets
+/// @param pred decides about each entry once, NULL removes all of them
+/// @param taken if not NULL, gets each removed entry and takes over its key: the table
+/// no longer frees a key it was given. A key the table copied is freed when taken returns.
+/// Without taken, keys are freed like ioopm_hash_table_remove does.
+/// @param arg extra argument to pred and taken
+/// @return the number of entries removed
+size_t ioopm_hash_table_remove_if(ioopm_hash_table_t *ht, ioopm_predicate *pred,
+                                  ioopm_drain_function *taken, void *arg);
+
+/// @brief empty the table, handing every entry to taken (see ioopm_hash_table_remove_if)
+void ioopm_hash_table_drain(ioopm_hash_table_t *ht, ioopm_drain_function *taken, void *arg);
+
 /// @brief returns the number of key => value entries in the hash table
 /// @param h hash table operated upon
 /// @return the number of key => value entries in the hash table
@@ -94,6 +214,18 @@ ioopm_list_t *ioopm_hash_table_keys(ioopm_hash_table_t *ht);
 /// @return an array of values for hash table h
 ioopm_list_t *ioopm_hash_table_keys(ioopm_hash_table_t *ht);
 
+/// @brief copy all keys into an array in one pass over the table, no list is built
+/// (IOOPM_HT_ORDERED: in insertion order, a single memcpy when nothing has been removed)
+/// @param buf room for ioopm_hash_table_size(ht) keys, or NULL to have one malloc'ed
+/// @return buf, or the new array (which the caller frees)
+elem_t *ioopm_hash_table_keys_array(ioopm_hash_table_t *ht, elem_t *buf);
+
+/// @brief like ioopm_hash_table_keys_array but for the values, in the same order
+elem_t *ioopm_hash_table_values_array(ioopm_hash_table_t *ht, elem_t *buf);
+
+/// @brief copy all entries as key, value, key, value, ... (buf needs room for 2 * size)
+elem_t *ioopm_hash_table_pairs_array(ioopm_hash_table_t *ht, elem_t *buf);
+
 /// @brief check if a hash table has an entry with a given key
 /// @param h hash table operated upon
 /// @param key the key sought
@@ -106,8 +238,14 @@ ioopm_list_t *ioopm_hash_table_values(ioopm_hash_table_t *ht);
 /// @brief check if a hash table has an entry with a given value
 /// @param h hash table operated upon
 /// @param value the value sought
+/// With a value index (options.value_index) this is a lookup, comparing with value_eq
 bool ioopm_hash_table_has_value(ioopm_hash_table_t *ht, elem_t value);
 
+/// @brief the keys of all entries with a given value, in no particular order
+/// With a value index this only touches those keys, otherwise it walks the table.
+/// @return a new list the caller destroys, NULL if no entry has value (like ioopm_hash_table_keys)
+ioopm_list_t *ioopm_hash_table_keys_for_value(ioopm_hash_table_t *ht, elem_t value);
+
 /// @brief check if a predicate is satisfied by all entries in a hash table
 /// @param h hash table operated upon
 /// @param pred the predicate
@@ -120,7 +258,7 @@ bool ioopm_hash_table_all(ioopm_hash_table_t *ht, ioopm_predicate *pred, void *a
 /// @param arg extra argument to pred
 bool ioopm_hash_table_any(ioopm_hash_table_t *ht, ioopm_predicate *pred, void *arg);
 
-/// @brief apply a function to all entries in a hash table
+/// @brief apply a function to all entries in a hash table (IOOPM_HT_ORDERED: in insertion order)
 /// @param h hash table operated upon
 /// @param apply_fun the function to be applied to all elements
 /// @param arg extra argument to apply_fun
@@ -128,4 +266,96 @@ void ioopm_hash_table_apply_to_all(ioopm_hash_table_t *ht, ioopm_apply_function
 
 void ioopm_hash_table_insert_freq(ioopm_hash_table_t *ht, elem_t key);
 
+/// Makes the key to store for a new entry out of the key given to upsert, e.g. a copy of it
+typedef elem_t ioopm_key_materialise(elem_t key, void *arg);
+
+/// @brief find the value of key, adding an entry for it if it is missing; key is hashed once
+/// @param materialise called only if key is new, the key stored is what it returns (NULL stores key)
+/// @param arg extra argument to materialise
+/// @param inserted set to whether the entry was added (its value is then zeroed), may be NULL
+/// @return the value slot, valid until the table is next changed: an insert, remove,
+/// clear or merge may move entries (also with incremental_resize), lookups never do.
+/// A value index is rebuilt on its next query, it can not see writes through the slot.
+elem_t *ioopm_hash_table_upsert(ioopm_hash_table_t *ht, elem_t key, ioopm_key_materialise *materialise,
+                                void *arg, bool *inserted);
+
+/// @brief the value slot of key, or NULL if key is missing; valid like the slot from upsert
+elem_t *ioopm_hash_table_lookup_slot(ioopm_hash_table_t *ht, elem_t key);
+
+/// Folds one entry into a partial result of ioopm_hash_table_reduce_parallel
+typedef elem_t ioopm_reduce_function(elem_t acc, elem_t key, elem_t value, void *arg);
+
+/// Joins two partial results; with init it must behave like + with 0.
+/// ioopm_hash_table_merge uses it to join the two values of a key.
+typedef elem_t ioopm_combine_function(elem_t a, elem_t b, void *arg);
+
+/// @brief move every entry of src into dst, leaving src empty
+/// Chained tables whose entries come from the same place (malloc, a shared slab or each
+/// its own slab) have the entries relinked, nothing is allocated or copied. Otherwise the
+/// entries are taken out and inserted; shared keys move over, cached hashes are reused
+/// when both tables hash alike.
+/// Both tables must have the same copy_keys and compare keys alike. Moved keys are then
+/// freed by dst like its own. src's counters are added to dst's.
+/// @param combine called as combine(dst's value, src's value, arg) for a key in both,
+/// what it returns is the new value in dst; src's key is freed if src frees its keys
+/// (a ioopm_combine_function, e.g. one summing counts)
+void ioopm_hash_table_merge(ioopm_hash_table_t *dst, ioopm_hash_table_t *src,
+                            ioopm_combine_function *combine, void *arg);
+
+/// @brief ioopm_hash_table_apply_to_all with the buckets split over the threads of pool
+/// @param pool the threads to use, NULL runs on the calling thread
+/// @param apply_fun may change the value it is given, but anything else it shares
+/// with other calls (through arg) has to be thread safe
+void ioopm_hash_table_apply_to_all_parallel(ioopm_hash_table_t *ht, ioopm_thread_pool_t *pool,
+                                            ioopm_apply_function *apply_fun, void *arg);
+
+/// @brief ioopm_hash_table_all over the threads of pool; all threads stop at the first failure
+bool ioopm_hash_table_all_parallel(ioopm_hash_table_t *ht, ioopm_thread_pool_t *pool, ioopm_predicate *pred, void *arg);
+
+/// @brief ioopm_hash_table_any over the threads of pool; all threads stop at the first match
+bool ioopm_hash_table_any_parallel(ioopm_hash_table_t *ht, ioopm_thread_pool_t *pool, ioopm_predicate *pred, void *arg);
+
+/// @brief fold every entry into a result, in parallel
+/// @param reduce folds an entry into the partial result of a chunk of buckets, each starting at init
+/// @param combine joins the partial results, in a fixed order
+/// @return init if the table is empty
+elem_t ioopm_hash_table_reduce_parallel(ioopm_hash_table_t *ht, ioopm_thread_pool_t *pool,
+                                        ioopm_reduce_function *reduce, ioopm_combine_function *combine,
+                                        elem_t init, void *arg);
+
+#define Stats_Histogram_Size 16 // lengths from Stats_Histogram_Size - 1 and up share the last bin
+
+/// What ioopm_hash_table_stats reports
+typedef struct hash_table_stats
+{
+    size_t size;
+    size_t no_buckets;
+    float load_factor;
+    /// IOOPM_HT_CHAINED: number of buckets with a chain of length i.
+    /// Open addressing: number of entries i slots (IOOPM_HT_SWISS: probed groups) from home.
+    size_t histogram[Stats_Histogram_Size];
+    size_t max_chain;        // longest chain, or longest probe (distance + 1)
+    bool counting;           // whether counters is kept, i.e. built with IOOPM_HT_STATS
+    bool filtered;           // the table has a key filter
+    size_t filter_bytes;
+    double filter_fp_estimate; // chance a missing key gets past the filter, from how full it is
+    ioopm_hash_table_counters_t counters;
+} ioopm_hash_table_stats_t;
+
+/// @brief measure the shape of the table (walks all of it) and copy its counters
+void ioopm_hash_table_stats(ioopm_hash_table_t *ht, ioopm_hash_table_stats_t *stats);
+
+/// @brief print ioopm_hash_table_stats in a human readable form
+void ioopm_hash_table_print_stats(ioopm_hash_table_t *ht, FILE *out);
+
+/// @brief look up n keys at once, hiding cache misses by prefetching ahead
+/// @param results n options, filled in like ioopm_hash_table_lookup would
+void ioopm_hash_table_lookup_batch(ioopm_hash_table_t *ht, const elem_t *keys, size_t n, option_t *results);
+
+/// @brief ioopm_hash_table_insert for n key/value pairs, in order
+void ioopm_hash_table_insert_batch(ioopm_hash_table_t *ht, const elem_t *keys, const elem_t *values, size_t n);
+
+/// @brief ioopm_hash_table_insert_freq for n keys, in order (the same key may occur many times)
+void ioopm_hash_table_insert_freq_batch(ioopm_hash_table_t *ht, const elem_t *keys, size_t n);
+
 
@@ -0,0 +1,356 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hash_table_file.h"
+#include "hash_table_internal.h"
+
+#define Table_File_Magic "IOOPMHT"
+#define Byte_Order_Mark 0x01020304u // reads differently on a machine of the other endianness
+#define Min_File_Slots 8
+
+/// File layout: header | slots[no_slots] | heap. Offsets are from the start of the file,
+/// string offsets from the start of the heap.
+typedef struct file_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t key_kind;       // IOOPM_FILE_INT or IOOPM_FILE_STR
+    uint32_t value_kind;
+    uint64_t seed;
+    uint64_t size;           // entries
+    uint64_t no_slots;       // power of two, at most half full
+    uint64_t slots_offset;
+    uint64_t heap_offset;
+    uint64_t heap_size;
+} file_header_t;
+
+/// One open addressing slot, linear probing. hash 0 marks an empty slot.
+typedef struct file_slot
+{
+    uint64_t hash;
+    uint64_t key;     // the int, or the heap offset of the string
+    uint64_t value;
+} file_slot_t;
+
+/// A heap string: its length, then the bytes and a NUL, padded to 8 bytes
+typedef struct file_str
+{
+    uint64_t len;
+    char bytes[];
+} file_str_t;
+
+struct mapped_table
+{
+    void *base;
+    size_t length;
+    const file_header_t *header;
+    const file_slot_t *slots;
+    const char *heap;
+    unsigned shift;   // for home_index
+};
+
+/// ---------------------- Elements ----------------------
+
+static inline size_t heap_size_of(size_t len)
+{
+    return (sizeof(file_str_t) + len + 1 + 7) & ~(size_t) 7;
+}
+
+/// The bytes of a string key or value, as the saved table holds it
+static inline const char *str_bytes(elem_t elem, ioopm_file_elem_t kind, size_t *len)
+{
+    if (kind == IOOPM_FILE_STRVIEW)
+    {
+        const ioopm_str_t *view = elem.p;
+        *len = view->len;
+        return view->ptr;
+    }
+    *len = strlen(elem.p);
+    return elem.p;
+}
+
+static inline uint64_t file_hash(const char *bytes, size_t len, int i, bool is_str, uint64_t seed)
+{
+    uint64_t hash = is_str ? hash_bytes(bytes, len, seed) : hash_int_seeded(int_elem(i), (ioopm_hash_seed_t) { .k0 = seed });
+    return hash != 0 ? hash : 1;
+}
+
+/// Copy a string into the heap at *top and return its offset
+static uint64_t heap_put(char *heap, size_t *top, const char *bytes, size_t len)
+{
+    uint64_t offset = *top;
+    file_str_t *str = (file_str_t *) (heap + offset);
+    str->len = len;
+    memcpy(str->bytes, bytes, len);
+    str->bytes[len] = '\0';
+    *top += heap_size_of(len);
+    return offset;
+}
+
+/// ---------------------- Saving ----------------------
+
+/// Write the image to fd and flush it to disk
+static bool write_all(int fd, const char *image, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = write(fd, image, length);
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        image += written;
+        length -= written;
+    }
+    return fsync(fd) == 0;
+}
+
+/// Write the image to path.tmp and rename it over path. The file at path is never
+/// truncated or half written, so a process that has it mapped keeps the old table
+/// and a crash leaves either the old file or the new one.
+static bool replace_file(const char *path, const char *image, size_t length)
+{
+    size_t path_len = strlen(path);
+    char *tmp_path = malloc(path_len + sizeof(".tmp"));
+    memcpy(tmp_path, path, path_len);
+    memcpy(tmp_path + path_len, ".tmp", sizeof(".tmp"));
+
+    bool done = false;
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0)
+    {
+        done = write_all(fd, image, length);
+        int saved = errno;
+        if (close(fd) != 0 && done) { done = false; saved = errno; }
+        if (done && rename(tmp_path, path) != 0) { done = false; saved = errno; }
+        if (!done) unlink(tmp_path);
+        errno = saved;
+    }
+    free(tmp_path);
+    return done;
+}
+
+bool ioopm_hash_table_save(ioopm_hash_table_t *ht, const char *path,
+                           ioopm_file_elem_t key_kind, ioopm_file_elem_t value_kind)
+{
+    size_t size = ioopm_hash_table_size(ht);
+    elem_t *pairs = ioopm_hash_table_pairs_array(ht, NULL);
+    bool str_keys = key_kind != IOOPM_FILE_INT;
+    bool str_values = value_kind != IOOPM_FILE_INT;
+
+    size_t no_slots = Min_File_Slots;
+    while (no_slots < 2 * size) no_slots <<= 1;
+
+    size_t heap_size = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        size_t len;
+        if (str_keys) { str_bytes(pairs[2 * i], key_kind, &len); heap_size += heap_size_of(len); }
+        if (str_values) { str_bytes(pairs[2 * i + 1], value_kind, &len); heap_size += heap_size_of(len); }
+    }
+
+    // The whole file is put together in memory and written at once
+    size_t slots_offset = sizeof(file_header_t);
+    size_t heap_offset = slots_offset + no_slots * sizeof(file_slot_t);
+    size_t length = heap_offset + heap_size;
+    char *image = calloc(1, length);
+
+    file_header_t *header = (file_header_t *) image;
+    memcpy(header->magic, Table_File_Magic, sizeof(header->magic));
+    header->version = Table_File_Version;
+    header->byte_order = Byte_Order_Mark;
+    header->key_kind = str_keys ? IOOPM_FILE_STR : IOOPM_FILE_INT;
+    header->value_kind = str_values ? IOOPM_FILE_STR : IOOPM_FILE_INT;
+    header->seed = ht->seed.k0 ^ ht->seed.k1;
+    header->size = size;
+    header->no_slots = no_slots;
+    header->slots_offset = slots_offset;
+    header->heap_offset = heap_offset;
+    header->heap_size = heap_size;
+
+    file_slot_t *slots = (file_slot_t *) (image + slots_offset);
+    char *heap = image + heap_offset;
+    size_t top = 0;
+    unsigned shift = shift_for(no_slots);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        elem_t key = pairs[2 * i], value = pairs[2 * i + 1];
+        file_slot_t slot;
+        size_t len = 0;
+        const char *bytes = str_keys ? str_bytes(key, key_kind, &len) : NULL;
+
+        slot.hash = file_hash(bytes, len, key.i, str_keys, header->seed);
+        slot.key = str_keys ? heap_put(heap, &top, bytes, len) : (uint64_t) (int64_t) key.i;
+        if (str_values)
+        {
+            bytes = str_bytes(value, value_kind, &len);
+            slot.value = heap_put(heap, &top, bytes, len);
+        }
+        else
+        {
+            slot.value = (uint64_t) (int64_t) value.i;
+        }
+
+        size_t index = home_index(slot.hash, shift);
+        while (slots[index].hash != 0) index = (index + 1) & (no_slots - 1);
+        slots[index] = slot;
+    }
+    free(pairs);
+
+    bool written = replace_file(path, image, length);
+    free(image);
+    return written;
+}
+
+/// ---------------------- Opening ----------------------
+
+/// The header and the layout it describes, so a truncated or foreign file is refused.
+/// Slots are checked as they are read: a damaged one is skipped, never followed.
+static bool header_ok(const file_header_t *header, size_t length)
+{
+    if (length < sizeof(file_header_t)) return false;
+    if (memcmp(header->magic, Table_File_Magic, sizeof(header->magic)) != 0) return false;
+    if (header->version != Table_File_Version || header->byte_order != Byte_Order_Mark) return false;
+    if (header->key_kind > IOOPM_FILE_STR || header->value_kind > IOOPM_FILE_STR) return false;
+
+    uint64_t no_slots = header->no_slots;
+    if (no_slots < Min_File_Slots || (no_slots & (no_slots - 1)) != 0 || header->size >= no_slots) return false;
+    if (no_slots > length / sizeof(file_slot_t)) return false;
+
+    return header->slots_offset == sizeof(file_header_t)
+        && header->heap_offset == header->slots_offset + no_slots * sizeof(file_slot_t)
+        && header->heap_offset <= length
+        && header->heap_size == length - header->heap_offset;
+}
+
+ioopm_mapped_table_t *ioopm_mapped_table_open(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(file_header_t))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    size_t length = st.st_size;
+    void *base = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays
+    if (base == MAP_FAILED) return NULL;
+
+    const file_header_t *header = base;
+    if (!header_ok(header, length))
+    {
+        munmap(base, length);
+        return NULL;
+    }
+
+    ioopm_mapped_table_t *mt = malloc(sizeof(ioopm_mapped_table_t));
+    mt->base = base;
+    mt->length = length;
+    mt->header = header;
+    mt->slots = (const file_slot_t *) ((const char *) base + header->slots_offset);
+    mt->heap = (const char *) base + header->heap_offset;
+    mt->shift = shift_for(header->no_slots);
+    return mt;
+}
+
+void ioopm_mapped_table_close(ioopm_mapped_table_t *mt)
+{
+    if (!mt) return;
+    munmap(mt->base, mt->length);
+    free(mt);
+}
+
+/// ---------------------- Reading ----------------------
+
+/// The heap string at offset, or NULL if it does not fit in the heap with its NUL
+static inline const file_str_t *heap_str(ioopm_mapped_table_t *mt, uint64_t offset)
+{
+    uint64_t heap_size = mt->header->heap_size;
+    if (offset % sizeof(uint64_t) != 0 || offset > heap_size || heap_size - offset < sizeof(file_str_t)) return NULL;
+
+    const file_str_t *str = (const file_str_t *) (mt->heap + offset);
+    uint64_t room = heap_size - offset - sizeof(file_str_t); // for the bytes and the NUL
+    if (str->len >= room || str->bytes[str->len] != '\0') return NULL;
+    return str;
+}
+
+/// A stored key or value as an element; false if it is a string that is not in the heap
+static inline bool to_elem(ioopm_mapped_table_t *mt, uint64_t stored, uint32_t kind, elem_t *elem)
+{
+    if (kind == IOOPM_FILE_INT)
+    {
+        *elem = int_elem((int) (int64_t) stored);
+        return true;
+    }
+    const file_str_t *str = heap_str(mt, stored);
+    if (str == NULL) return false;
+    *elem = ptr_elem((char *) str->bytes);
+    return true;
+}
+
+option_t ioopm_mapped_table_lookup(ioopm_mapped_table_t *mt, elem_t key)
+{
+    const file_header_t *header = mt->header;
+    bool str_key = header->key_kind == IOOPM_FILE_STR;
+    size_t len = str_key ? strlen(key.p) : 0;
+    uint64_t hash = file_hash(key.p, len, key.i, str_key, header->seed);
+    size_t mask = header->no_slots - 1;
+    size_t index = home_index(hash, mt->shift);
+
+    // At most no_slots steps: a damaged file may have no empty slot to end the probe
+    for (size_t step = 0; step < header->no_slots && mt->slots[index].hash != 0; step++, index = (index + 1) & mask)
+    {
+        const file_slot_t *slot = &mt->slots[index];
+        if (slot->hash != hash) continue;
+
+        bool found;
+        if (str_key)
+        {
+            const file_str_t *stored = heap_str(mt, slot->key);
+            found = stored != NULL && stored->len == len && memcmp(stored->bytes, key.p, len) == 0;
+        }
+        else
+        {
+            found = (int) (int64_t) slot->key == key.i;
+        }
+
+        elem_t value;
+        if (found) return to_elem(mt, slot->value, header->value_kind, &value) ? Success(value) : Failure();
+    }
+    return Failure();
+}
+
+size_t ioopm_mapped_table_size(ioopm_mapped_table_t *mt)
+{
+    return mt->header->size;
+}
+
+void ioopm_mapped_table_apply_to_all(ioopm_mapped_table_t *mt, ioopm_apply_function *apply_fun, void *arg)
+{
+    for (size_t i = 0; i < mt->header->no_slots; i++)
+    {
+        const file_slot_t *slot = &mt->slots[i];
+        if (slot->hash == 0) continue;
+
+        elem_t key, value;
+        if (!to_elem(mt, slot->key, mt->header->key_kind, &key) ||
+            !to_elem(mt, slot->value, mt->header->value_kind, &value))
+        {
+            continue; // damaged
+        }
+        apply_fun(key, &value, arg);
+    }
+}
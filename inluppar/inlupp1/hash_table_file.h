@@ -0,0 +1,58 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+#include "hash_table.h"
+
+/// Hash tables saved to a file and opened again with mmap, so a big table does not
+/// have to be rebuilt at every start.
+///
+/// The file holds no pointers: a header (magic, version, hash seed, sizes), an open
+/// addressing slot array and a heap with the bytes of the string keys and values, all
+/// referred to by offsets. It is written to a temporary file that is renamed over the
+/// old one, and opened read-only; lookups probe the mapped pages directly, so opening
+/// costs page faults, not inserts.
+///
+/// The file hashes keys itself (hash_bytes for strings, hash_int_seeded for ints, with
+/// the seed in the header), whatever hash function the saved table used.
+
+#define Table_File_Version 1
+
+/// How a key or value of the saved table is to be read and written
+typedef enum table_file_elem
+{
+    IOOPM_FILE_INT = 0,   // elem_t.i
+    IOOPM_FILE_STR,       // elem_t.p is a NUL terminated char *
+    IOOPM_FILE_STRVIEW,   // elem_t.p is an ioopm_str_t * (saved as, and opened as, IOOPM_FILE_STR)
+} ioopm_file_elem_t;
+
+typedef struct mapped_table ioopm_mapped_table_t;
+
+/**
+ * Write every entry of ht to path, replacing the file.
+ * The table goes to path.tmp first, flushed to disk and renamed over path, so a table
+ * mapped from the old file stays valid and a crash never leaves a torn file.
+ * Returns false (with errno set) if the file could not be written; path is then untouched.
+ */
+bool ioopm_hash_table_save(ioopm_hash_table_t *ht, const char *path,
+                           ioopm_file_elem_t key_kind, ioopm_file_elem_t value_kind);
+
+/**
+ * Map a file written by ioopm_hash_table_save.
+ * Returns NULL if it can not be opened or is not a table file of this version.
+ */
+ioopm_mapped_table_t *ioopm_mapped_table_open(const char *path);
+
+/// @brief unmap the file; strings handed out by lookups are gone after this
+void ioopm_mapped_table_close(ioopm_mapped_table_t *mt);
+
+/// @brief look up key (an int or a char *, as saved); string values point into the mapping.
+/// Entries whose strings lie outside the file are skipped, here and in apply_to_all.
+option_t ioopm_mapped_table_lookup(ioopm_mapped_table_t *mt, elem_t key);
+
+/// @brief the number of entries in the file
+size_t ioopm_mapped_table_size(ioopm_mapped_table_t *mt);
+
+/// @brief apply a function to every entry, value changes are not written back
+void ioopm_mapped_table_apply_to_all(ioopm_mapped_table_t *mt, ioopm_apply_function *apply_fun, void *arg);
@@ -0,0 +1,77 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "hash_table.h"
+#include "hash_table_internal.h"
+
+/// The key filter of a table (options.key_filter): a blocked Bloom filter over the
+/// cached hashes. A key sets Filter_Hashes bits, all in one cache line sized block, so
+/// a check is one cache miss at most. A bit that is not set proves the key absent and
+/// the lookup ends without touching a bucket.
+///
+/// Bloom filters can not delete, so a removed key's bits stay set until the next
+/// rebuild. hash_table.c rebuilds the filter on every resize and once enough removes
+/// have piled up (see filter_stale).
+
+#define Filter_Bits_Per_Key 10 // about 1% false positives
+
+void ioopm_filter_init(ioopm_hash_table_t *ht, size_t entries)
+{
+    size_t bits = entries * Filter_Bits_Per_Key;
+    size_t blocks = 2; // at least 2, home_index can not shift by 64
+    while (blocks * Filter_Block_Words * 64 < bits) blocks <<= 1;
+
+    ioopm_filter_free(ht);
+    void *filter = NULL;
+    if (posix_memalign(&filter, Filter_Block_Words * sizeof(uint64_t), blocks * Filter_Block_Words * sizeof(uint64_t)) != 0)
+    {
+        filter = malloc(blocks * Filter_Block_Words * sizeof(uint64_t)); // unaligned only costs a second line
+    }
+    memset(filter, 0, blocks * Filter_Block_Words * sizeof(uint64_t));
+
+    ht->filter = filter;
+    ht->filter_blocks = blocks;
+    ht->filter_shift = shift_for(blocks);
+    ht->filter_stale = 0;
+}
+
+void ioopm_filter_free(ioopm_hash_table_t *ht)
+{
+    free(ht->filter);
+    ht->filter = NULL;
+}
+
+void ioopm_filter_add(ioopm_hash_table_t *ht, uint64_t hash)
+{
+    uint64_t *block = filter_block(ht, hash);
+    uint64_t bits = filter_bits(hash);
+
+    for (int j = 0; j < Filter_Hashes; j++, bits >>= 9)
+    {
+        block[(bits & 511) >> 6] |= (uint64_t) 1 << (bits & 63);
+    }
+}
+
+void ioopm_filter_clear(ioopm_hash_table_t *ht)
+{
+    memset(ht->filter, 0, ht->filter_blocks * Filter_Block_Words * sizeof(uint64_t));
+    ht->filter_stale = 0;
+}
+
+double ioopm_filter_fp_estimate(ioopm_hash_table_t *ht)
+{
+    // A missing key gets through if all its bits happen to be set in the block it maps to
+    double sum = 0;
+    for (size_t b = 0; b < ht->filter_blocks; b++)
+    {
+        size_t set = 0;
+        for (int w = 0; w < Filter_Block_Words; w++) set += __builtin_popcountll(ht->filter[b * Filter_Block_Words + w]);
+
+        double fill = (double) set / (Filter_Block_Words * 64);
+        double pass = 1;
+        for (int j = 0; j < Filter_Hashes; j++) pass *= fill;
+        sum += pass;
+    }
+    return sum / (double) ht->filter_blocks;
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "common.h"
+#include "hash_table.h"
+
+/// Shared between hash_table.c and the backend files, not part of the public API.
+
+#define Fib_Multiplier 0x9E3779B97F4A7C15ull // 2^64 / golden ratio
+
+/// Reduce a full-width hash to an index in a power of two array (Fibonacci hashing).
+/// Multiplying first spreads weak low bits (e.g. hash_int) over the whole word.
+static inline size_t home_index(uint64_t hash, unsigned shift)
+{
+    return (size_t)((hash * Fib_Multiplier) >> shift);
+}
+
+/// Hash a key for the table. 0 is reserved to mark empty open addressing slots.
+static inline uint64_t hash_of(ioopm_hash_table_t *ht, elem_t key)
+{
+    uint64_t hash = ht->seeded_func ? ht->seeded_func(key, ht->seed) : ht->func(key);
+    return hash != 0 ? hash : 1;
+}
+
+/// 64 - log2(no_buckets), the shift home_index needs for a power of two array
+static inline unsigned shift_for(size_t no_buckets)
+{
+    unsigned log2 = 0;
+    while (((size_t) 1 << log2) < no_buckets) log2++;
+    return 64 - log2;
+}
+
+/// Counting for ioopm_hash_table_stats, compiled out unless IOOPM_HT_STATS is defined
+#ifdef IOOPM_HT_STATS
+#define Count(ht, counter) ((ht)->counters.counter++)
+#else
+#define Count(ht, counter) ((void) 0)
+#endif
+
+/// ht->eq_func(a, b), counted
+#define Eq(ht, a, b) (Count(ht, eq_calls), (ht)->eq_func(a, b))
+
+/// Called once per entry by the backend iterators; return false to stop early
+typedef bool entry_visitor(elem_t key, elem_t *value, void *arg);
+
+/// ---------------------- Robin Hood backend (hash_table_robin.c) ----------------------
+
+void ioopm_robin_init(ioopm_hash_table_t *ht, size_t no_slots);
+void ioopm_robin_free(ioopm_hash_table_t *ht);
+elem_t *ioopm_robin_find(ioopm_hash_table_t *ht, elem_t key, uint64_t hash);
+/// Start loading the cache lines a find for hash would touch first
+void ioopm_robin_prefetch(ioopm_hash_table_t *ht, uint64_t hash);
+elem_t *ioopm_robin_insert_new(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t value);
+bool ioopm_robin_remove(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t *removed_key, elem_t *removed_value);
+/// Remove whatever is in slot i (if anything) and hand it back
+bool ioopm_robin_take_at(ioopm_hash_table_t *ht, size_t i, elem_t *key, elem_t *value, uint64_t *hash);
+void ioopm_robin_resize(ioopm_hash_table_t *ht, size_t no_slots);
+/// Visit the entries in slots from .. to - 1
+bool ioopm_robin_each(ioopm_hash_table_t *ht, size_t from, size_t to, entry_visitor *visit, void *arg);
+void ioopm_robin_clear(ioopm_hash_table_t *ht);
+
+/// ---------------------- Swiss table backend (hash_table_swiss.c) ----------------------
+
+#ifdef __AVX2__
+#define Swiss_Group_Shift 5 // log2 of the slots probed per AVX2 compare
+#else
+#define Swiss_Group_Shift 4 // log2 of the slots probed per SSE2 compare
+#endif
+#define Swiss_Group_Size (1 << Swiss_Group_Shift) // also the smallest table
+
+void ioopm_swiss_init(ioopm_hash_table_t *ht, size_t no_slots);
+void ioopm_swiss_free(ioopm_hash_table_t *ht);
+elem_t *ioopm_swiss_find(ioopm_hash_table_t *ht, elem_t key, uint64_t hash);
+void ioopm_swiss_prefetch(ioopm_hash_table_t *ht, uint64_t hash);
+elem_t *ioopm_swiss_insert_new(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t value);
+bool ioopm_swiss_remove(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t *removed_key, elem_t *removed_value);
+bool ioopm_swiss_take_at(ioopm_hash_table_t *ht, size_t i, elem_t *key, elem_t *value, uint64_t *hash);
+void ioopm_swiss_resize(ioopm_hash_table_t *ht, size_t no_slots);
+/// Groups a find for the key in (full) slot i has to look at, 1 if it is in its home group
+size_t ioopm_swiss_probe_length(ioopm_hash_table_t *ht, size_t i);
+bool ioopm_swiss_each(ioopm_hash_table_t *ht, size_t from, size_t to, entry_visitor *visit, void *arg);
+void ioopm_swiss_clear(ioopm_hash_table_t *ht);
+
+/// ---------------------- Insertion ordered backend (hash_table_ordered.c) ----------------------
+
+/// For the ordered backend the positions given to take_at and each are positions in the
+/// dense entry arrays, not index slots; positions past entries_used are empty.
+void ioopm_ordered_init(ioopm_hash_table_t *ht, size_t no_slots);
+void ioopm_ordered_free(ioopm_hash_table_t *ht);
+elem_t *ioopm_ordered_find(ioopm_hash_table_t *ht, elem_t key, uint64_t hash);
+void ioopm_ordered_prefetch(ioopm_hash_table_t *ht, uint64_t hash);
+elem_t *ioopm_ordered_insert_new(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t value);
+bool ioopm_ordered_remove(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t *removed_key, elem_t *removed_value);
+bool ioopm_ordered_take_at(ioopm_hash_table_t *ht, size_t i, elem_t *key, elem_t *value, uint64_t *hash);
+/// Rebuild with no_slots index slots; drops dead entries, keeps the order of the live ones
+void ioopm_ordered_resize(ioopm_hash_table_t *ht, size_t no_slots);
+/// Slots from home + 1 for the live entry that index slot i points at
+size_t ioopm_ordered_probe_length(ioopm_hash_table_t *ht, size_t i);
+bool ioopm_ordered_each(ioopm_hash_table_t *ht, size_t from, size_t to, entry_visitor *visit, void *arg);
+void ioopm_ordered_clear(ioopm_hash_table_t *ht);
+
+/// ---------------------- Key filter (hash_table_filter.c) ----------------------
+
+#define Filter_Block_Words 8 // 512 bit blocks, one cache line
+#define Filter_Hashes 6      // bits set per key, 9 bits of filter_bits each
+
+static inline uint64_t *filter_block(ioopm_hash_table_t *ht, uint64_t hash)
+{
+    return ht->filter + home_index(hash, ht->filter_shift) * Filter_Block_Words;
+}
+
+/// Where in its block a key's bits go; mixed, so they do not follow from the block
+static inline uint64_t filter_bits(uint64_t hash)
+{
+    hash = (hash ^ (hash >> 31)) * 0xbf58476d1ce4e5b9ull;
+    return hash ^ (hash >> 29);
+}
+
+/// false: no key with this hash is in the table. true: there may be one.
+static inline bool filter_may_contain(ioopm_hash_table_t *ht, uint64_t hash)
+{
+    const uint64_t *block = filter_block(ht, hash);
+    uint64_t bits = filter_bits(hash);
+
+    for (int j = 0; j < Filter_Hashes; j++, bits >>= 9)
+    {
+        if (!(block[(bits & 511) >> 6] & ((uint64_t) 1 << (bits & 63)))) return false;
+    }
+    return true;
+}
+
+/// (Re)allocate an empty filter sized for entries keys
+void ioopm_filter_init(ioopm_hash_table_t *ht, size_t entries);
+void ioopm_filter_free(ioopm_hash_table_t *ht);
+void ioopm_filter_add(ioopm_hash_table_t *ht, uint64_t hash);
+void ioopm_filter_clear(ioopm_hash_table_t *ht);
+/// Chance that a key that is not in the table gets past the filter, from how full it is
+double ioopm_filter_fp_estimate(ioopm_hash_table_t *ht);
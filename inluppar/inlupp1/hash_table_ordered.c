@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "common.h"
+#include "hash_table.h"
+#include "hash_table_internal.h"
+
+/// Insertion ordered storage, like Python's compact dict. Entries are appended to three
+/// dense parallel arrays (slot_keys, slot_values, slot_hashes) in the order they are
+/// inserted, and a separate open addressing index of no_buckets 32 bit slots maps a
+/// hash to a position in them (0 is an empty index slot, otherwise position + 1).
+///
+/// Iterating is a scan over the dense arrays, so it follows insertion order and touches
+/// no empty slots. A removed entry is only marked dead (hash 0) and counted in
+/// tombstones; the arrays are compacted when they run out of room, and on every resize.
+/// Positions are 32 bits, so a table holds at most 2^32 - 1 entries.
+
+/// Entries that fit before the arrays have to be compacted or grown: as many as the
+/// load factor allows, so the table grows just as the arrays fill up with live entries.
+/// Below no_slots, so the index always keeps an empty slot to end a probe for a missing key.
+static size_t room_for(ioopm_hash_table_t *ht, size_t no_slots)
+{
+    size_t room = (size_t) ((float) no_slots * ht->max_load_factor);
+    return room < no_slots ? room : no_slots - 1;
+}
+
+void ioopm_ordered_init(ioopm_hash_table_t *ht, size_t no_slots)
+{
+    ht->no_buckets = no_slots;
+    ht->bucket_shift = shift_for(no_slots);
+    ht->tombstones = 0;
+    ht->entries_used = 0;
+    ht->entries_room = room_for(ht, no_slots);
+    ht->entry_index = calloc(no_slots, sizeof(uint32_t));
+    ht->slot_keys = malloc(ht->entries_room * sizeof(elem_t));
+    ht->slot_values = malloc(ht->entries_room * sizeof(elem_t));
+    ht->slot_hashes = malloc(ht->entries_room * sizeof(uint64_t));
+}
+
+void ioopm_ordered_free(ioopm_hash_table_t *ht)
+{
+    free(ht->entry_index);
+    free(ht->slot_keys);
+    free(ht->slot_values);
+    free(ht->slot_hashes);
+}
+
+elem_t *ioopm_ordered_find(ioopm_hash_table_t *ht, elem_t key, uint64_t hash)
+{
+    size_t mask = ht->no_buckets - 1;
+
+    // Index slots of dead entries are passed over like live ones, their hash never matches
+    for (size_t i = home_index(hash, ht->bucket_shift); ht->entry_index[i] != 0; i = (i + 1) & mask)
+    {
+        size_t e = ht->entry_index[i] - 1;
+        if (ht->slot_hashes[e] == hash && Eq(ht, ht->slot_keys[e], key))
+        {
+            return &ht->slot_values[e];
+        }
+    }
+    return NULL;
+}
+
+void ioopm_ordered_prefetch(ioopm_hash_table_t *ht, uint64_t hash)
+{
+    __builtin_prefetch(&ht->entry_index[home_index(hash, ht->bucket_shift)]);
+}
+
+/// Point the index at entry e, in the first slot that is empty or belongs to a dead entry
+static void index_entry(ioopm_hash_table_t *ht, size_t e)
+{
+    size_t mask = ht->no_buckets - 1;
+    size_t i = home_index(ht->slot_hashes[e], ht->bucket_shift);
+
+    while (ht->entry_index[i] != 0 && ht->slot_hashes[ht->entry_index[i] - 1] != 0) i = (i + 1) & mask;
+    ht->entry_index[i] = (uint32_t) (e + 1);
+}
+
+/// Append an entry that is known not to be in the table; the caller makes sure there is room
+static elem_t *append(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t value)
+{
+    size_t e = ht->entries_used++;
+    ht->slot_keys[e] = key;
+    ht->slot_values[e] = value;
+    ht->slot_hashes[e] = hash;
+    index_entry(ht, e);
+    return &ht->slot_values[e];
+}
+
+void ioopm_ordered_resize(ioopm_hash_table_t *ht, size_t no_slots)
+{
+    elem_t *old_keys = ht->slot_keys;
+    elem_t *old_values = ht->slot_values;
+    uint64_t *old_hashes = ht->slot_hashes;
+    size_t old_used = ht->entries_used;
+
+    free(ht->entry_index);
+    ioopm_ordered_init(ht, no_slots);
+
+    // Live entries keep their order, dead ones are dropped; the cached hashes are reused
+    for (size_t e = 0; e < old_used; e++)
+    {
+        if (old_hashes[e] != 0) append(ht, old_keys[e], old_hashes[e], old_values[e]);
+    }
+
+    free(old_keys);
+    free(old_values);
+    free(old_hashes);
+}
+
+elem_t *ioopm_ordered_insert_new(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t value)
+{
+    // Out of room at the end but not over the load factor, so there are dead entries:
+    // compact in place. Growing is up to the table (maybe_grow).
+    if (ht->entries_used == ht->entries_room) ioopm_ordered_resize(ht, ht->no_buckets);
+    return append(ht, key, hash, value);
+}
+
+/// Mark entry e dead; its index slot stays until the next compaction
+static void remove_at(ioopm_hash_table_t *ht, size_t e)
+{
+    ht->slot_hashes[e] = 0;
+    ht->tombstones++;
+}
+
+bool ioopm_ordered_remove(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t *removed_key, elem_t *removed_value)
+{
+    elem_t *value = ioopm_ordered_find(ht, key, hash);
+    if (value == NULL) return false;
+
+    size_t e = value - ht->slot_values;
+    *removed_key = ht->slot_keys[e];
+    *removed_value = *value;
+    remove_at(ht, e);
+    return true;
+}
+
+bool ioopm_ordered_take_at(ioopm_hash_table_t *ht, size_t i, elem_t *key, elem_t *value, uint64_t *hash)
+{
+    if (i >= ht->entries_used || ht->slot_hashes[i] == 0) return false;
+
+    *key = ht->slot_keys[i];
+    *value = ht->slot_values[i];
+    *hash = ht->slot_hashes[i];
+    remove_at(ht, i);
+    return true;
+}
+
+size_t ioopm_ordered_probe_length(ioopm_hash_table_t *ht, size_t i)
+{
+    size_t e = ht->entry_index[i] - 1;
+    return ((i - home_index(ht->slot_hashes[e], ht->bucket_shift)) & (ht->no_buckets - 1)) + 1;
+}
+
+bool ioopm_ordered_each(ioopm_hash_table_t *ht, size_t from, size_t to, entry_visitor *visit, void *arg)
+{
+    if (to > ht->entries_used) to = ht->entries_used;
+    for (size_t e = from; e < to; e++)
+    {
+        if (ht->slot_hashes[e] != 0 && !visit(ht->slot_keys[e], &ht->slot_values[e], arg))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ioopm_ordered_clear(ioopm_hash_table_t *ht)
+{
+    for (size_t e = 0; e < ht->entries_used; e++)
+    {
+        if (ht->slot_hashes[e] != 0 && ht->should_free_keys && ht->slot_keys[e].p != NULL)
+        {
+            free(ht->slot_keys[e].p);
+        }
+    }
+    memset(ht->entry_index, 0, ht->no_buckets * sizeof(uint32_t));
+    ht->entries_used = 0;
+    ht->tombstones = 0;
+}
@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "common.h"
+#include "hash_table.h"
+#include "hash_table_internal.h"
+
+/// Robin Hood open addressing: keys, values and hashes live in three parallel arrays.
+/// An entry that is further from its home slot than the one we are looking at takes
+/// its place, which keeps probe sequences short and lets lookups stop early.
+/// Removal shifts the following entries back one step instead of leaving tombstones.
+
+/// How far the entry in slot i is from its home slot
+static inline size_t probe_distance(ioopm_hash_table_t *ht, size_t i)
+{
+    size_t home = home_index(ht->slot_hashes[i], ht->bucket_shift);
+    return (i - home) & (ht->no_buckets - 1);
+}
+
+void ioopm_robin_init(ioopm_hash_table_t *ht, size_t no_slots)
+{
+    ht->no_buckets = no_slots;
+    ht->bucket_shift = shift_for(no_slots);
+    ht->slot_keys = calloc(no_slots, sizeof(elem_t));
+    ht->slot_values = calloc(no_slots, sizeof(elem_t));
+    ht->slot_hashes = calloc(no_slots, sizeof(uint64_t));
+}
+
+void ioopm_robin_free(ioopm_hash_table_t *ht)
+{
+    free(ht->slot_keys);
+    free(ht->slot_values);
+    free(ht->slot_hashes);
+}
+
+elem_t *ioopm_robin_find(ioopm_hash_table_t *ht, elem_t key, uint64_t hash)
+{
+    size_t mask = ht->no_buckets - 1;
+    size_t i = home_index(hash, ht->bucket_shift);
+
+    for (size_t dist = 0; ht->slot_hashes[i] != 0; dist++, i = (i + 1) & mask)
+    {
+        // Everything from here on is closer to home than key would be, so key is absent
+        if (probe_distance(ht, i) < dist) return NULL;
+
+        if (ht->slot_hashes[i] == hash && Eq(ht, ht->slot_keys[i], key))
+        {
+            return &ht->slot_values[i];
+        }
+    }
+    return NULL;
+}
+
+/// Place an entry that is known not to be in the table, without checking the load factor
+static elem_t *place(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t value)
+{
+    size_t mask = ht->no_buckets - 1;
+    size_t i = home_index(hash, ht->bucket_shift);
+    elem_t *placed = NULL;
+
+    for (size_t dist = 0; ; dist++, i = (i + 1) & mask)
+    {
+        if (ht->slot_hashes[i] == 0)
+        {
+            ht->slot_hashes[i] = hash;
+            ht->slot_keys[i] = key;
+            ht->slot_values[i] = value;
+            return placed ? placed : &ht->slot_values[i];
+        }
+
+        size_t existing = probe_distance(ht, i);
+        if (existing < dist)
+        {
+            // Take from the rich: swap in and carry the displaced entry onwards
+            uint64_t tmp_hash = ht->slot_hashes[i];
+            elem_t tmp_key = ht->slot_keys[i];
+            elem_t tmp_value = ht->slot_values[i];
+
+            ht->slot_hashes[i] = hash;
+            ht->slot_keys[i] = key;
+            ht->slot_values[i] = value;
+            if (placed == NULL) placed = &ht->slot_values[i];
+
+            hash = tmp_hash;
+            key = tmp_key;
+            value = tmp_value;
+            dist = existing;
+        }
+    }
+}
+
+void ioopm_robin_prefetch(ioopm_hash_table_t *ht, uint64_t hash)
+{
+    size_t i = home_index(hash, ht->bucket_shift);
+    __builtin_prefetch(&ht->slot_hashes[i]);
+    __builtin_prefetch(&ht->slot_keys[i]);
+}
+
+elem_t *ioopm_robin_insert_new(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t value)
+{
+    return place(ht, key, hash, value);
+}
+
+/// Empty slot i. Backward shift: pull every following displaced entry one step closer to home.
+static void remove_at(ioopm_hash_table_t *ht, size_t i)
+{
+    size_t mask = ht->no_buckets - 1;
+    size_t next = (i + 1) & mask;
+    while (ht->slot_hashes[next] != 0 && probe_distance(ht, next) > 0)
+    {
+        ht->slot_hashes[i] = ht->slot_hashes[next];
+        ht->slot_keys[i] = ht->slot_keys[next];
+        ht->slot_values[i] = ht->slot_values[next];
+        i = next;
+        next = (next + 1) & mask;
+    }
+    ht->slot_hashes[i] = 0;
+}
+
+bool ioopm_robin_remove(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t *removed_key, elem_t *removed_value)
+{
+    elem_t *value = ioopm_robin_find(ht, key, hash);
+    if (value == NULL) return false;
+
+    size_t i = value - ht->slot_values;
+    *removed_key = ht->slot_keys[i];
+    *removed_value = *value;
+    remove_at(ht, i);
+    return true;
+}
+
+bool ioopm_robin_take_at(ioopm_hash_table_t *ht, size_t i, elem_t *key, elem_t *value, uint64_t *hash)
+{
+    if (ht->slot_hashes[i] == 0) return false;
+
+    *key = ht->slot_keys[i];
+    *value = ht->slot_values[i];
+    *hash = ht->slot_hashes[i];
+    remove_at(ht, i); // may pull the next entry into slot i
+    return true;
+}
+
+void ioopm_robin_resize(ioopm_hash_table_t *ht, size_t no_slots)
+{
+    elem_t *old_keys = ht->slot_keys;
+    elem_t *old_values = ht->slot_values;
+    uint64_t *old_hashes = ht->slot_hashes;
+    size_t old_no_slots = ht->no_buckets;
+
+    ioopm_robin_init(ht, no_slots);
+
+    // The cached hashes are reused, the hash function is never called again
+    for (size_t i = 0; i < old_no_slots; i++)
+    {
+        if (old_hashes[i] != 0)
+        {
+            place(ht, old_keys[i], old_hashes[i], old_values[i]);
+        }
+    }
+
+    free(old_keys);
+    free(old_values);
+    free(old_hashes);
+}
+
+bool ioopm_robin_each(ioopm_hash_table_t *ht, size_t from, size_t to, entry_visitor *visit, void *arg)
+{
+    for (size_t i = from; i < to; i++)
+    {
+        if (ht->slot_hashes[i] != 0 && !visit(ht->slot_keys[i], &ht->slot_values[i], arg))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ioopm_robin_clear(ioopm_hash_table_t *ht)
+{
+    for (size_t i = 0; i < ht->no_buckets; i++)
+    {
+        if (ht->slot_hashes[i] != 0 && ht->should_free_keys && ht->slot_keys[i].p != NULL)
+        {
+            free(ht->slot_keys[i].p);
+        }
+    }
+    memset(ht->slot_hashes, 0, ht->no_buckets * sizeof(uint64_t));
+}
@@ -0,0 +1,286 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "common.h"
+#include "hash_table.h"
+#include "hash_table_internal.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/// Swiss table style open addressing. Slots are split into groups of Group_Size and
+/// every slot has a control byte: Ctrl_Empty, Ctrl_Deleted, or 7 bits of the hash
+/// of the key stored there. A probe compares a whole group of control bytes at once
+/// and only calls eq_func for slots whose 7 bits (and cached hash) match.
+
+#define Group_Size Swiss_Group_Size
+#define Ctrl_Empty ((uint8_t) 0x80)
+#define Ctrl_Deleted ((uint8_t) 0xFE)
+
+/// Bit i of a group mask is set when slot i of the group matched
+typedef uint32_t group_mask_t;
+
+#if defined(__AVX2__)
+
+/// With AVX2 a group is 32 slots, compared with one 256-bit compare
+static inline group_mask_t match_byte(const uint8_t *group, uint8_t byte)
+{
+    __m256i ctrl = _mm256_loadu_si256((const __m256i *) group);
+    return (group_mask_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(ctrl, _mm256_set1_epi8((char) byte)));
+}
+
+static inline group_mask_t match_free(const uint8_t *group)
+{
+    return (group_mask_t) _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *) group));
+}
+
+#elif defined(__SSE2__)
+
+static inline group_mask_t match_byte(const uint8_t *group, uint8_t byte)
+{
+    __m128i ctrl = _mm_loadu_si128((const __m128i *) group);
+    return (group_mask_t) _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char) byte)));
+}
+
+/// Empty and deleted both have the high bit set, full slots never do
+static inline group_mask_t match_free(const uint8_t *group)
+{
+    return (group_mask_t) _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) group));
+}
+
+#else
+
+static inline group_mask_t match_byte(const uint8_t *group, uint8_t byte)
+{
+    group_mask_t mask = 0;
+    for (int i = 0; i < Group_Size; i++)
+    {
+        if (group[i] == byte) mask |= (group_mask_t) 1 << i;
+    }
+    return mask;
+}
+
+static inline group_mask_t match_free(const uint8_t *group)
+{
+    group_mask_t mask = 0;
+    for (int i = 0; i < Group_Size; i++)
+    {
+        if (group[i] & 0x80) mask |= (group_mask_t) 1 << i;
+    }
+    return mask;
+}
+
+#endif
+
+static inline int lowest_bit(group_mask_t mask)
+{
+    return __builtin_ctz(mask);
+}
+
+/// Top bits of the scrambled hash pick the first group, 7 other bits go in the control byte
+static inline size_t first_group(ioopm_hash_table_t *ht, uint64_t hash)
+{
+    if (ht->no_buckets == Group_Size) return 0; // a shift by 64 would be undefined
+    return home_index(hash, ht->bucket_shift + Swiss_Group_Shift); // index groups, not slots
+}
+
+static inline uint8_t fingerprint(uint64_t hash)
+{
+    return (uint8_t)(((hash * Fib_Multiplier) >> 32) & 0x7F);
+}
+
+void ioopm_swiss_init(ioopm_hash_table_t *ht, size_t no_slots)
+{
+    if (no_slots < Group_Size) no_slots = Group_Size;
+    ht->no_buckets = no_slots;
+    ht->bucket_shift = shift_for(no_slots);
+    ht->tombstones = 0;
+    ht->ctrl = malloc(no_slots);
+    memset(ht->ctrl, Ctrl_Empty, no_slots);
+    ht->slot_keys = calloc(no_slots, sizeof(elem_t));
+    ht->slot_values = calloc(no_slots, sizeof(elem_t));
+    ht->slot_hashes = calloc(no_slots, sizeof(uint64_t));
+}
+
+void ioopm_swiss_free(ioopm_hash_table_t *ht)
+{
+    free(ht->ctrl);
+    free(ht->slot_keys);
+    free(ht->slot_values);
+    free(ht->slot_hashes);
+}
+
+elem_t *ioopm_swiss_find(ioopm_hash_table_t *ht, elem_t key, uint64_t hash)
+{
+    size_t group_mask = ht->no_buckets / Group_Size - 1;
+    size_t group = first_group(ht, hash);
+    uint8_t h2 = fingerprint(hash);
+
+    // Triangular steps visit every group once when the group count is a power of two
+    for (size_t step = 1; step <= group_mask + 1; step++)
+    {
+        const uint8_t *ctrl = ht->ctrl + group * Group_Size;
+
+        for (group_mask_t match = match_byte(ctrl, h2); match; match &= match - 1)
+        {
+            size_t i = group * Group_Size + lowest_bit(match);
+            if (ht->slot_hashes[i] == hash && Eq(ht, ht->slot_keys[i], key))
+            {
+                return &ht->slot_values[i];
+            }
+        }
+
+        // An empty slot means the key would have been placed here, so it is absent
+        if (match_byte(ctrl, Ctrl_Empty)) return NULL;
+
+        group = (group + step) & group_mask;
+    }
+    return NULL;
+}
+
+void ioopm_swiss_prefetch(ioopm_hash_table_t *ht, uint64_t hash)
+{
+    size_t group = first_group(ht, hash);
+    __builtin_prefetch(ht->ctrl + group * Group_Size);
+    __builtin_prefetch(&ht->slot_hashes[group * Group_Size]);
+}
+
+/// Put an entry in the first free slot of its probe sequence, without checking the load
+static elem_t *place(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t value)
+{
+    size_t group_mask = ht->no_buckets / Group_Size - 1;
+    size_t group = first_group(ht, hash);
+
+    for (size_t step = 1; ; step++)
+    {
+        group_mask_t free_slots = match_free(ht->ctrl + group * Group_Size);
+        if (free_slots)
+        {
+            size_t i = group * Group_Size + lowest_bit(free_slots);
+            if (ht->ctrl[i] == Ctrl_Deleted) ht->tombstones--;
+            ht->ctrl[i] = fingerprint(hash);
+            ht->slot_hashes[i] = hash;
+            ht->slot_keys[i] = key;
+            ht->slot_values[i] = value;
+            return &ht->slot_values[i];
+        }
+        group = (group + step) & group_mask;
+    }
+}
+
+void ioopm_swiss_resize(ioopm_hash_table_t *ht, size_t no_slots)
+{
+    uint8_t *old_ctrl = ht->ctrl;
+    elem_t *old_keys = ht->slot_keys;
+    elem_t *old_values = ht->slot_values;
+    uint64_t *old_hashes = ht->slot_hashes;
+    size_t old_no_slots = ht->no_buckets;
+
+    ioopm_swiss_init(ht, no_slots);
+
+    // The cached hashes are reused, the hash function is never called again
+    for (size_t i = 0; i < old_no_slots; i++)
+    {
+        if (!(old_ctrl[i] & 0x80))
+        {
+            place(ht, old_keys[i], old_hashes[i], old_values[i]);
+        }
+    }
+
+    free(old_ctrl);
+    free(old_keys);
+    free(old_values);
+    free(old_hashes);
+}
+
+elem_t *ioopm_swiss_insert_new(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t value)
+{
+    // Tombstones lengthen probes like live entries do; rebuild in place to drop them
+    if ((float) (ht->size + ht->tombstones + 1) > (float) ht->no_buckets * ht->max_load_factor)
+    {
+        ioopm_swiss_resize(ht, ht->no_buckets);
+    }
+    return place(ht, key, hash, value);
+}
+
+/// Mark slot i as free again
+static void remove_at(ioopm_hash_table_t *ht, size_t i)
+{
+    // A group that still has an empty slot has never been full, so no probe went past
+    // it and the slot can become empty again. Otherwise leave a tombstone.
+    const uint8_t *group = ht->ctrl + (i & ~(size_t)(Group_Size - 1));
+    if (match_byte(group, Ctrl_Empty))
+    {
+        ht->ctrl[i] = Ctrl_Empty;
+    }
+    else
+    {
+        ht->ctrl[i] = Ctrl_Deleted;
+        ht->tombstones++;
+    }
+}
+
+bool ioopm_swiss_remove(ioopm_hash_table_t *ht, elem_t key, uint64_t hash, elem_t *removed_key, elem_t *removed_value)
+{
+    elem_t *value = ioopm_swiss_find(ht, key, hash);
+    if (value == NULL) return false;
+
+    size_t i = value - ht->slot_values;
+    *removed_key = ht->slot_keys[i];
+    *removed_value = *value;
+    remove_at(ht, i);
+    return true;
+}
+
+bool ioopm_swiss_take_at(ioopm_hash_table_t *ht, size_t i, elem_t *key, elem_t *value, uint64_t *hash)
+{
+    if (ht->ctrl[i] & 0x80) return false;
+
+    *key = ht->slot_keys[i];
+    *value = ht->slot_values[i];
+    *hash = ht->slot_hashes[i];
+    remove_at(ht, i);
+    return true;
+}
+
+size_t ioopm_swiss_probe_length(ioopm_hash_table_t *ht, size_t i)
+{
+    size_t group_mask = ht->no_buckets / Group_Size - 1;
+    size_t group = first_group(ht, ht->slot_hashes[i]);
+    size_t step = 1;
+
+    while (group != i / Group_Size)
+    {
+        group = (group + step) & group_mask;
+        step++;
+    }
+    return step;
+}
+
+bool ioopm_swiss_each(ioopm_hash_table_t *ht, size_t from, size_t to, entry_visitor *visit, void *arg)
+{
+    for (size_t i = from; i < to; i++)
+    {
+        if (!(ht->ctrl[i] & 0x80) && !visit(ht->slot_keys[i], &ht->slot_values[i], arg))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ioopm_swiss_clear(ioopm_hash_table_t *ht)
+{
+    for (size_t i = 0; i < ht->no_buckets; i++)
+    {
+        if (!(ht->ctrl[i] & 0x80) && ht->should_free_keys && ht->slot_keys[i].p != NULL)
+        {
+            free(ht->slot_keys[i].p);
+        }
+    }
+    memset(ht->ctrl, Ctrl_Empty, ht->no_buckets);
+    ht->tombstones = 0;
+}
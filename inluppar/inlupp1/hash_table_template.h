@@ -0,0 +1,244 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Type specialised hash tables, generated at compile time.
+///
+/// IOOPM_DEFINE_HASH_TABLE(name, K, V, hash_fn, eq_fn) defines name_t, a table from K to V,
+/// and static inline functions name_create, name_find, name_insert, ... for it.
+/// Unlike ioopm_hash_table_t, keys and values are stored as K and V (no elem_t boxing)
+/// and hash_fn and eq_fn are called directly, so the compiler can inline them into the
+/// probe loop instead of calling through a function pointer for every slot.
+///
+///   hash_fn: uint64_t hash_fn(K key), a full width hash (it is reduced with Fibonacci hashing)
+///   eq_fn:   bool eq_fn(K a, K b)
+///
+/// Either may be a function or a function-like macro. Keys and values are copied by
+/// assignment and never freed by the table. Storage is Robin Hood open addressing
+/// like IOOPM_HT_ROBIN_HOOD, one array of { hash, key, value } slots, so a probe that
+/// finds its key has the value in the same cache line. Use it in one .c file per
+/// table type, e.g.
+///
+///   IOOPM_DEFINE_HASH_TABLE(int_counts, int, size_t, hash_small_int, small_int_eq)
+///   int_counts_t *counts = int_counts_create(0);
+///   (*int_counts_upsert(counts, 42, NULL))++;
+
+#define Template_Min_Slots 8
+#define Template_Fib_Multiplier 0x9E3779B97F4A7C15ull // as Fib_Multiplier in hash_table_internal.h
+
+/// The home slot of a hash in a table of 2^(64 - shift) slots
+static inline size_t ioopm_template_home(uint64_t hash, unsigned shift)
+{
+    return (size_t) ((hash * Template_Fib_Multiplier) >> shift);
+}
+
+static inline unsigned ioopm_template_shift(size_t no_slots)
+{
+    unsigned log2 = 0;
+    while (((size_t) 1 << log2) < no_slots) log2++;
+    return 64 - log2;
+}
+
+/// Smallest power of two slot count that keeps entries at or below 3/4 full
+static inline size_t ioopm_template_slots_for(size_t entries)
+{
+    size_t n = Template_Min_Slots;
+    while (entries * 4 > n * 3) n <<= 1;
+    return n;
+}
+
+#define IOOPM_DEFINE_HASH_TABLE(name, K, V, hash_fn, eq_fn)                                         \
+                                                                                                    \
+    typedef struct name##_slot                                                                      \
+    {                                                                                               \
+        uint64_t hash; /* 0 marks an empty slot */                                                  \
+        K key;                                                                                      \
+        V value;                                                                                    \
+    } name##_slot_t;                                                                                \
+                                                                                                    \
+    typedef struct name                                                                             \
+    {                                                                                               \
+        name##_slot_t *slots;                                                                       \
+        size_t no_slots;      /* always a power of two */                                           \
+        unsigned shift;       /* 64 - log2(no_slots) */                                             \
+        size_t min_slots;     /* never shrink below the capacity asked for */                       \
+        size_t size;                                                                                \
+    } name##_t;                                                                                     \
+                                                                                                    \
+    static inline uint64_t name##_hash_of(K key)                                                    \
+    {                                                                                               \
+        uint64_t h = hash_fn(key);                                                                  \
+        return h != 0 ? h : 1;                                                                      \
+    }                                                                                               \
+                                                                                                    \
+    static inline size_t name##_distance(const name##_t *t, size_t i)                               \
+    {                                                                                               \
+        return (i - ioopm_template_home(t->slots[i].hash, t->shift)) & (t->no_slots - 1);           \
+    }                                                                                               \
+                                                                                                    \
+    static inline void name##_init(name##_t *t, size_t no_slots)                                    \
+    {                                                                                               \
+        t->slots = calloc(no_slots, sizeof(name##_slot_t));                                         \
+        t->no_slots = no_slots;                                                                     \
+        t->shift = ioopm_template_shift(no_slots);                                                  \
+    }                                                                                               \
+                                                                                                    \
+    /** capacity: expected number of entries, 0 for the smallest table */                          \
+    static inline name##_t *name##_create(size_t capacity)                                          \
+    {                                                                                               \
+        name##_t *t = calloc(1, sizeof(name##_t));                                                  \
+        t->min_slots = ioopm_template_slots_for(capacity);                                          \
+        name##_init(t, t->min_slots);                                                               \
+        return t;                                                                                   \
+    }                                                                                               \
+                                                                                                    \
+    static inline void name##_destroy(name##_t *t)                                                  \
+    {                                                                                               \
+        if (!t) return;                                                                             \
+        free(t->slots);                                                                             \
+        free(t);                                                                                    \
+    }                                                                                               \
+                                                                                                    \
+    /** The slot holding key, or no_slots if there is none */                                       \
+    static inline size_t name##_find_index(name##_t *t, K key)                                      \
+    {                                                                                               \
+        uint64_t h = name##_hash_of(key);                                                           \
+        size_t mask = t->no_slots - 1;                                                              \
+        size_t i = ioopm_template_home(h, t->shift);                                                \
+                                                                                                    \
+        for (size_t dist = 0; t->slots[i].hash != 0; dist++, i = (i + 1) & mask)                    \
+        {                                                                                           \
+            if (name##_distance(t, i) < dist) break; /* it would have been placed by now */         \
+            if (t->slots[i].hash == h && eq_fn(t->slots[i].key, key)) return i;                     \
+        }                                                                                           \
+        return t->no_slots;                                                                         \
+    }                                                                                               \
+                                                                                                    \
+    /** The value of key, or NULL; valid until the table is next changed */                         \
+    static inline V *name##_find(name##_t *t, K key)                                                \
+    {                                                                                               \
+        size_t i = name##_find_index(t, key);                                                       \
+        return i < t->no_slots ? &t->slots[i].value : NULL;                                         \
+    }                                                                                               \
+                                                                                                    \
+    static inline bool name##_lookup(name##_t *t, K key, V *value)                                  \
+    {                                                                                               \
+        V *found = name##_find(t, key);                                                             \
+        if (found && value) *value = *found;                                                        \
+        return found != NULL;                                                                       \
+    }                                                                                               \
+                                                                                                    \
+    /** Place a new slot without checking the load, returns where its value ended up */             \
+    static inline V *name##_place(name##_t *t, name##_slot_t slot)                                  \
+    {                                                                                               \
+        size_t mask = t->no_slots - 1;                                                              \
+        size_t i = ioopm_template_home(slot.hash, t->shift);                                        \
+        V *placed = NULL;                                                                           \
+                                                                                                    \
+        for (size_t dist = 0; ; dist++, i = (i + 1) & mask)                                         \
+        {                                                                                           \
+            if (t->slots[i].hash == 0)                                                              \
+            {                                                                                       \
+                t->slots[i] = slot;                                                                 \
+                return placed ? placed : &t->slots[i].value;                                        \
+            }                                                                                       \
+            size_t existing = name##_distance(t, i);                                                \
+            if (existing < dist)                                                                    \
+            {                                                                                       \
+                /* Take from the rich and carry the displaced slot onwards */                       \
+                name##_slot_t displaced = t->slots[i];                                              \
+                t->slots[i] = slot;                                                                 \
+                if (placed == NULL) placed = &t->slots[i].value;                                    \
+                slot = displaced;                                                                   \
+                dist = existing;                                                                    \
+            }                                                                                       \
+        }                                                                                           \
+    }                                                                                               \
+                                                                                                    \
+    static inline void name##_resize(name##_t *t, size_t no_slots)                                  \
+    {                                                                                               \
+        name##_slot_t *old = t->slots;                                                              \
+        size_t old_no_slots = t->no_slots;                                                          \
+                                                                                                    \
+        name##_init(t, no_slots);                                                                   \
+        for (size_t i = 0; i < old_no_slots; i++)                                                   \
+        {                                                                                           \
+            if (old[i].hash != 0) name##_place(t, old[i]);                                          \
+        }                                                                                           \
+        free(old);                                                                                  \
+    }                                                                                               \
+                                                                                                    \
+    /** The value of key, adding it with a zeroed value if it is missing */                         \
+    static inline V *name##_upsert(name##_t *t, K key, bool *inserted)                              \
+    {                                                                                               \
+        V *found = name##_find(t, key);                                                             \
+        if (inserted) *inserted = found == NULL;                                                    \
+        if (found) return found;                                                                    \
+                                                                                                    \
+        /* Grow first, so the pointer handed out stays valid */                                     \
+        if ((t->size + 1) * 4 > t->no_slots * 3) name##_resize(t, t->no_slots * 2);                 \
+        name##_slot_t slot;                                                                         \
+        memset(&slot, 0, sizeof(slot));                                                             \
+        slot.hash = name##_hash_of(key);                                                            \
+        slot.key = key;                                                                             \
+        t->size++;                                                                                  \
+        return name##_place(t, slot);                                                               \
+    }                                                                                               \
+                                                                                                    \
+    static inline void name##_insert(name##_t *t, K key, V value)                                   \
+    {                                                                                               \
+        *name##_upsert(t, key, NULL) = value;                                                       \
+    }                                                                                               \
+                                                                                                    \
+    /** Remove key; what was stored is copied to removed_key / removed_value (may be NULL) */       \
+    static inline bool name##_remove(name##_t *t, K key, K *removed_key, V *removed_value)          \
+    {                                                                                               \
+        size_t i = name##_find_index(t, key);                                                       \
+        if (i == t->no_slots) return false;                                                         \
+                                                                                                    \
+        size_t mask = t->no_slots - 1;                                                              \
+        if (removed_key) *removed_key = t->slots[i].key;                                            \
+        if (removed_value) *removed_value = t->slots[i].value;                                      \
+                                                                                                    \
+        /* Backward shift, no tombstones */                                                         \
+        size_t next = (i + 1) & mask;                                                               \
+        while (t->slots[next].hash != 0 && name##_distance(t, next) > 0)                            \
+        {                                                                                           \
+            t->slots[i] = t->slots[next];                                                           \
+            i = next;                                                                               \
+            next = (next + 1) & mask;                                                               \
+        }                                                                                           \
+        t->slots[i].hash = 0;                                                                       \
+        t->size--;                                                                                  \
+                                                                                                    \
+        /* Shrink below 3/16 full, the default min_load_factor of ioopm_hash_table_t */             \
+        if (t->no_slots > t->min_slots && t->size * 16 < t->no_slots * 3)                           \
+        {                                                                                           \
+            name##_resize(t, t->no_slots / 2);                                                      \
+        }                                                                                           \
+        return true;                                                                                \
+    }                                                                                               \
+                                                                                                    \
+    static inline size_t name##_size(const name##_t *t)                                             \
+    {                                                                                               \
+        return t->size;                                                                             \
+    }                                                                                               \
+                                                                                                    \
+    static inline void name##_clear(name##_t *t)                                                    \
+    {                                                                                               \
+        free(t->slots);                                                                             \
+        name##_init(t, t->min_slots);                                                               \
+        t->size = 0;                                                                                \
+    }                                                                                               \
+                                                                                                    \
+    /** Call apply(key, &value, arg) for every entry; it may change the value */                    \
+    static inline void name##_apply_to_all(name##_t *t, void (*apply)(K key, V *value, void *arg),  \
+                                           void *arg)                                               \
+    {                                                                                               \
+        for (size_t i = 0; i < t->no_slots; i++)                                                    \
+        {                                                                                           \
+            if (t->slots[i].hash != 0) apply(t->slots[i].key, &t->slots[i].value, arg);             \
+        }                                                                                           \
+    }
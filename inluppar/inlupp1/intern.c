@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "hash_table_template.h"
+#include "intern.h"
+
+/// Every string lives in one allocation together with its reference count. The pool
+/// is a hash table from the string (the handle) to that allocation.
+typedef struct interned
+{
+    size_t refs;
+    char str[];
+} interned_t;
+
+/// As hash_str and str_eq, but on plain char * so the table below can inline them
+#define hash_chars(str) hash_bytes((str), strlen(str), 0)
+#define chars_eq(a, b) ((a) == (b) || strcmp((a), (b)) == 0)
+
+/// Every intern and release is a lookup here, so it gets a table of its own type
+IOOPM_DEFINE_HASH_TABLE(string_table, const char *, interned_t *, hash_chars, chars_eq)
+
+struct intern_pool
+{
+    string_table_t *strings;
+};
+
+ioopm_intern_pool_t *ioopm_intern_pool_create(void)
+{
+    ioopm_intern_pool_t *pool = calloc(1, sizeof(ioopm_intern_pool_t));
+    pool->strings = string_table_create(0);
+    return pool;
+}
+
+static void free_interned(const char *key, interned_t **value, void *arg)
+{
+    (void) key;
+    (void) arg;
+    free(*value);
+}
+
+void ioopm_intern_pool_destroy(ioopm_intern_pool_t *pool)
+{
+    if (!pool) return;
+
+    string_table_apply_to_all(pool->strings, free_interned, NULL);
+    string_table_destroy(pool->strings);
+    free(pool);
+}
+
+static interned_t *find_interned(ioopm_intern_pool_t *pool, const char *str)
+{
+    interned_t **entry = string_table_find(pool->strings, str);
+    return entry != NULL ? *entry : NULL;
+}
+
+const char *ioopm_intern(ioopm_intern_pool_t *pool, const char *str)
+{
+    interned_t *entry = find_interned(pool, str);
+    if (entry == NULL)
+    {
+        size_t len = strlen(str);
+        entry = malloc(sizeof(interned_t) + len + 1);
+        entry->refs = 0;
+        memcpy(entry->str, str, len + 1);
+        string_table_insert(pool->strings, entry->str, entry);
+    }
+    entry->refs++;
+    return entry->str;
+}
+
+void ioopm_intern_release(ioopm_intern_pool_t *pool, const char *handle)
+{
+    interned_t *entry = find_interned(pool, handle);
+    if (entry == NULL || --entry->refs > 0) return;
+
+    string_table_remove(pool->strings, entry->str, NULL, NULL);
+    free(entry);
+}
+
+const char *ioopm_intern_find(ioopm_intern_pool_t *pool, const char *str)
+{
+    interned_t *entry = find_interned(pool, str);
+    return entry != NULL ? entry->str : NULL;
+}
+
+size_t ioopm_intern_count(ioopm_intern_pool_t *pool)
+{
+    return string_table_size(pool->strings);
+}
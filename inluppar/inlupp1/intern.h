@@ -0,0 +1,35 @@
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+
+/// A pool of interned strings: every distinct string is stored once and handed out as
+/// the same pointer, so two handles from one pool are equal exactly when the pointers
+/// are (str_eq checks that before running strcmp). Handles are reference counted, a
+/// string is freed when its last reference is released.
+
+typedef struct intern_pool ioopm_intern_pool_t;
+
+/// @brief Create an empty pool
+ioopm_intern_pool_t *ioopm_intern_pool_create(void);
+
+/// @brief Free the pool and every string in it, whatever their reference counts
+/// @param pool the pool to be destroyed
+void ioopm_intern_pool_destroy(ioopm_intern_pool_t *pool);
+
+/// @brief Get the pool's copy of str and take a reference to it
+/// @param pool the pool
+/// @param str any string, it is copied the first time it is seen
+/// @return the handle for str, valid until its last reference is released
+const char *ioopm_intern(ioopm_intern_pool_t *pool, const char *str);
+
+/// @brief Give back one reference taken by ioopm_intern
+/// @param pool the pool the handle came from
+/// @param handle a handle (not just an equal string)
+void ioopm_intern_release(ioopm_intern_pool_t *pool, const char *handle);
+
+/// @brief Look up the handle for str without taking a reference
+/// @return the handle, or NULL if str is not in the pool
+const char *ioopm_intern_find(ioopm_intern_pool_t *pool, const char *str);
+
+/// @brief Number of distinct strings in the pool
+size_t ioopm_intern_count(ioopm_intern_pool_t *pool);
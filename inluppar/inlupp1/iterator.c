@@ -78,7 +78,7 @@ elem_t ioopm_iterator_remove(ioopm_list_iterator_t *iter){
         }
     }
 
-    free(remove);
+    ioopm_linked_list_free_link(iter->list, remove);
     iter->list->size--;
     return elem;
 }
@@ -86,7 +86,7 @@ elem_t ioopm_iterator_remove(ioopm_list_iterator_t *iter){
 /// @brief Insert a new element into the underlying list making the current element it's next
 void ioopm_iterator_insert(ioopm_list_iterator_t *iter, elem_t element) {
     if(!iter) return;
-    ioopm_link_t *new_node = calloc(1, sizeof(ioopm_link_t));
+    ioopm_link_t *new_node = ioopm_linked_list_new_link(iter->list);
     new_node->element = element;
 
     if (ioopm_linked_list_size(iter->list) == 0) { // empty list
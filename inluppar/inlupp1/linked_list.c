@@ -15,15 +15,62 @@ ioopm_list_t *ioopm_linked_list_create(ioopm_eq_function *eq_func){
     return list;
 }
 
-/// @brief Tear down the linked list and return all its memory (but not the memory of the elements)
-/// @param list the list to be destroyed
-void ioopm_linked_list_destroy(ioopm_list_t *list) {
-    if (!list) return;
+/// @brief Creates a new empty list whose links come from a slab instead of calloc
+/// @param eq_func equality function for the elements
+/// @param slab a shared slab, or NULL to give the list its own
+/// @return an empty linked list
+ioopm_list_t *ioopm_linked_list_create_pooled(ioopm_eq_function *eq_func, ioopm_slab_t *slab){
+    ioopm_list_t *list = ioopm_linked_list_create(eq_func);
+    if (slab == NULL) {
+        slab = ioopm_slab_create(sizeof(ioopm_link_t));
+        list->owns_link_slab = true;
+    }
+    list->link_slab = slab;
+    return list;
+}
+
+/// @brief Allocate a zeroed link the way list does
+ioopm_link_t *ioopm_linked_list_new_link(ioopm_list_t *list){
+    if (list->link_slab == NULL) {
+        return calloc(1, sizeof(ioopm_link_t));
+    }
+    ioopm_link_t *link = ioopm_slab_alloc(list->link_slab);
+    link->element = (elem_t){ .p = NULL };
+    link->next = NULL;
+    return link;
+}
+
+/// @brief Free a link that has been unlinked from list
+void ioopm_linked_list_free_link(ioopm_list_t *list, ioopm_link_t *link){
+    if (list->link_slab == NULL) {
+        free(link);
+    } else {
+        ioopm_slab_free(list->link_slab, link);
+    }
+}
+
+/// Free every link of the list, all at once when the list owns its slab
+static void free_all_links(ioopm_list_t *list) {
+    if (list->owns_link_slab) {
+        ioopm_slab_reset(list->link_slab);
+        return;
+    }
     ioopm_link_t *current = list->head;
     while (current != NULL) {
         ioopm_link_t *tmp = current;
         current = current->next;
-        free(tmp);
+        ioopm_linked_list_free_link(list, tmp);
+    }
+}
+
+/// @brief Tear down the linked list and return all its memory (but not the memory of the elements)
+/// @param list the list to be destroyed
+void ioopm_linked_list_destroy(ioopm_list_t *list) {
+    if (!list) return;
+    if (list->owns_link_slab) {
+        ioopm_slab_destroy(list->link_slab);
+    } else {
+        free_all_links(list);
     }
     free(list);  // finally free the container itself
 }
@@ -32,7 +79,7 @@ void ioopm_linked_list_destroy(ioopm_list_t *list) {
 /// @param list the linked list that will be appended
 /// @param value the value to be appended
 void ioopm_linked_list_append(ioopm_list_t *list, elem_t value){
-    ioopm_link_t *new_node = calloc(1, sizeof(ioopm_link_t));
+    ioopm_link_t *new_node = ioopm_linked_list_new_link(list);
     new_node->element = value;
     new_node->next = NULL; // since we add it in the last place in the list there will be nothing after
 
@@ -52,7 +99,7 @@ void ioopm_linked_list_append(ioopm_list_t *list, elem_t value){
 /// @param list the linked list that will be prepended to
 /// @param value the value to be prepended
 void ioopm_linked_list_prepend(ioopm_list_t *list, elem_t value) {
-    ioopm_link_t *new_node = calloc(1, sizeof(ioopm_link_t));
+    ioopm_link_t *new_node = ioopm_linked_list_new_link(list);
     new_node->element = value;
     new_node->next = list->head;
 
@@ -102,7 +149,7 @@ void ioopm_linked_list_insert(ioopm_list_t *list, int index, elem_t value) {
     }
 
     // Case 3: insert in the middle
-    ioopm_link_t *new_node = calloc(1, sizeof(ioopm_link_t));
+    ioopm_link_t *new_node = ioopm_linked_list_new_link(list);
     new_node->element = value;
 
     // Walk to node just before the insertion point
@@ -140,7 +187,7 @@ elem_t ioopm_linked_list_remove(ioopm_list_t *list, int index) {
         if (size == 1) {
             list->tail = NULL; 
         }
-        free(tmp);
+        ioopm_linked_list_free_link(list, tmp);
     }
     else {
         ioopm_link_t *current = list->head;
@@ -153,7 +200,7 @@ elem_t ioopm_linked_list_remove(ioopm_list_t *list, int index) {
         if (index == size - 1) {
             list->tail = current;
         }
-        free(tmp);
+        ioopm_linked_list_free_link(list, tmp);
     }
 
     list->size--;
@@ -206,12 +253,7 @@ bool ioopm_linked_list_is_empty(ioopm_list_t *list){
 /// @brief Remove all elements from a linked list
 /// @param list the linked list
 void ioopm_linked_list_clear(ioopm_list_t *list) {
-    ioopm_link_t *current = list->head;
-    while (current != NULL) {
-        ioopm_link_t *tmp = current;
-        current = current->next;
-        free(tmp);
-    }
+    free_all_links(list);
 
     // Reset container fields
     list->head = NULL;
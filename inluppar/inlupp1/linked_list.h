@@ -1,6 +1,7 @@
 #pragma once
 #include <stdbool.h>
 #include "common.h"
+#include "slab.h"
 
 typedef struct link ioopm_link_t;
 
@@ -14,11 +15,30 @@ typedef struct list {
     ioopm_link_t *tail;   // last node;
     size_t size;    // number of elements
     ioopm_eq_function *func; //boolean  euq function
+    ioopm_slab_t *link_slab; // where links come from, NULL means calloc
+    bool owns_link_slab;     // destroy/clear release the whole slab at once
 } ioopm_list_t;
 /// @brief Creates a new empty list
 /// @return an empty linked list
 ioopm_list_t *ioopm_linked_list_create(ioopm_eq_function *eq_func);
 
+/// @brief Creates a new empty list whose links come from a slab instead of calloc
+/// @param eq_func equality function for the elements
+/// @param slab a slab of sizeof(ioopm_link_t) objects shared with other lists (caller frees it),
+///             or NULL to give the list its own slab that destroy/clear release in one go
+/// @return an empty linked list
+ioopm_list_t *ioopm_linked_list_create_pooled(ioopm_eq_function *eq_func, ioopm_slab_t *slab);
+
+/// @brief Allocate a zeroed link the way list does (used by the iterator)
+/// @param list the list the link will belong to
+/// @return a new link
+ioopm_link_t *ioopm_linked_list_new_link(ioopm_list_t *list);
+
+/// @brief Free a link that has been unlinked from list (used by the iterator)
+/// @param list the list the link belonged to
+/// @param link the link to be freed
+void ioopm_linked_list_free_link(ioopm_list_t *list, ioopm_link_t *link);
+
 /// @brief Tear down the linked list and return all its memory (but not the memory of the elements)
 /// @param list the list to be destroyed
 void ioopm_linked_list_destroy(ioopm_list_t *list);
@@ -241,6 +241,46 @@ void test_string_data() {
     ioopm_linked_list_destroy(list);
 }
 
+void test_pooled_list() {
+    ioopm_list_t *list = ioopm_linked_list_create_pooled(int_eq, NULL);
+
+    for (int i = 0; i < 1000; i++) {
+        ioopm_linked_list_append(list, int_elem(i));
+    }
+    ioopm_linked_list_prepend(list, int_elem(-1));
+    ioopm_linked_list_insert(list, 1, int_elem(-2));
+    CU_ASSERT_EQUAL(ioopm_linked_list_size(list), 1002);
+    CU_ASSERT_EQUAL(ioopm_linked_list_get(list, 1).i, -2);
+    CU_ASSERT_EQUAL(ioopm_linked_list_remove(list, 0).i, -1);
+    CU_ASSERT_EQUAL(ioopm_slab_in_use(list->link_slab), 1001);
+
+    ioopm_linked_list_clear(list);
+    CU_ASSERT_TRUE(ioopm_linked_list_is_empty(list));
+    CU_ASSERT_EQUAL(ioopm_slab_in_use(list->link_slab), 0);
+
+    ioopm_linked_list_append(list, int_elem(7));
+    CU_ASSERT_TRUE(ioopm_linked_list_contains(list, int_elem(7)));
+    ioopm_linked_list_destroy(list);
+}
+
+void test_shared_link_slab() {
+    ioopm_slab_t *slab = ioopm_slab_create(sizeof(ioopm_link_t));
+    ioopm_list_t *a = ioopm_linked_list_create_pooled(int_eq, slab);
+    ioopm_list_t *b = ioopm_linked_list_create_pooled(int_eq, slab);
+
+    ioopm_linked_list_append(a, int_elem(1));
+    ioopm_linked_list_append(b, int_elem(2));
+    ioopm_linked_list_append(b, int_elem(3));
+    CU_ASSERT_EQUAL(ioopm_slab_in_use(slab), 3);
+
+    ioopm_linked_list_destroy(a); // only gives back a's links
+    CU_ASSERT_EQUAL(ioopm_slab_in_use(slab), 2);
+    CU_ASSERT_EQUAL(ioopm_linked_list_get(b, 1).i, 3);
+
+    ioopm_linked_list_destroy(b);
+    ioopm_slab_destroy(slab);
+}
+
 int main() {
     if (CU_initialize_registry() != CUE_SUCCESS) return CU_get_error();
 
@@ -261,6 +301,8 @@ int main() {
     CU_add_test(suite, "Destroy non empty list", test_clear_non_empty);
     CU_add_test(suite, "Predicate testing", test_predicate_edge_cases);
     CU_add_test(suite, "String testing with predicate", test_string_data);
+    CU_add_test(suite, "List with its own slab", test_pooled_list);
+    CU_add_test(suite, "Lists sharing a slab", test_shared_link_slab);
 
 
 
@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <assert.h>
+#include "slab.h"
+
+#define Objects_Per_Chunk 256
+
+/// Something with the strictest alignment we need (max_align_t is C11)
+typedef union
+{
+    long double ld;
+    long long ll;
+    void *p;
+} align_t;
+
+#define Slab_Alignment sizeof(align_t)
+
+typedef struct chunk chunk_t;
+
+struct chunk
+{
+    chunk_t *next;
+    align_t data[]; // Objects_Per_Chunk objects of slab->object_size bytes
+};
+
+/// A freed object is reused to hold the free list link
+typedef struct free_object free_object_t;
+
+struct free_object
+{
+    free_object_t *next;
+};
+
+struct slab
+{
+    size_t object_size;    // rounded up to Slab_Alignment
+    chunk_t *chunks;       // every chunk allocated, oldest first
+    chunk_t *current;      // chunk objects are bumped out of
+    size_t bump;           // objects already handed out from current
+    free_object_t *free_list;
+    size_t in_use;
+};
+
+static chunk_t *new_chunk(ioopm_slab_t *slab)
+{
+    chunk_t *chunk = malloc(sizeof(chunk_t) + slab->object_size * Objects_Per_Chunk);
+    chunk->next = NULL;
+    return chunk;
+}
+
+ioopm_slab_t *ioopm_slab_create(size_t object_size)
+{
+    ioopm_slab_t *slab = calloc(1, sizeof(ioopm_slab_t));
+    if (object_size < sizeof(free_object_t)) object_size = sizeof(free_object_t);
+    slab->object_size = (object_size + Slab_Alignment - 1) / Slab_Alignment * Slab_Alignment;
+    slab->chunks = new_chunk(slab);
+    slab->current = slab->chunks;
+    return slab;
+}
+
+void ioopm_slab_destroy(ioopm_slab_t *slab)
+{
+    if (!slab) return;
+    chunk_t *chunk = slab->chunks;
+    while (chunk != NULL)
+    {
+        chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(slab);
+}
+
+void *ioopm_slab_alloc(ioopm_slab_t *slab)
+{
+    slab->in_use++;
+
+    if (slab->free_list != NULL)
+    {
+        free_object_t *object = slab->free_list;
+        slab->free_list = object->next;
+        return object;
+    }
+
+    if (slab->bump == Objects_Per_Chunk)
+    {
+        // Chunks kept by ioopm_slab_reset are used again before new ones are made
+        if (slab->current->next == NULL)
+        {
+            slab->current->next = new_chunk(slab);
+        }
+        slab->current = slab->current->next;
+        slab->bump = 0;
+    }
+
+    return (char *) slab->current->data + slab->object_size * slab->bump++;
+}
+
+void ioopm_slab_free(ioopm_slab_t *slab, void *object)
+{
+    assert(slab->in_use > 0);
+    free_object_t *freed = object;
+    freed->next = slab->free_list;
+    slab->free_list = freed;
+    slab->in_use--;
+}
+
+void ioopm_slab_reset(ioopm_slab_t *slab)
+{
+    slab->current = slab->chunks;
+    slab->bump = 0;
+    slab->free_list = NULL;
+    slab->in_use = 0;
+}
+
+void ioopm_slab_adopt(ioopm_slab_t *slab, ioopm_slab_t *other)
+{
+    assert(slab->object_size == other->object_size);
+
+    // The adopted chunks go in front of the current one, so they are never bumped into
+    // again before a reset; their freed objects join the free list
+    chunk_t *last = other->chunks;
+    while (last->next != NULL) last = last->next;
+    last->next = slab->chunks;
+    slab->chunks = other->chunks;
+
+    if (other->free_list != NULL)
+    {
+        free_object_t *tail = other->free_list;
+        while (tail->next != NULL) tail = tail->next;
+        tail->next = slab->free_list;
+        slab->free_list = other->free_list;
+    }
+    slab->in_use += other->in_use;
+
+    other->chunks = new_chunk(other);
+    other->current = other->chunks;
+    other->bump = 0;
+    other->free_list = NULL;
+    other->in_use = 0;
+}
+
+size_t ioopm_slab_in_use(ioopm_slab_t *slab)
+{
+    return slab->in_use;
+}
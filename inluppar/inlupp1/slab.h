@@ -0,0 +1,44 @@
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+
+/// A slab allocator for many objects of the same size, e.g. hash table entries
+/// or list links. Objects are carved out of big chunks and freed objects go on a
+/// free list, so alloc/free are a few pointer moves instead of malloc/free.
+/// Everything can be given back at once with ioopm_slab_reset or ioopm_slab_destroy.
+
+typedef struct slab ioopm_slab_t;
+
+/// @brief Create a slab for objects of object_size bytes
+/// @param object_size size of every object handed out
+/// @return an empty slab
+ioopm_slab_t *ioopm_slab_create(size_t object_size);
+
+/// @brief Return all memory of the slab, including objects still in use
+/// @param slab the slab to be destroyed
+void ioopm_slab_destroy(ioopm_slab_t *slab);
+
+/// @brief Get an uninitialised object from the slab in O(1) time
+/// @param slab the slab allocated from
+/// @return a pointer to object_size bytes, suitably aligned for any type
+void *ioopm_slab_alloc(ioopm_slab_t *slab);
+
+/// @brief Give one object back to the slab in O(1) time
+/// @param slab the slab the object was allocated from
+/// @param object the object to be freed
+void ioopm_slab_free(ioopm_slab_t *slab, void *object);
+
+/// @brief Give every object back at once. The chunks are kept for reuse.
+/// @param slab the slab to be reset
+void ioopm_slab_reset(ioopm_slab_t *slab);
+
+/// @brief Take over all memory of other, so objects allocated from it can be freed
+/// to slab from now on. other is left empty and can be used or destroyed as usual.
+/// @param slab the slab taking over, with the same object size as other
+/// @param other the slab given up
+void ioopm_slab_adopt(ioopm_slab_t *slab, ioopm_slab_t *other);
+
+/// @brief Number of objects currently handed out
+/// @param slab the slab
+/// @return allocations minus frees since the last reset
+size_t ioopm_slab_in_use(ioopm_slab_t *slab);
@@ -0,0 +1,124 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "thread_pool.h"
+
+struct thread_pool
+{
+    pthread_t *workers;
+    size_t no_workers;          // threads started, one less than the pool size
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // a new run (or shutdown) for the workers
+    pthread_cond_t done;        // a worker has finished its part of the run
+    unsigned long generation;   // bumped by every run, workers wait for it to change
+    size_t finished;            // workers done with the current run
+    bool shutdown;
+
+    // The current run, written under lock before the workers are woken
+    ioopm_task_function *task;
+    void *arg;
+    size_t tasks;
+    size_t next_task;           // taken with an atomic add
+};
+
+/// Take tasks until there are none left
+static void run_tasks(ioopm_thread_pool_t *pool)
+{
+    size_t i;
+    while ((i = __atomic_fetch_add(&pool->next_task, 1, __ATOMIC_RELAXED)) < pool->tasks)
+    {
+        pool->task(i, pool->arg);
+    }
+}
+
+static void *worker(void *arg)
+{
+    ioopm_thread_pool_t *pool = arg;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true)
+    {
+        while (!pool->shutdown && pool->generation == seen) pthread_cond_wait(&pool->work, &pool->lock);
+        if (pool->shutdown) break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_tasks(pool);
+
+        // Every worker checks in for every run, so the next run can not start under it
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->finished == pool->no_workers) pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+ioopm_thread_pool_t *ioopm_thread_pool_create(size_t threads)
+{
+    if (threads == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (size_t) cpus : 1;
+    }
+
+    ioopm_thread_pool_t *pool = calloc(1, sizeof(ioopm_thread_pool_t));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    pool->workers = calloc(threads, sizeof(pthread_t));
+    for (size_t i = 0; i + 1 < threads; i++)
+    {
+        if (pthread_create(&pool->workers[i], NULL, worker, pool) != 0) break; // run with fewer
+        pool->no_workers++;
+    }
+    return pool;
+}
+
+void ioopm_thread_pool_destroy(ioopm_thread_pool_t *pool)
+{
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < pool->no_workers; i++) pthread_join(pool->workers[i], NULL);
+
+    free(pool->workers);
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+size_t ioopm_thread_pool_size(ioopm_thread_pool_t *pool)
+{
+    return pool->no_workers + 1;
+}
+
+void ioopm_thread_pool_run(ioopm_thread_pool_t *pool, size_t tasks, ioopm_task_function *task, void *arg)
+{
+    if (tasks == 0) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->arg = arg;
+    pool->tasks = tasks;
+    pool->next_task = 0;
+    pool->finished = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_tasks(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->finished < pool->no_workers) pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
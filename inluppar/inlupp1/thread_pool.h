@@ -0,0 +1,34 @@
+#pragma once
+#include <stddef.h>
+
+/// A fixed set of worker threads that run numbered tasks.
+///
+/// ioopm_thread_pool_run hands out tasks 0 .. n-1 to the workers and the calling
+/// thread, which helps instead of sitting idle, and returns once all of them are done.
+/// The workers sleep between runs, so a pool can be created once and reused.
+
+typedef struct thread_pool ioopm_thread_pool_t;
+
+/// One task of a run, called on some thread of the pool with the arg given to run
+typedef void ioopm_task_function(size_t task, void *arg);
+
+/**
+ * Start a pool. threads is the number of threads that run tasks, the caller of
+ * ioopm_thread_pool_run included; 0 means one per online CPU.
+ */
+ioopm_thread_pool_t *ioopm_thread_pool_create(size_t threads);
+
+/**
+ * Stop and join the workers. No run may be in progress.
+ */
+void ioopm_thread_pool_destroy(ioopm_thread_pool_t *pool);
+
+/// @brief the number of threads a run uses, the caller included
+size_t ioopm_thread_pool_size(ioopm_thread_pool_t *pool);
+
+/**
+ * Run task(i, arg) for every i below tasks and wait for all of them.
+ * Tasks run in no particular order and possibly at the same time.
+ * Only one thread at a time may run tasks on a pool.
+ */
+void ioopm_thread_pool_run(ioopm_thread_pool_t *pool, size_t tasks, ioopm_task_function *task, void *arg);
@@ -1,9 +1,18 @@
   #define _POSIX_C_SOURCE 200809L
   #include "CUnit/Basic.h"
   #include "hash_table.h"
+  #include "concurrent_hash_table.h"
+  #include "intern.h"
+  #include "hash_table_file.h"
+  #include "frozen_table.h"
+  #include "hash_table_template.h"
   #include <assert.h>
   #include <string.h>
   #include <stdlib.h>
+  #include <stdio.h>
+  #include <pthread.h>
+  #include <unistd.h>
+  #include <time.h>
   
 
   int init_suite(void) { return 0; }
@@ -213,6 +222,1439 @@ void test_ioopm_hash_table_any(void) {
     ioopm_hash_table_destroy(ht);
 }
 
+void test_hash_grow_and_shrink(void)
+{
+    ioopm_hash_table_t *ht = ioopm_hash_table_create(hash_int, int_eq);
+    size_t initial_buckets = ht->no_buckets;
+
+    for (int i = -500; i < 500; i++) {
+        ioopm_hash_table_insert(ht, int_elem(i), int_elem(i * 2));
+    }
+    CU_ASSERT_EQUAL(ioopm_hash_table_size(ht), 1000);
+    CU_ASSERT_TRUE(ht->no_buckets > initial_buckets);
+    CU_ASSERT_TRUE((float) ht->size <= (float) ht->no_buckets * ht->max_load_factor);
+
+    for (int i = -500; i < 500; i++) {
+        option_t res = ioopm_hash_table_lookup(ht, int_elem(i));
+        CU_ASSERT_TRUE(res.success);
+        CU_ASSERT_EQUAL(res.value.i, i * 2);
+    }
+
+    for (int i = -500; i < 490; i++) {
+        ioopm_hash_table_remove(ht, int_elem(i));
+    }
+    CU_ASSERT_EQUAL(ioopm_hash_table_size(ht), 10);
+    CU_ASSERT_TRUE((float) ht->size >= (float) ht->no_buckets * ht->min_load_factor);
+    CU_ASSERT_TRUE(ioopm_hash_table_has_key(ht, int_elem(495)));
+
+    ioopm_hash_table_destroy(ht);
+}
+
+void test_hash_create_with_capacity(void)
+{
+    ioopm_hash_table_options_t opts = { .capacity = 5000, .max_load_factor = 2.0f };
+    ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_int, int_eq, &opts);
+    size_t buckets = ht->no_buckets;
+    CU_ASSERT_TRUE((float) buckets * 2.0f >= 5000.0f);
+
+    for (int i = 0; i < 5000; i++) {
+        ioopm_hash_table_insert(ht, int_elem(i), int_elem(i));
+    }
+    CU_ASSERT_EQUAL(ht->no_buckets, buckets); // the hint was big enough, no resize
+
+    ioopm_hash_table_clear(ht);
+    CU_ASSERT_EQUAL(ht->no_buckets, buckets); // never shrinks below the hint
+    ioopm_hash_table_destroy(ht);
+}
+
+/// Inserts, overwrites and removes enough keys to force resizes and long probe runs
+static void exercise_backend(ioopm_hash_backend_t backend)
+{
+    ioopm_hash_table_options_t opts = { .backend = backend };
+    ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_int, int_eq, &opts);
+
+    for (int i = 0; i < 2000; i++) {
+        ioopm_hash_table_insert(ht, int_elem(i * 7), int_elem(i));
+    }
+    ioopm_hash_table_insert(ht, int_elem(14), int_elem(-1)); // overwrite
+    CU_ASSERT_EQUAL(ioopm_hash_table_size(ht), 2000);
+    CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, int_elem(14)).value.i, -1);
+
+    for (int i = 0; i < 2000; i += 2) {
+        ioopm_hash_table_remove(ht, int_elem(i * 7));
+    }
+    CU_ASSERT_EQUAL(ioopm_hash_table_size(ht), 1000);
+
+    for (int i = 0; i < 2000; i++) {
+        CU_ASSERT_EQUAL(ioopm_hash_table_has_key(ht, int_elem(i * 7)), i % 2 == 1);
+    }
+    CU_ASSERT_TRUE(ioopm_hash_table_has_value(ht, int_elem(1999)));
+    CU_ASSERT_FALSE(ioopm_hash_table_has_value(ht, int_elem(1998)));
+
+    ioopm_list_t *keys = ioopm_hash_table_keys(ht);
+    CU_ASSERT_EQUAL(ioopm_linked_list_size(keys), 1000);
+    ioopm_linked_list_destroy(keys);
+
+    ioopm_hash_table_clear(ht);
+    CU_ASSERT_TRUE(ioopm_hash_table_is_empty(ht));
+    CU_ASSERT_FALSE(ioopm_hash_table_has_key(ht, int_elem(7)));
+    ioopm_hash_table_destroy(ht);
+}
+
+void test_robin_hood_backend(void)
+{
+    exercise_backend(IOOPM_HT_ROBIN_HOOD);
+
+    // Owned string keys are freed on overwrite-free paths, remove and destroy
+    ioopm_hash_table_options_t opts = { .backend = IOOPM_HT_ROBIN_HOOD };
+    ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_str, str_eq, &opts);
+    ht->should_free_keys = true;
+    ioopm_hash_table_insert_freq(ht, ptr_elem(strdup("word")));
+    ioopm_hash_table_insert_freq(ht, ptr_elem(strdup("word")));
+    ioopm_hash_table_insert_freq(ht, ptr_elem(strdup("other")));
+    CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, ptr_elem("word")).value.i, 2);
+    ioopm_hash_table_remove(ht, ptr_elem("other"));
+    CU_ASSERT_EQUAL(ioopm_hash_table_size(ht), 1);
+    ioopm_hash_table_destroy(ht);
+}
+
+void test_swiss_backend(void)
+{
+    exercise_backend(IOOPM_HT_SWISS);
+
+    // Remove and re-insert in a loop so tombstones pile up and get rebuilt away
+    ioopm_hash_table_options_t opts = { .backend = IOOPM_HT_SWISS };
+    ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_int, int_eq, &opts);
+    for (int round = 0; round < 50; round++) {
+        for (int i = 0; i < 40; i++) {
+            ioopm_hash_table_insert(ht, int_elem(round * 40 + i), int_elem(round));
+        }
+        for (int i = 0; i < 30; i++) {
+            ioopm_hash_table_remove(ht, int_elem(round * 40 + i));
+        }
+    }
+    CU_ASSERT_EQUAL(ioopm_hash_table_size(ht), 500);
+    CU_ASSERT_TRUE(ht->size + ht->tombstones <= ht->no_buckets);
+    CU_ASSERT_TRUE(ioopm_hash_table_has_key(ht, int_elem(49 * 40 + 39)));
+    CU_ASSERT_FALSE(ioopm_hash_table_has_key(ht, int_elem(49 * 40)));
+    ioopm_hash_table_destroy(ht);
+}
+
+static int eq_calls = 0;
+
+static bool counting_int_eq(elem_t a, elem_t b)
+{
+    eq_calls++;
+    return a.i == b.i;
+}
+
+void test_hash_checked_before_eq(void)
+{
+    // A huge load factor keeps everything in a few long chains
+    ioopm_hash_table_options_t opts = { .max_load_factor = 100.0f };
+    ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_int, counting_int_eq, &opts);
+    for (int i = 1; i <= 500; i++) {
+        ioopm_hash_table_insert(ht, int_elem(i), int_elem(i));
+    }
+
+    eq_calls = 0;
+    for (int i = 1; i <= 500; i++) {
+        CU_ASSERT_TRUE(ioopm_hash_table_lookup(ht, int_elem(i)).success);
+    }
+    CU_ASSERT_EQUAL(eq_calls, 500); // exactly one eq_func call per hit
+    CU_ASSERT_FALSE(ioopm_hash_table_has_key(ht, int_elem(1000)));
+    CU_ASSERT_EQUAL(eq_calls, 500); // and none for a miss
+
+    ioopm_hash_table_destroy(ht);
+}
+
+void test_pooled_entries(void)
+{
+    ioopm_hash_table_options_t opts = { .pooled_entries = true };
+    ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_str, str_eq, &opts);
+    ht->should_free_keys = true;
+
+    char buf[16];
+    for (int i = 0; i < 600; i++) {
+        snprintf(buf, sizeof(buf), "key%d", i % 300);
+        ioopm_hash_table_insert_freq(ht, ptr_elem(strdup(buf)));
+    }
+    CU_ASSERT_EQUAL(ioopm_hash_table_size(ht), 300);
+    CU_ASSERT_EQUAL(ioopm_slab_in_use(ht->entry_slab), 300);
+    CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, ptr_elem("key42")).value.i, 2);
+
+    ioopm_hash_table_remove(ht, ptr_elem("key42"));
+    CU_ASSERT_EQUAL(ioopm_slab_in_use(ht->entry_slab), 299);
+
+    ioopm_hash_table_clear(ht); // frees keys, entries go back in one go
+    CU_ASSERT_EQUAL(ioopm_slab_in_use(ht->entry_slab), 0);
+    ioopm_hash_table_insert_freq(ht, ptr_elem(strdup("again")));
+    CU_ASSERT_TRUE(ioopm_hash_table_has_key(ht, ptr_elem("again")));
+    ioopm_list_t *keys = ioopm_hash_table_keys(ht); // a pooled table pools the list links too
+    CU_ASSERT_PTR_NOT_NULL(keys->link_slab);
+    ioopm_linked_list_destroy(keys);
+    ioopm_hash_table_destroy(ht);
+
+    // Without the option keys and values are plain lists
+    ioopm_hash_table_t *plain = ioopm_hash_table_create(hash_int, int_eq);
+    ioopm_hash_table_insert(plain, int_elem(1), int_elem(1));
+    ioopm_list_t *values = ioopm_hash_table_values(plain);
+    CU_ASSERT_PTR_NULL(values->link_slab);
+    ioopm_linked_list_destroy(values);
+    ioopm_hash_table_destroy(plain);
+
+    // Two tables drawing from one slab
+    ioopm_slab_t *slab = ioopm_slab_create(sizeof(entry_t));
+    ioopm_hash_table_options_t shared = { .entry_slab = slab };
+    ioopm_hash_table_t *a = ioopm_hash_table_create_with(hash_int, int_eq, &shared);
+    ioopm_hash_table_t *b = ioopm_hash_table_create_with(hash_int, int_eq, &shared);
+    for (int i = 0; i < 100; i++) {
+        ioopm_hash_table_insert(a, int_elem(i), int_elem(i));
+        ioopm_hash_table_insert(b, int_elem(i), int_elem(-i));
+    }
+    CU_ASSERT_EQUAL(ioopm_slab_in_use(slab), 200);
+    ioopm_hash_table_destroy(a);
+    CU_ASSERT_EQUAL(ioopm_slab_in_use(slab), 100);
+    CU_ASSERT_EQUAL(ioopm_hash_table_lookup(b, int_elem(5)).value.i, -5);
+    ioopm_hash_table_destroy(b);
+    ioopm_slab_destroy(slab);
+}
+
+void test_ordered_backend(void)
+{
+    exercise_backend(IOOPM_HT_ORDERED);
+
+    // Iteration and export follow insertion order, through growth, removes and compaction
+    ioopm_hash_table_options_t opts = { .backend = IOOPM_HT_ORDERED };
+    ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_int, int_eq, &opts);
+    for (int i = 0; i < 1000; i++) {
+        ioopm_hash_table_insert(ht, int_elem(999 - i), int_elem(i));
+    }
+    elem_t *keys = ioopm_hash_table_keys_array(ht, NULL); // no removes yet, copied in one go
+    for (int i = 0; i < 1000; i++) CU_ASSERT_EQUAL(keys[i].i, 999 - i);
+    free(keys);
+
+    for (int i = 0; i < 1000; i++) {
+        if (i % 3 != 0) ioopm_hash_table_remove(ht, int_elem(999 - i));
+    }
+    ioopm_hash_table_insert(ht, int_elem(999), int_elem(-1)); // an update keeps its place
+    ioopm_hash_table_insert(ht, int_elem(998), int_elem(-2)); // removed before, goes last
+    for (int round = 0; round < 20; round++) {
+        // Churn at a steady size, so dead entries have to be compacted away
+        ioopm_hash_table_insert(ht, int_elem(5000 + round), int_elem(0));
+        ioopm_hash_table_remove(ht, int_elem(5000 + round));
+    }
+    CU_ASSERT_EQUAL(ioopm_hash_table_size(ht), 335);
+    CU_ASSERT_TRUE(ht->entries_used <= ht->entries_room);
+
+    keys = ioopm_hash_table_keys_array(ht, NULL);
+    elem_t *values = ioopm_hash_table_values_array(ht, NULL);
+    for (int i = 0; i < 334; i++) {
+        CU_ASSERT_EQUAL(keys[i].i, 999 - 3 * i);
+        CU_ASSERT_EQUAL(values[i].i, i == 0 ? -1 : 3 * i);
+    }
+    CU_ASSERT_EQUAL(keys[334].i, 998);
+    CU_ASSERT_EQUAL(values[334].i, -2);
+    free(keys);
+    free(values);
+
+    ioopm_list_t *list = ioopm_hash_table_keys(ht);
+    CU_ASSERT_EQUAL(ioopm_linked_list_get(list, 1).i, 996);
+    ioopm_linked_list_destroy(list);
+    ioopm_hash_table_destroy(ht);
+
+    // Entry arrays that fill up with only a few dead entries grow the table the usual
+    // way, so the resize is counted and the key filter is sized for the new capacity
+    ioopm_hash_table_options_t filtered = { .backend = IOOPM_HT_ORDERED, .capacity = 1000, .key_filter = true };
+    ht = ioopm_hash_table_create_with(hash_int, int_eq, &filtered);
+    size_t room = ht->entries_room, no_buckets = ht->no_buckets, blocks = ht->filter_blocks;
+    CU_ASSERT_EQUAL(room, (size_t) ((float) no_buckets * ht->max_load_factor));
+    for (int i = 1; i < (int) room; i++) ioopm_hash_table_insert(ht, int_elem(i), int_elem(i));
+    ioopm_hash_table_remove(ht, int_elem(1));
+    ioopm_hash_table_insert(ht, int_elem(-1), int_elem(0));
+    ioopm_hash_table_insert(ht, int_elem(-2), int_elem(0)); // arrays full, one dead entry
+    CU_ASSERT_EQUAL(ht->no_buckets, 2 * no_buckets);
+    CU_ASSERT_TRUE(ht->filter_blocks > blocks);
+    CU_ASSERT_EQUAL(ht->tombstones, 0);
+#ifdef IOOPM_HT_STATS
+    CU_ASSERT_EQUAL(ht->counters.resizes, 1);
+#endif
+    CU_ASSERT_TRUE(ioopm_hash_table_has_key(ht, int_elem(-2)));
+    CU_ASSERT_FALSE(ioopm_hash_table_has_key(ht, int_elem(1)));
+    ioopm_hash_table_destroy(ht);
+
+    // Copied string keys are freed by remove, clear and destroy
+    opts.copy_keys = IOOPM_KEYS_COPY_STR;
+    ht = ioopm_hash_table_create_with(hash_str, str_eq, &opts);
+    char word[16];
+    for (int i = 0; i < 100; i++) {
+        sprintf(word, "w%d", i);
+        ioopm_hash_table_insert_freq(ht, ptr_elem(word));
+    }
+    ioopm_hash_table_remove(ht, ptr_elem("w0"));
+    keys = ioopm_hash_table_keys_array(ht, NULL);
+    CU_ASSERT_STRING_EQUAL(keys[0].p, "w1");
+    CU_ASSERT_STRING_EQUAL(keys[98].p, "w99");
+    free(keys);
+    ioopm_hash_table_clear(ht);
+    ioopm_hash_table_insert_freq(ht, ptr_elem("again"));
+    CU_ASSERT_EQUAL(ioopm_hash_table_size(ht), 1);
+    ioopm_hash_table_destroy(ht);
+}
+
+static void exercise_incremental(ioopm_hash_backend_t backend)
+{
+    ioopm_hash_table_options_t opts = { .backend = backend, .incremental_resize = true, .pooled_entries = true };
+    ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_int, int_eq, &opts);
+    bool seen_migrating = false;
+
+    for (int i = 1; i <= 2000; i++) {
+        ioopm_hash_table_insert(ht, int_elem(i), int_elem(i * 2));
+        if (ht->migrating_from != NULL) seen_migrating = true;
+    }
+    CU_ASSERT_TRUE(seen_migrating);
+    CU_ASSERT_EQUAL(ioopm_hash_table_size(ht), 2000);
+
+    // Every key is found wherever it currently lives, and removes reach both storages
+    for (int i = 1; i <= 2000; i++) {
+        CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, int_elem(i)).value.i, i * 2);
+    }
+    for (int i = 1; i <= 2000; i += 2) {
+        ioopm_hash_table_remove(ht, int_elem(i));
+    }
+    CU_ASSERT_EQUAL(ioopm_hash_table_size(ht), 1000);
+    CU_ASSERT_FALSE(ioopm_hash_table_has_key(ht, int_elem(1)));
+    CU_ASSERT_TRUE(ioopm_hash_table_has_key(ht, int_elem(2000)));
+
+    ioopm_list_t *keys = ioopm_hash_table_keys(ht);
+    CU_ASSERT_EQUAL(ioopm_linked_list_size(keys), 1000);
+    ioopm_linked_list_destroy(keys);
+
+    // Force a resize and clear before the old storage is drained
+    while (ht->migrating_from == NULL) {
+        ioopm_hash_table_insert(ht, int_elem(ioopm_hash_table_size(ht) * 2 + 10000), int_elem(0));
+    }
+
+    // Lookups move nothing, a slot handed out mid-migration stays put
+    elem_t *slot = ioopm_hash_table_lookup_slot(ht, int_elem(2000));
+    size_t pos = ht->migrating_from->migrate_pos;
+    for (int i = 1; i <= 2000; i++) ioopm_hash_table_has_key(ht, int_elem(i));
+    CU_ASSERT_EQUAL(ht->migrating_from->migrate_pos, pos);
+    CU_ASSERT_PTR_EQUAL(ioopm_hash_table_lookup_slot(ht, int_elem(2000)), slot);
+    CU_ASSERT_EQUAL(slot->i, 4000);
+
+    ioopm_hash_table_clear(ht);
+    CU_ASSERT_TRUE(ioopm_hash_table_is_empty(ht));
+    CU_ASSERT_PTR_NULL(ht->migrating_from);
+
+    for (int i = 1; i <= 100; i++) ioopm_hash_table_insert(ht, int_elem(i), int_elem(i));
+    ioopm_hash_table_destroy(ht); // possibly mid-migration
+}
+
+void test_incremental_resize(void)
+{
+    exercise_incremental(IOOPM_HT_CHAINED);
+    exercise_incremental(IOOPM_HT_ROBIN_HOOD);
+    exercise_incremental(IOOPM_HT_SWISS);
+    exercise_incremental(IOOPM_HT_ORDERED);
+}
+
+static void exercise_batches(ioopm_hash_backend_t backend)
+{
+    ioopm_hash_table_options_t opts = { .backend = backend };
+    ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_int, int_eq, &opts);
+
+    elem_t keys[100], values[100];
+    for (int i = 0; i < 100; i++) {
+        keys[i] = int_elem(i * 7);
+        values[i] = int_elem(i);
+    }
+    ioopm_hash_table_insert_batch(ht, keys, values, 100); // grows several times on the way
+    CU_ASSERT_EQUAL(ioopm_hash_table_size(ht), 100);
+
+    keys[99] = int_elem(3); // not in the table
+    option_t results[100];
+    ioopm_hash_table_lookup_batch(ht, keys, 100, results);
+    for (int i = 0; i < 99; i++) {
+        CU_ASSERT_TRUE(results[i].success);
+        CU_ASSERT_EQUAL(results[i].value.i, i);
+    }
+    CU_ASSERT_FALSE(results[99].success);
+    ioopm_hash_table_destroy(ht);
+
+    // Repeated keys within one batch are counted, and the extra copies freed
+    ht = ioopm_hash_table_create_with(hash_str, str_eq, &opts);
+    ht->should_free_keys = true;
+    char *words[] = { "a", "b", "a", "c", "a", "b" };
+    elem_t word_keys[6];
+    for (int i = 0; i < 6; i++) word_keys[i] = ptr_elem(strdup(words[i]));
+    ioopm_hash_table_insert_freq_batch(ht, word_keys, 6);
+    CU_ASSERT_EQUAL(ioopm_hash_table_size(ht), 3);
+    CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, ptr_elem("a")).value.i, 3);
+    CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, ptr_elem("b")).value.i, 2);
+    ioopm_hash_table_destroy(ht);
+}
+
+void test_batches(void)
+{
+    exercise_batches(IOOPM_HT_CHAINED);
+    exercise_batches(IOOPM_HT_ROBIN_HOOD);
+    exercise_batches(IOOPM_HT_SWISS);
+    exercise_batches(IOOPM_HT_ORDERED);
+}
+
+void test_export_arrays(void)
+{
+    ioopm_hash_table_t *ht = ioopm_hash_table_create(hash_int, int_eq);
+    elem_t *empty = ioopm_hash_table_keys_array(ht, NULL);
+    CU_ASSERT_PTR_NOT_NULL(empty);
+    free(empty);
+
+    for (int i = 0; i < 50; i++) ioopm_hash_table_insert(ht, int_elem(i), int_elem(i + 1000));
+
+    elem_t *keys = ioopm_hash_table_keys_array(ht, NULL);
+    elem_t values[50];
+    ioopm_hash_table_values_array(ht, values);
+    elem_t *pairs = ioopm_hash_table_pairs_array(ht, NULL);
+
+    int key_sum = 0;
+    for (int i = 0; i < 50; i++) {
+        key_sum += keys[i].i;
+        CU_ASSERT_EQUAL(values[i].i, keys[i].i + 1000); // same order
+        CU_ASSERT_EQUAL(pairs[2 * i].i, keys[i].i);
+        CU_ASSERT_EQUAL(pairs[2 * i + 1].i, values[i].i);
+    }
+    CU_ASSERT_EQUAL(key_sum, 49 * 50 / 2);
+
+    free(keys);
+    free(pairs);
+    ioopm_hash_table_destroy(ht);
+}
+
+void test_hash_family(void)
+{
+    // Reference vectors from the SipHash paper: key 00..0f, message 00..(len-1)
+    uint8_t msg[15];
+    for (int i = 0; i < 15; i++) msg[i] = (uint8_t) i;
+    uint64_t k0 = 0x0706050403020100ull, k1 = 0x0f0e0d0c0b0a0908ull;
+    CU_ASSERT_EQUAL(siphash_bytes(msg, 0, k0, k1), 0x726fdb47dd0e0e31ull);
+    CU_ASSERT_EQUAL(siphash_bytes(msg, 15, k0, k1), 0xa129ca6149be45e5ull);
+
+    // Every length path of hash_bytes sees every byte, and the seed changes the result
+    char text[100];
+    for (int i = 0; i < 100; i++) text[i] = (char) ('a' + i % 26);
+    for (size_t len = 1; len < 100; len++) {
+        uint64_t h = hash_bytes(text, len, 0);
+        CU_ASSERT_NOT_EQUAL(h, hash_bytes(text, len - 1, 0));
+        CU_ASSERT_NOT_EQUAL(h, hash_bytes(text, len, 1));
+        text[len - 1] ^= 1;
+        CU_ASSERT_NOT_EQUAL(h, hash_bytes(text, len, 0));
+        text[len - 1] ^= 1;
+    }
+    CU_ASSERT_EQUAL(hash_str(ptr_elem("banana")), hash_bytes("banana", 6, 0));
+    ioopm_hash_seed_t seven = { .k0 = 7 };
+    CU_ASSERT_NOT_EQUAL(hash_int_seeded(int_elem(1), seven), hash_int_seeded(int_elem(2), seven));
+
+    // hash_str_sip keys SipHash with both seed words, so either one changes every hash
+    ioopm_hash_seed_t key = { .k0 = k0, .k1 = k1 };
+    CU_ASSERT_EQUAL(hash_str_sip(ptr_elem(""), key), 0x726fdb47dd0e0e31ull);
+    ioopm_hash_seed_t other_k1 = { .k0 = k0, .k1 = k1 ^ 1 };
+    CU_ASSERT_NOT_EQUAL(hash_str_sip(ptr_elem("key"), key), hash_str_sip(ptr_elem("key"), other_k1));
+
+    // A table picks its hash family and seed at create time
+    ioopm_hash_table_options_t opts = { .seeded_hash = hash_str_sip, .hash_seed = { 0x1234, 0x5678 } };
+    ioopm_hash_table_t *ht = ioopm_hash_table_create_with(NULL, str_eq, &opts);
+    ioopm_hash_table_insert(ht, ptr_elem("key"), int_elem(1));
+    CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, ptr_elem("key")).value.i, 1);
+    CU_ASSERT_FALSE(ioopm_hash_table_has_key(ht, ptr_elem("kez")));
+    ioopm_hash_table_destroy(ht);
+}
+
+void test_string_views(void)
+{
+    const char *line = "apple,applesauce,apple";
+    ioopm_str_t first = ioopm_str_view(line, 5);
+    ioopm_str_t longer = ioopm_str_view(line + 6, 10);
+    ioopm_str_t last = ioopm_str_view(line + 17, 5);
+
+    CU_ASSERT_TRUE(strview_eq(ptr_elem(&first), ptr_elem(&last)));
+    CU_ASSERT_FALSE(strview_eq(ptr_elem(&first), ptr_elem(&longer))); // same prefix, other length
+    CU_ASSERT_EQUAL(hash_strview(ptr_elem(&first)), hash_strview(ptr_elem(&last)));
+
+    ioopm_hash_table_t *ht = ioopm_hash_table_create(hash_strview, strview_eq);
+    ht->should_free_keys = true;
+    ioopm_hash_table_insert(ht, ptr_elem(ioopm_str_dup(&first)), int_elem(1));
+    ioopm_hash_table_insert(ht, ptr_elem(ioopm_str_dup(&longer)), int_elem(2));
+
+    // Slices of the original buffer find the owned copies
+    CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, ptr_elem(&last)).value.i, 1);
+    CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, ptr_elem(&longer)).value.i, 2);
+
+    elem_t *keys = ioopm_hash_table_keys_array(ht, NULL);
+    ioopm_str_t *owned = keys[0].p;
+    CU_ASSERT_EQUAL(strlen(owned->ptr), owned->len); // copies are NUL terminated
+    free(keys);
+    ioopm_hash_table_destroy(ht); // one free per key releases the view and its bytes
+}
+
+void test_copied_keys(void)
+{
+    ioopm_hash_backend_t backends[] = { IOOPM_HT_CHAINED, IOOPM_HT_ROBIN_HOOD };
+    const char *long_key = "a key that does not fit inline";
+
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++)
+    {
+        ioopm_hash_table_options_t opts = { .backend = backends[b], .pooled_entries = true,
+                                            .copy_keys = IOOPM_KEYS_COPY_STR };
+        ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_str, str_eq, &opts);
+        char buf[64];
+
+        // The same buffer for every key, the table keeps copies
+        for (int i = 0; i < 100; i++)
+        {
+            snprintf(buf, sizeof(buf), "A%d", i);
+            ioopm_hash_table_insert(ht, ptr_elem(buf), int_elem(i));
+        }
+        strcpy(buf, long_key);
+        ioopm_hash_table_insert(ht, ptr_elem(buf), int_elem(-1));
+        strcpy(buf, "overwritten");
+
+        CU_ASSERT_EQUAL(ioopm_hash_table_size(ht), 101);
+        CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, ptr_elem("A25")).value.i, 25);
+        CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, ptr_elem((char *) long_key)).value.i, -1);
+        CU_ASSERT_FALSE(ioopm_hash_table_has_key(ht, ptr_elem(buf)));
+
+        // insert_freq leaves a caller's key alone when the table copies keys
+        ioopm_hash_table_insert_freq(ht, ptr_elem("A25"));
+        CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, ptr_elem("A25")).value.i, 26);
+
+        ioopm_hash_table_remove(ht, ptr_elem("A3"));
+        ioopm_hash_table_remove(ht, ptr_elem((char *) long_key));
+        CU_ASSERT_FALSE(ioopm_hash_table_has_key(ht, ptr_elem("A3")));
+        CU_ASSERT_EQUAL(ioopm_hash_table_size(ht), 99);
+        ioopm_hash_table_destroy(ht); // frees the copies left
+    }
+
+    // Views into a line, as freq-count hands them over
+    ioopm_hash_table_options_t opts = { .copy_keys = IOOPM_KEYS_COPY_STRVIEW };
+    ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_strview, strview_eq, &opts);
+    char line[] = "shelf,shelf,a-word-well-over-sixteen-bytes";
+    ioopm_str_t views[] = { ioopm_str_view(line, 5), ioopm_str_view(line + 6, 5), ioopm_str_view(line + 12, 30) };
+    ioopm_hash_table_insert_freq_batch(ht, (elem_t[]) { ptr_elem(&views[0]), ptr_elem(&views[1]), ptr_elem(&views[2]) }, 3);
+    memset(line, 'x', sizeof(line) - 1);
+
+    elem_t *keys = ioopm_hash_table_keys_array(ht, NULL);
+    for (size_t i = 0; i < 2; i++)
+    {
+        ioopm_str_t *copy = keys[i].p;
+        CU_ASSERT_EQUAL(strlen(copy->ptr), copy->len);
+        CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, keys[i]).value.i, copy->len == 5 ? 2 : 1);
+    }
+    free(keys);
+    ioopm_hash_table_destroy(ht);
+}
+
+static elem_t dup_key(elem_t key, void *calls)
+{
+    (*(int *) calls)++;
+    return ptr_elem(strdup(key.p));
+}
+
+void test_upsert(void)
+{
+    ioopm_hash_table_t *ht = ioopm_hash_table_create(hash_str, str_eq);
+    ht->should_free_keys = true;
+    int calls = 0;
+    bool inserted;
+
+    elem_t *slot = ioopm_hash_table_upsert(ht, ptr_elem("apple"), dup_key, &calls, &inserted);
+    CU_ASSERT_TRUE(inserted);
+    CU_ASSERT_EQUAL(slot->i, 0); // new values start zeroed
+    slot->i += 5;
+
+    // An existing key is neither materialised again nor changed
+    slot = ioopm_hash_table_upsert(ht, ptr_elem("apple"), dup_key, &calls, &inserted);
+    CU_ASSERT_FALSE(inserted);
+    CU_ASSERT_EQUAL(slot->i, 5);
+    CU_ASSERT_EQUAL(calls, 1);
+    CU_ASSERT_EQUAL(ioopm_hash_table_size(ht), 1);
+
+    CU_ASSERT_PTR_EQUAL(ioopm_hash_table_lookup_slot(ht, ptr_elem("apple")), slot);
+    CU_ASSERT_PTR_NULL(ioopm_hash_table_lookup_slot(ht, ptr_elem("pear")));
+
+    // insert_freq is an upsert that adds one
+    for (int i = 0; i < 3; i++) ioopm_hash_table_insert_freq(ht, ptr_elem(strdup("pear")));
+    CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, ptr_elem("pear")).value.i, 3);
+
+    ioopm_hash_table_destroy(ht);
+}
+
+static void count_mapped(elem_t key, elem_t *value, void *count)
+{
+    (void) key;
+    (void) value;
+    (*(int *) count)++;
+}
+
+void test_table_file(void)
+{
+    char path[] = "/tmp/unit_tests_table_XXXXXX";
+    int fd = mkstemp(path);
+    CU_ASSERT_TRUE(fd >= 0);
+    close(fd);
+
+    ioopm_hash_table_options_t opts = { .seeded_hash = hash_str_seeded, .hash_seed = { 42 } };
+    ioopm_hash_table_t *ht = ioopm_hash_table_create_with(NULL, str_eq, &opts);
+    char *words[] = { "apple", "pear", "a much longer key than the others", "" };
+    for (int i = 0; i < 4; i++) ioopm_hash_table_insert(ht, ptr_elem(words[i]), int_elem(i - 1));
+    CU_ASSERT_TRUE(ioopm_hash_table_save(ht, path, IOOPM_FILE_STR, IOOPM_FILE_INT));
+    ioopm_hash_table_destroy(ht);
+
+    ioopm_mapped_table_t *mt = ioopm_mapped_table_open(path);
+    CU_ASSERT_PTR_NOT_NULL(mt);
+    CU_ASSERT_EQUAL(ioopm_mapped_table_size(mt), 4);
+    for (int i = 0; i < 4; i++)
+    {
+        option_t found = ioopm_mapped_table_lookup(mt, ptr_elem(words[i]));
+        CU_ASSERT_TRUE(found.success);
+        CU_ASSERT_EQUAL(found.value.i, i - 1);
+    }
+    CU_ASSERT_FALSE(ioopm_mapped_table_lookup(mt, ptr_elem("appl")).success);
+    ioopm_mapped_table_close(mt);
+
+    // Int keys and string values, many more than the smallest file
+    ht = ioopm_hash_table_create(hash_int, int_eq);
+    char names[1000][8];
+    for (int i = 0; i < 1000; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "n%d", i);
+        ioopm_hash_table_insert(ht, int_elem(i * 7), ptr_elem(names[i]));
+    }
+    CU_ASSERT_TRUE(ioopm_hash_table_save(ht, path, IOOPM_FILE_INT, IOOPM_FILE_STR));
+    ioopm_hash_table_destroy(ht);
+
+    mt = ioopm_mapped_table_open(path);
+    CU_ASSERT_EQUAL(ioopm_mapped_table_size(mt), 1000);
+    CU_ASSERT_STRING_EQUAL(ioopm_mapped_table_lookup(mt, int_elem(7 * 999)).value.p, "n999");
+    CU_ASSERT_FALSE(ioopm_mapped_table_lookup(mt, int_elem(8)).success);
+
+    // Saving again replaces the file, the table mapped from the old one is left alone
+    ht = ioopm_hash_table_create(hash_int, int_eq);
+    ioopm_hash_table_insert(ht, int_elem(1), ptr_elem("one"));
+    CU_ASSERT_TRUE(ioopm_hash_table_save(ht, path, IOOPM_FILE_INT, IOOPM_FILE_STR));
+    ioopm_hash_table_destroy(ht);
+    CU_ASSERT_STRING_EQUAL(ioopm_mapped_table_lookup(mt, int_elem(7 * 999)).value.p, "n999");
+    ioopm_mapped_table_close(mt);
+    char tmp_path[sizeof(path) + 4];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    CU_ASSERT_EQUAL(access(tmp_path, F_OK), -1);
+    mt = ioopm_mapped_table_open(path);
+    CU_ASSERT_EQUAL(ioopm_mapped_table_size(mt), 1);
+    ioopm_mapped_table_close(mt);
+
+    // A damaged file: every slot full, every string key outside the heap. Lookups end and
+    // miss, apply_to_all skips everything. Slots follow the 72 byte header, 24 bytes each.
+    ht = ioopm_hash_table_create(hash_str, str_eq);
+    for (int i = 0; i < 4; i++) ioopm_hash_table_insert(ht, ptr_elem(words[i]), int_elem(i));
+    CU_ASSERT_TRUE(ioopm_hash_table_save(ht, path, IOOPM_FILE_STR, IOOPM_FILE_INT));
+    ioopm_hash_table_destroy(ht);
+    FILE *f = fopen(path, "r+b");
+    for (long i = 0; i < 8; i++)
+    {
+        uint64_t slot[3];
+        fseek(f, 72 + i * (long) sizeof(slot), SEEK_SET);
+        CU_ASSERT_EQUAL(fread(slot, sizeof(slot), 1, f), 1);
+        if (slot[0] == 0) slot[0] = 1;
+        slot[1] = (uint64_t) 1 << 40;
+        fseek(f, 72 + i * (long) sizeof(slot), SEEK_SET);
+        fwrite(slot, sizeof(slot), 1, f);
+    }
+    fclose(f);
+    mt = ioopm_mapped_table_open(path);
+    CU_ASSERT_PTR_NOT_NULL(mt);
+    CU_ASSERT_FALSE(ioopm_mapped_table_lookup(mt, ptr_elem("apple")).success);
+    CU_ASSERT_FALSE(ioopm_mapped_table_lookup(mt, ptr_elem("appl")).success);
+    int visited = 0;
+    ioopm_mapped_table_apply_to_all(mt, count_mapped, &visited);
+    CU_ASSERT_EQUAL(visited, 0);
+    ioopm_mapped_table_close(mt);
+
+    // Anything else is refused
+    f = fopen(path, "w");
+    fputs("not a table, just some text that is long enough to hold a header", f);
+    fclose(f);
+    CU_ASSERT_PTR_NULL(ioopm_mapped_table_open(path));
+    unlink(path);
+    CU_ASSERT_PTR_NULL(ioopm_mapped_table_open(path));
+}
+
+void test_stats(void)
+{
+    ioopm_hash_backend_t backends[] = { IOOPM_HT_CHAINED, IOOPM_HT_ROBIN_HOOD, IOOPM_HT_SWISS, IOOPM_HT_ORDERED };
+
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++)
+    {
+        ioopm_hash_table_options_t opts = { .backend = backends[b] };
+        ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_int, int_eq, &opts);
+        for (int i = 0; i < 1000; i++) ioopm_hash_table_insert(ht, int_elem(i), int_elem(i));
+        for (int i = 0; i < 2000; i++) ioopm_hash_table_lookup(ht, int_elem(i));
+
+        ioopm_hash_table_stats_t stats;
+        ioopm_hash_table_stats(ht, &stats);
+        CU_ASSERT_EQUAL(stats.size, 1000);
+        CU_ASSERT_EQUAL(stats.no_buckets, ht->no_buckets);
+        CU_ASSERT_TRUE(stats.load_factor > 0 && stats.load_factor <= 0.95f);
+        CU_ASSERT_TRUE(stats.max_chain >= 1);
+
+        // Chained counts buckets, open addressing counts entries
+        size_t total = 0, weighted = 0;
+        for (size_t i = 0; i < Stats_Histogram_Size; i++)
+        {
+            total += stats.histogram[i];
+            weighted += i * stats.histogram[i];
+        }
+        if (backends[b] == IOOPM_HT_CHAINED)
+        {
+            CU_ASSERT_EQUAL(total, stats.no_buckets);
+            if (stats.max_chain < Stats_Histogram_Size) CU_ASSERT_EQUAL(weighted, 1000);
+        }
+        else
+        {
+            CU_ASSERT_EQUAL(total, 1000);
+        }
+
+#ifdef IOOPM_HT_STATS
+        CU_ASSERT_TRUE(stats.counting);
+        CU_ASSERT_EQUAL(stats.counters.hits, 1000);
+        CU_ASSERT_EQUAL(stats.counters.misses, 2000); // the inserts, then the missing half
+        CU_ASSERT_TRUE(stats.counters.eq_calls >= 1000);
+        CU_ASSERT_TRUE(stats.counters.resizes > 0);
+#else
+        CU_ASSERT_FALSE(stats.counting);
+        CU_ASSERT_EQUAL(stats.counters.hits, 0);
+#endif
+        ioopm_hash_table_destroy(ht);
+    }
+}
+
+static void double_value(elem_t key, elem_t *value, void *arg)
+{
+    (void) key;
+    (void) arg;
+    value->i *= 2;
+}
+
+static bool value_at_least(elem_t key, elem_t value, void *min)
+{
+    (void) key;
+    return value.i >= *(int *) min;
+}
+
+static bool value_is(elem_t key, elem_t value, void *wanted)
+{
+    (void) key;
+    return value.i == *(int *) wanted;
+}
+
+static elem_t add_value(elem_t acc, elem_t key, elem_t value, void *arg)
+{
+    (void) key;
+    (void) arg;
+    return (elem_t) { .i = acc.i + value.i };
+}
+
+static elem_t add_partials(elem_t a, elem_t b, void *arg)
+{
+    (void) arg;
+    return (elem_t) { .i = a.i + b.i };
+}
+
+void test_parallel_traversal(void)
+{
+    ioopm_thread_pool_t *pool = ioopm_thread_pool_create(4);
+    CU_ASSERT_EQUAL(ioopm_thread_pool_size(pool), 4);
+
+    ioopm_hash_table_options_t opts = { .incremental_resize = true }; // parallel walks finish a migration first
+    ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_int, int_eq, &opts);
+    for (int i = 1; i <= 20000; i++) ioopm_hash_table_insert(ht, int_elem(i), int_elem(i));
+
+    ioopm_hash_table_apply_to_all_parallel(ht, pool, double_value, NULL);
+    CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, int_elem(777)).value.i, 1554);
+
+    // Sum of 2i for i in 1..20000, with and without a pool
+    elem_t sum = ioopm_hash_table_reduce_parallel(ht, pool, add_value, add_partials, int_elem(0), NULL);
+    CU_ASSERT_EQUAL(sum.i, 20000 * 20001);
+    CU_ASSERT_EQUAL(ioopm_hash_table_reduce_parallel(ht, NULL, add_value, add_partials, int_elem(0), NULL).i, 20000 * 20001);
+
+    int two = 2, three = 3, odd = 39999, big = 40000;
+    CU_ASSERT_TRUE(ioopm_hash_table_all_parallel(ht, pool, value_at_least, &two));
+    CU_ASSERT_FALSE(ioopm_hash_table_all_parallel(ht, pool, value_at_least, &three));
+    CU_ASSERT_TRUE(ioopm_hash_table_any_parallel(ht, pool, value_is, &big));
+    CU_ASSERT_FALSE(ioopm_hash_table_any_parallel(ht, pool, value_is, &odd));
+    CU_ASSERT_TRUE(ioopm_hash_table_any_parallel(ht, NULL, value_is, &big));
+
+    ioopm_hash_table_clear(ht);
+    CU_ASSERT_EQUAL(ioopm_hash_table_reduce_parallel(ht, pool, add_value, add_partials, int_elem(5), NULL).i, 5);
+    CU_ASSERT_TRUE(ioopm_hash_table_all_parallel(ht, pool, value_at_least, &three));
+
+    ioopm_hash_table_destroy(ht);
+    ioopm_thread_pool_destroy(pool);
+}
+
+static uint64_t same_hash(elem_t key)
+{
+    (void) key;
+    return 42;
+}
+
+/// Identity, except that 1000 collides with 7
+static uint64_t one_collision(elem_t key)
+{
+    return key.i == 1000 ? 7 : key.u;
+}
+
+void test_frozen_table(void)
+{
+    // String keys, in a table that has grown and shrunk
+    ioopm_hash_table_t *ht = ioopm_hash_table_create(hash_str, str_eq);
+    ht->should_free_keys = true;
+    char buf[32];
+    for (int i = 0; i < 10000; i++)
+    {
+        snprintf(buf, sizeof(buf), "word%d", i);
+        ioopm_hash_table_insert(ht, ptr_elem(strdup(buf)), int_elem(i));
+    }
+    for (int i = 5000; i < 10000; i++)
+    {
+        snprintf(buf, sizeof(buf), "word%d", i);
+        ioopm_hash_table_remove(ht, ptr_elem(buf));
+    }
+
+    ioopm_frozen_table_t *ft = ioopm_hash_table_freeze(ht);
+    CU_ASSERT_PTR_NOT_NULL(ft);
+    CU_ASSERT_EQUAL(ioopm_frozen_table_size(ft), 5000);
+    for (int i = 0; i < 10000; i++)
+    {
+        snprintf(buf, sizeof(buf), "word%d", i);
+        option_t found = ioopm_frozen_table_lookup(ft, ptr_elem(buf));
+        CU_ASSERT_EQUAL(found.success, i < 5000);
+        if (i < 5000) CU_ASSERT_EQUAL(found.value.i, i);
+    }
+    ioopm_frozen_table_destroy(ft);
+    ioopm_hash_table_destroy(ht); // the keys were only borrowed
+
+    // Int keys with the identity hash, and the tiny cases
+    ht = ioopm_hash_table_create(hash_int, int_eq);
+    ft = ioopm_hash_table_freeze(ht);
+    CU_ASSERT_FALSE(ioopm_frozen_table_has_key(ft, int_elem(0)));
+    ioopm_frozen_table_destroy(ft);
+    for (int n = 1; n <= 1000; n *= 10)
+    {
+        for (int i = 0; i < n; i++) ioopm_hash_table_insert(ht, int_elem(i * 3), int_elem(i));
+        ft = ioopm_hash_table_freeze(ht);
+        for (int i = 0; i < 3 * n; i++) CU_ASSERT_EQUAL(ioopm_frozen_table_has_key(ft, int_elem(i)), i % 3 == 0);
+        ioopm_frozen_table_destroy(ft);
+    }
+    ioopm_hash_table_destroy(ht);
+
+    // Keys with the same full hash can not be separated
+    ht = ioopm_hash_table_create(same_hash, int_eq);
+    ioopm_hash_table_insert(ht, int_elem(1), int_elem(1));
+    ioopm_hash_table_insert(ht, int_elem(2), int_elem(2));
+    CU_ASSERT_PTR_NULL(ioopm_hash_table_freeze(ht));
+    ioopm_hash_table_destroy(ht);
+
+    // One colliding pair among many keys is found before any displacement is tried
+    ht = ioopm_hash_table_create(one_collision, int_eq);
+    for (int i = 1; i <= 1000; i++) ioopm_hash_table_insert(ht, int_elem(i), int_elem(i));
+    clock_t started = clock();
+    CU_ASSERT_PTR_NULL(ioopm_hash_table_freeze(ht));
+    CU_ASSERT_TRUE(clock() - started < CLOCKS_PER_SEC / 10);
+    ioopm_hash_table_remove(ht, int_elem(1000));
+    ft = ioopm_hash_table_freeze(ht);
+    CU_ASSERT_PTR_NOT_NULL(ft);
+    ioopm_frozen_table_destroy(ft);
+    ioopm_hash_table_destroy(ht);
+}
+
+/// Two generated tables: unboxed int keys, and string keys with a macro for eq
+#define hash_small_int(i) ((uint64_t) (unsigned) (i))
+#define small_int_eq(a, b) ((a) == (b))
+IOOPM_DEFINE_HASH_TABLE(int_table, int, long, hash_small_int, small_int_eq)
+
+#define hash_chars(s) hash_bytes((s), strlen(s), 0)
+#define chars_eq(a, b) (strcmp((a), (b)) == 0)
+IOOPM_DEFINE_HASH_TABLE(name_table, const char *, int, hash_chars, chars_eq)
+
+static void sum_values(int key, long *value, void *arg)
+{
+    (void) key;
+    *(long *) arg += *value;
+}
+
+void test_hash_table_template(void)
+{
+    int_table_t *t = int_table_create(0);
+    for (int i = 0; i < 5000; i++) int_table_insert(t, i * 3, i);
+    int_table_insert(t, 0, -1); // overwrite
+    CU_ASSERT_EQUAL(int_table_size(t), 5000);
+
+    long value = 0;
+    CU_ASSERT_TRUE(int_table_lookup(t, 0, &value));
+    CU_ASSERT_EQUAL(value, -1);
+    CU_ASSERT_FALSE(int_table_lookup(t, 1, &value));
+    CU_ASSERT_EQUAL(*int_table_find(t, 300), 100);
+
+    bool inserted;
+    (*int_table_upsert(t, 7, &inserted))++;
+    CU_ASSERT_TRUE(inserted);
+    (*int_table_upsert(t, 7, &inserted))++;
+    CU_ASSERT_FALSE(inserted);
+    CU_ASSERT_EQUAL(*int_table_find(t, 7), 2);
+
+    // Remove most keys: every remaining one is still found after the backward shifts and shrinks
+    int removed_key;
+    CU_ASSERT_TRUE(int_table_remove(t, 7, &removed_key, &value));
+    CU_ASSERT_EQUAL(removed_key, 7);
+    CU_ASSERT_EQUAL(value, 2);
+    for (int i = 0; i < 5000; i++) {
+        if (i % 10 != 0) CU_ASSERT_TRUE(int_table_remove(t, i * 3, NULL, NULL));
+    }
+    CU_ASSERT_FALSE(int_table_remove(t, 3, NULL, NULL));
+    CU_ASSERT_EQUAL(int_table_size(t), 500);
+    CU_ASSERT_EQUAL(t->no_slots, 2048); // shrunk from 8192, 500 entries are above 3/16 of 2048
+    for (int i = 10; i < 5000; i += 10) CU_ASSERT_EQUAL(*int_table_find(t, i * 3), i);
+
+    long sum = 0;
+    int_table_apply_to_all(t, sum_values, &sum);
+    CU_ASSERT_EQUAL(sum, -1 + 10L * (0 + 499) * 500 / 2);
+
+    int_table_clear(t);
+    CU_ASSERT_EQUAL(int_table_size(t), 0);
+    CU_ASSERT_PTR_NULL(int_table_find(t, 30));
+    int_table_destroy(t);
+
+    // Keys are compared with eq, not by pointer
+    name_table_t *names = name_table_create(100);
+    char buf[16];
+    for (int i = 0; i < 100; i++) {
+        sprintf(buf, "name%d", i);
+        name_table_insert(names, strdup(buf), i);
+    }
+    size_t slots = names->no_slots;
+    CU_ASSERT_EQUAL(*name_table_find(names, "name42"), 42);
+    const char *key = NULL;
+    CU_ASSERT_TRUE(name_table_remove(names, "name42", &key, NULL));
+    CU_ASSERT_STRING_EQUAL(key, "name42");
+    free((char *) key);
+    CU_ASSERT_EQUAL(names->no_slots, slots); // sized for the capacity hint up front
+    for (int i = 0; i < 100; i++) {
+        sprintf(buf, "name%d", i);
+        if (name_table_remove(names, buf, &key, NULL)) free((char *) key);
+    }
+    CU_ASSERT_EQUAL(name_table_size(names), 0);
+    name_table_destroy(names);
+}
+
+void test_key_filter(void)
+{
+    ioopm_hash_backend_t backends[] = { IOOPM_HT_CHAINED, IOOPM_HT_ROBIN_HOOD, IOOPM_HT_SWISS, IOOPM_HT_ORDERED };
+
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++)
+    {
+        for (int incremental = 0; incremental <= 1; incremental++)
+        {
+            ioopm_hash_table_options_t opts = { .backend = backends[b], .key_filter = true,
+                                                .incremental_resize = incremental };
+            ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_int, int_eq, &opts);
+            for (int i = 0; i < 3000; i++) ioopm_hash_table_insert(ht, int_elem(i * 2), int_elem(i));
+
+            // Never a false negative, whatever resizes happened on the way
+            for (int i = 0; i < 3000; i++) CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, int_elem(i * 2)).value.i, i);
+            for (int i = 0; i < 3000; i++) CU_ASSERT_FALSE(ioopm_hash_table_has_key(ht, int_elem(i * 2 + 1)));
+
+            ioopm_hash_table_stats_t stats;
+            ioopm_hash_table_stats(ht, &stats);
+            CU_ASSERT_TRUE(stats.filtered);
+            CU_ASSERT_TRUE(stats.filter_bytes > 0);
+            CU_ASSERT_TRUE(stats.filter_fp_estimate > 0 && stats.filter_fp_estimate < 0.05);
+    #ifdef IOOPM_HT_STATS
+            // Most misses were answered by the filter alone: 3000 from the inserts, 3000 above
+            CU_ASSERT_TRUE(stats.counters.filter_rejects > 5400);
+            CU_ASSERT_EQUAL(stats.counters.filter_rejects + stats.counters.filter_false_positives, 6000);
+    #endif
+
+            // Removes leave stale bits until a rebuild, keys that stay are still found
+            for (int i = 0; i < 3000; i++) {
+                if (i % 4 != 0) ioopm_hash_table_remove(ht, int_elem(i * 2));
+            }
+            CU_ASSERT_TRUE(ht->filter_stale <= ht->size / 2 + 32);
+            for (int i = 0; i < 3000; i++) {
+                CU_ASSERT_EQUAL(ioopm_hash_table_has_key(ht, int_elem(i * 2)), i % 4 == 0);
+            }
+            ioopm_hash_table_remove(ht, int_elem(1)); // never there
+
+            ioopm_hash_table_clear(ht);
+            CU_ASSERT_FALSE(ioopm_hash_table_has_key(ht, int_elem(0)));
+            ioopm_hash_table_insert(ht, int_elem(0), int_elem(7));
+            CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, int_elem(0)).value.i, 7);
+            ioopm_hash_table_destroy(ht);
+        }
+    }
+
+    // Tables without a filter report none
+    ioopm_hash_table_t *ht = ioopm_hash_table_create(hash_int, int_eq);
+    ioopm_hash_table_stats_t stats;
+    ioopm_hash_table_stats(ht, &stats);
+    CU_ASSERT_FALSE(stats.filtered);
+    ioopm_hash_table_destroy(ht);
+}
+
+void test_value_index(void)
+{
+    ioopm_hash_backend_t backends[] = { IOOPM_HT_CHAINED, IOOPM_HT_ROBIN_HOOD, IOOPM_HT_SWISS, IOOPM_HT_ORDERED };
+
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++)
+    {
+        ioopm_hash_table_options_t opts = { .backend = backends[b], .value_index = true,
+                                            .value_hash = hash_int, .value_eq = int_eq };
+        ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_int, int_eq, &opts);
+        for (int i = 0; i < 1000; i++) ioopm_hash_table_insert(ht, int_elem(i), int_elem(i % 10));
+
+        ioopm_list_t *keys = ioopm_hash_table_keys_for_value(ht, int_elem(3));
+        CU_ASSERT_EQUAL(ioopm_linked_list_size(keys), 100);
+        CU_ASSERT_TRUE(ioopm_linked_list_contains(keys, int_elem(993)));
+        CU_ASSERT_FALSE(ioopm_linked_list_contains(keys, int_elem(994)));
+        ioopm_linked_list_destroy(keys);
+        CU_ASSERT_PTR_NULL(ioopm_hash_table_keys_for_value(ht, int_elem(10)));
+#ifdef IOOPM_HT_STATS
+        size_t hits = ht->counters.hits;
+        ioopm_hash_table_remove(ht, int_elem(5)); // one find, the index gets the removed value
+        CU_ASSERT_EQUAL(ht->counters.hits, hits + 1);
+        keys = ioopm_hash_table_keys_for_value(ht, int_elem(5));
+        CU_ASSERT_EQUAL(ioopm_linked_list_size(keys), 99);
+        CU_ASSERT_FALSE(ioopm_linked_list_contains(keys, int_elem(5)));
+        ioopm_linked_list_destroy(keys);
+#endif
+
+        // Updates and removes move keys between the sets
+        for (int i = 3; i < 1000; i += 10) ioopm_hash_table_insert(ht, int_elem(i), int_elem(42));
+        for (int i = 0; i < 1000; i += 10) ioopm_hash_table_remove(ht, int_elem(i));
+        CU_ASSERT_FALSE(ioopm_hash_table_has_value(ht, int_elem(3)));
+        CU_ASSERT_FALSE(ioopm_hash_table_has_value(ht, int_elem(0)));
+        CU_ASSERT_TRUE(ioopm_hash_table_has_value(ht, int_elem(42)));
+        keys = ioopm_hash_table_keys_for_value(ht, int_elem(42));
+        CU_ASSERT_EQUAL(ioopm_linked_list_size(keys), 100);
+        ioopm_linked_list_destroy(keys);
+
+        // apply_to_all writes behind the index's back, the next query catches up
+        ioopm_hash_table_apply_to_all(ht, double_value, NULL);
+        CU_ASSERT_FALSE(ioopm_hash_table_has_value(ht, int_elem(42)));
+        keys = ioopm_hash_table_keys_for_value(ht, int_elem(84));
+        CU_ASSERT_EQUAL(ioopm_linked_list_size(keys), 100);
+        ioopm_linked_list_destroy(keys);
+        ioopm_hash_table_lookup_slot(ht, int_elem(1))->i = 84;
+        keys = ioopm_hash_table_keys_for_value(ht, int_elem(84));
+        CU_ASSERT_EQUAL(ioopm_linked_list_size(keys), 101);
+        ioopm_linked_list_destroy(keys);
+
+        ioopm_hash_table_clear(ht);
+        CU_ASSERT_FALSE(ioopm_hash_table_has_value(ht, int_elem(84)));
+        ioopm_hash_table_insert(ht, int_elem(1), int_elem(5));
+        CU_ASSERT_TRUE(ioopm_hash_table_has_value(ht, int_elem(5)));
+        ioopm_hash_table_destroy(ht);
+    }
+
+    // Which words have count N, with keys the table frees and with copied keys
+    for (int copy = 0; copy <= 1; copy++)
+    {
+        ioopm_hash_table_options_t opts = { .value_index = true, .value_hash = hash_int, .value_eq = int_eq,
+                                            .copy_keys = copy ? IOOPM_KEYS_COPY_STR : IOOPM_KEYS_SHARED };
+        ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_str, str_eq, &opts);
+        ht->should_free_keys = true;
+        char *words[] = { "the", "cat", "the", "hat", "the", "cat" };
+        for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++)
+        {
+            char buf[8];
+            strcpy(buf, words[i]);
+            ioopm_hash_table_insert_freq(ht, copy ? ptr_elem(buf) : ptr_elem(strdup(buf)));
+        }
+
+        ioopm_list_t *once = ioopm_hash_table_keys_for_value(ht, int_elem(1));
+        CU_ASSERT_EQUAL(ioopm_linked_list_size(once), 1);
+        CU_ASSERT_STRING_EQUAL(ioopm_linked_list_get(once, 0).p, "hat");
+        ioopm_linked_list_destroy(once);
+        CU_ASSERT_TRUE(ioopm_hash_table_has_value(ht, int_elem(3)));
+        CU_ASSERT_FALSE(ioopm_hash_table_has_value(ht, int_elem(4)));
+
+        ioopm_hash_table_remove(ht, ptr_elem("the"));
+        CU_ASSERT_FALSE(ioopm_hash_table_has_value(ht, int_elem(3)));
+        ioopm_hash_table_destroy(ht);
+    }
+
+    // Without an index keys_for_value walks the table
+    ioopm_hash_table_t *ht = ioopm_hash_table_create(hash_int, int_eq);
+    for (int i = 0; i < 20; i++) ioopm_hash_table_insert(ht, int_elem(i), int_elem(i % 2));
+    ioopm_list_t *odd = ioopm_hash_table_keys_for_value(ht, int_elem(1));
+    CU_ASSERT_EQUAL(ioopm_linked_list_size(odd), 10);
+    ioopm_linked_list_destroy(odd);
+    CU_ASSERT_PTR_NULL(ioopm_hash_table_keys_for_value(ht, int_elem(2)));
+    ioopm_hash_table_destroy(ht);
+}
+
+static bool key_is_odd(elem_t key, elem_t value, void *arg)
+{
+    (void) value;
+    (void) arg;
+    return key.i % 2 != 0;
+}
+
+static bool key_is_odd_value(elem_t key, elem_t value, void *arg)
+{
+    (void) key;
+    (void) arg;
+    return value.i % 2 != 0;
+}
+
+static void sum_taken(elem_t key, elem_t value, void *sum)
+{
+    *(long *) sum += key.i + value.i;
+}
+
+static void free_taken_key(elem_t key, elem_t value, void *count)
+{
+    (void) value;
+    free(key.p);
+    (*(int *) count)++;
+}
+
+void test_remove_if_and_drain(void)
+{
+    ioopm_hash_backend_t backends[] = { IOOPM_HT_CHAINED, IOOPM_HT_ROBIN_HOOD, IOOPM_HT_SWISS, IOOPM_HT_ORDERED };
+
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++)
+    {
+        for (int incremental = 0; incremental <= 1; incremental++)
+        {
+            ioopm_hash_table_options_t opts = { .backend = backends[b], .incremental_resize = incremental,
+                                                .key_filter = true };
+            ioopm_hash_table_t *ht = ioopm_hash_table_create_with(hash_int, int_eq, &opts);
+            for (int i = 0; i < 5000; i++) ioopm_hash_table_insert(ht, int_elem(i), int_elem(i));
+
+            // Every odd key goes, each handed over exactly once
+            long sum = 0;
+            CU_ASSERT_EQUAL(ioopm_hash_table_remove_if(ht, key_is_odd, sum_taken, &sum), 2500);
+            CU_ASSERT_EQUAL(sum, 2 * 2500L * 2500);
+            CU_ASSERT_EQUAL(ioopm_hash_table_size(ht), 2500);
+            for (int i = 0; i < 5000; i++) CU_ASSERT_EQUAL(ioopm_hash_table_has_key(ht, int_elem(i)), i % 2 == 0);
+            CU_ASSERT_EQUAL(ioopm_hash_table_remove_if(ht, key_is_odd, NULL, NULL), 0);
+
+            sum = 0;
+            ioopm_hash_table_drain(ht, sum_taken, &sum);
+            CU_ASSERT_EQUAL(sum, 2 * 2499L * 2500);
+            CU_ASSERT_TRUE(ioopm_hash_table_is_empty(ht));
+            CU_ASSERT_EQUAL(ht->no_buckets, ht->min_buckets);
+
+            ioopm_hash_table_insert(ht, int_elem(1), int_elem(2));
+            CU_ASSERT_EQUAL(ioopm_hash_table_lookup(ht, int_elem(1)).value.i, 2);
+            ioopm_hash_table_destroy(ht);
+        }
+    }
+
+    // Without taken the table frees the keys it owns, with it they go to the caller
+    ioopm_hash_table_t *ht = ioopm_hash_table_create(hash_str, str_eq);
+    ht->should_free_keys = true;
+    char name[16];
+    for (int i = 0; i < 100; i++)
+    {
+        snprintf(name, sizeof(name), "key %d", i);
+        ioopm_hash_table_insert(ht, ptr_elem(strdup(name)), int_elem(i));
+    }
+    CU_ASSERT_EQUAL(ioopm_hash_table_remove_if(ht, key_is_odd_value, NULL, NULL), 50);
+    int freed = 0;
+    ioopm_hash_table_drain(ht, free_taken_key, &freed);
+    CU_ASSERT_EQUAL(freed, 50);
+    ioopm_hash_table_destroy(ht);
+
+    // A value index follows the entries removed
+    ioopm_hash_table_options_t opts = { .copy_keys = IOOPM_KEYS_COPY_STR, .value_index = true,
+                                        .value_hash = hash_int, .value_eq = int_eq };
+    ht = ioopm_hash_table_create_with(hash_str, str_eq, &opts);
+    for (int i = 0; i < 100; i++)
+    {
+        snprintf(name, sizeof(name), "key %d", i);
+        ioopm_hash_table_insert(ht, ptr_elem(name), int_elem(i % 4));
+    }
+    CU_ASSERT_EQUAL(ioopm_hash_table_remove_if(ht, key_is_odd_value, NULL, NULL), 50);
+    CU_ASSERT_FALSE(ioopm_hash_table_has_value(ht, int_elem(1)));
+    CU_ASSERT_TRUE(ioopm_hash_table_has_value(ht, int_elem(2)));
+    ioopm_hash_table_drain(ht, NULL, NULL);
+    CU_ASSERT_FALSE(ioopm_hash_table_has_value(ht, int_elem(2)));
+    ioopm_hash_table_destroy(ht);
+}
+
+static elem_t add_values(elem_t a, elem_t b, void *arg)
+{
+    (void) arg;
+    return int_elem(a.i + b.i);
+}
+
+void test_merge(void)
+{
+    ioopm_slab_t *slab = ioopm_slab_create(sizeof(entry_t));
+    ioopm_hash_table_options_t kinds[] = {
+        { .backend = IOOPM_HT_CHAINED },
+        { .backend = IOOPM_HT_CHAINED, .pooled_entries = true },
+        { .backend = IOOPM_HT_CHAINED, .entry_slab = slab },
+        { .backend = IOOPM_HT_CHAINED, .seeded_hash = hash_int_seeded, .hash_seed = { 7 }, .incremental_resize = true },
+        { .backend = IOOPM_HT_ROBIN_HOOD, .key_filter = true },
+        { .backend = IOOPM_HT_SWISS },
+        { .backend = IOOPM_HT_ORDERED, .value_index = true, .value_hash = hash_int, .value_eq = int_eq },
+    };
+    size_t no_kinds = sizeof(kinds) / sizeof(kinds[0]);
+
+    for (size_t d = 0; d < no_kinds; d++)
+    {
+        for (size_t s = 0; s < no_kinds; s++)
+        {
+            ioopm_hash_table_t *dst = ioopm_hash_table_create_with(hash_int, int_eq, &kinds[d]);
+            ioopm_hash_table_t *src = ioopm_hash_table_create_with(hash_int, int_eq, &kinds[s]);
+            for (int i = 0; i < 2000; i++) ioopm_hash_table_insert(dst, int_elem(i), int_elem(1));
+            for (int i = 1000; i < 3000; i++) ioopm_hash_table_insert(src, int_elem(i), int_elem(2));
+
+            ioopm_hash_table_merge(dst, src, add_values, NULL);
+            CU_ASSERT_TRUE(ioopm_hash_table_is_empty(src));
+            CU_ASSERT_EQUAL(ioopm_hash_table_size(dst), 3000);
+            for (int i = 0; i < 3000; i++)
+            {
+                int expected = (i < 2000 ? 1 : 0) + (i >= 1000 ? 2 : 0);
+                CU_ASSERT_EQUAL(ioopm_hash_table_lookup(dst, int_elem(i)).value.i, expected);
+            }
+            CU_ASSERT_FALSE(ioopm_hash_table_has_key(dst, int_elem(3000)));
+            if (dst->value_index != NULL)
+            {
+                ioopm_list_t *both = ioopm_hash_table_keys_for_value(dst, int_elem(3));
+                CU_ASSERT_EQUAL(ioopm_linked_list_size(both), 1000);
+                ioopm_linked_list_destroy(both);
+            }
+
+            // src is still usable
+            ioopm_hash_table_insert(src, int_elem(5), int_elem(5));
+            CU_ASSERT_EQUAL(ioopm_hash_table_lookup(src, int_elem(5)).value.i, 5);
+            ioopm_hash_table_destroy(src);
+            ioopm_hash_table_destroy(dst);
+        }
+    }
+    CU_ASSERT_EQUAL(ioopm_slab_in_use(slab), 0);
+    ioopm_slab_destroy(slab);
+
+    // Pooled tables: the entries move into dst's slab with the rest of src's memory
+    ioopm_hash_table_options_t pooled = { .pooled_entries = true, .copy_keys = IOOPM_KEYS_COPY_STR };
+    ioopm_hash_table_t *dst = ioopm_hash_table_create_with(hash_str, str_eq, &pooled);
+    ioopm_hash_table_t *src = ioopm_hash_table_create_with(hash_str, str_eq, &pooled);
+    ioopm_hash_table_insert(dst, ptr_elem("the"), int_elem(1));
+    ioopm_hash_table_insert(src, ptr_elem("the"), int_elem(2));
+    ioopm_hash_table_insert(src, ptr_elem("a rather long word, copied to the heap"), int_elem(1));
+    size_t misses_before = dst->counters.misses + src->counters.misses;
+    ioopm_hash_table_merge(dst, src, add_values, NULL);
+#ifdef IOOPM_HT_STATS
+    // The counting src did shows up in dst's stats, plus the merge's own lookups
+    CU_ASSERT_EQUAL(misses_before, 3);
+    CU_ASSERT_EQUAL(dst->counters.misses, misses_before + 1);
+    CU_ASSERT_EQUAL(dst->counters.hits, 1);
+    CU_ASSERT_EQUAL(src->counters.misses, 0);
+#else
+    (void) misses_before;
+#endif
+    CU_ASSERT_EQUAL(ioopm_slab_in_use(dst->entry_slab), 2);
+    CU_ASSERT_EQUAL(ioopm_slab_in_use(src->entry_slab), 0);
+    ioopm_hash_table_destroy(src);
+    CU_ASSERT_EQUAL(ioopm_hash_table_lookup(dst, ptr_elem("the")).value.i, 3);
+    CU_ASSERT_EQUAL(ioopm_hash_table_lookup(dst, ptr_elem("a rather long word, copied to the heap")).value.i, 1);
+    ioopm_hash_table_destroy(dst);
+
+    // Shared keys move over, the duplicates src owned are freed
+    dst = ioopm_hash_table_create_with(hash_str, str_eq, &(ioopm_hash_table_options_t) { .backend = IOOPM_HT_SWISS });
+    src = ioopm_hash_table_create(hash_str, str_eq);
+    dst->should_free_keys = src->should_free_keys = true;
+    ioopm_hash_table_insert(dst, ptr_elem(strdup("cat")), int_elem(1));
+    ioopm_hash_table_insert(src, ptr_elem(strdup("cat")), int_elem(1));
+    ioopm_hash_table_insert(src, ptr_elem(strdup("hat")), int_elem(1));
+    ioopm_hash_table_merge(dst, src, add_values, NULL);
+    ioopm_hash_table_destroy(src);
+    CU_ASSERT_EQUAL(ioopm_hash_table_lookup(dst, ptr_elem("cat")).value.i, 2);
+    CU_ASSERT_EQUAL(ioopm_hash_table_lookup(dst, ptr_elem("hat")).value.i, 1);
+    ioopm_hash_table_destroy(dst);
+}
+
+void test_intern_pool(void)
+{
+    ioopm_intern_pool_t *pool = ioopm_intern_pool_create();
+    char buf[] = "shelf A1";
+
+    const char *a = ioopm_intern(pool, buf);
+    const char *b = ioopm_intern(pool, "shelf A1");
+    CU_ASSERT_PTR_EQUAL(a, b); // one copy, equality is a pointer compare
+    CU_ASSERT_PTR_NOT_EQUAL(a, buf);
+    CU_ASSERT_EQUAL(ioopm_intern_count(pool), 1);
+    CU_ASSERT_PTR_EQUAL(ioopm_intern_find(pool, "shelf A1"), a);
+    CU_ASSERT_TRUE(str_eq(ptr_elem((char *) a), ptr_elem((char *) b)));
+
+    ioopm_intern_release(pool, a);
+    CU_ASSERT_PTR_EQUAL(ioopm_intern_find(pool, "shelf A1"), b); // one reference left
+    ioopm_intern_release(pool, b);
+    CU_ASSERT_PTR_NULL(ioopm_intern_find(pool, "shelf A1"));
+    CU_ASSERT_EQUAL(ioopm_intern_count(pool), 0);
+
+    ioopm_intern(pool, "left for destroy");
+    ioopm_intern_pool_destroy(pool);
+}
+
+#define Counting_Threads 4
+#define Counting_Words 500
+#define Counting_Rounds 4
+
+static void *count_words(void *arg)
+{
+    ioopm_concurrent_hash_table_t *ht = arg;
+    char buf[16];
+    for (int i = 0; i < Counting_Words * Counting_Rounds; i++) {
+        snprintf(buf, sizeof(buf), "word%d", i % Counting_Words);
+        ioopm_concurrent_hash_table_increment(ht, ptr_elem(strdup(buf)), 1);
+    }
+    return NULL;
+}
+
+void test_concurrent_counting(void)
+{
+    ioopm_concurrent_hash_table_t *ht = ioopm_concurrent_hash_table_create(hash_str, str_eq, NULL);
+    ht->should_free_keys = true;
+
+    pthread_t threads[Counting_Threads];
+    for (int i = 0; i < Counting_Threads; i++) pthread_create(&threads[i], NULL, count_words, ht);
+    for (int i = 0; i < Counting_Threads; i++) pthread_join(threads[i], NULL);
+
+    // No increment was lost, even across the resizes the threads set off
+    CU_ASSERT_EQUAL(ioopm_concurrent_hash_table_size(ht), Counting_Words);
+    CU_ASSERT_TRUE(ht->buckets->no_buckets > Concurrent_Stripes);
+    for (int i = 0; i < Concurrent_Stripes; i++) CU_ASSERT_PTR_EQUAL(ht->stripes[i].buckets, ht->buckets);
+    CU_ASSERT_EQUAL(ioopm_concurrent_hash_table_lookup(ht, ptr_elem("word0")).value.i, Counting_Threads * Counting_Rounds);
+    CU_ASSERT_EQUAL(ioopm_concurrent_hash_table_lookup(ht, ptr_elem("word499")).value.i, Counting_Threads * Counting_Rounds);
+    CU_ASSERT_FALSE(ioopm_concurrent_hash_table_has_key(ht, ptr_elem("word500")));
+
+    option_t removed = ioopm_concurrent_hash_table_remove(ht, ptr_elem("word7"));
+    CU_ASSERT_TRUE(removed.success);
+    CU_ASSERT_EQUAL(removed.value.i, Counting_Threads * Counting_Rounds);
+    CU_ASSERT_EQUAL(ioopm_concurrent_hash_table_size(ht), Counting_Words - 1);
+
+    ioopm_concurrent_hash_table_insert(ht, ptr_elem(strdup("new")), int_elem(3));
+    CU_ASSERT_EQUAL(ioopm_concurrent_hash_table_increment(ht, ptr_elem(strdup("new")), 2), 5);
+    ioopm_concurrent_hash_table_destroy(ht);
+}
+
+#define Catalog_Size 1000
+
+typedef struct reader_args
+{
+    ioopm_concurrent_hash_table_t *ht;
+    bool *done;
+    int misses;
+} reader_args_t;
+
+static void *read_catalog(void *arg)
+{
+    reader_args_t *args = arg;
+    while (!__atomic_load_n(args->done, __ATOMIC_ACQUIRE)) {
+        for (int i = 0; i < Catalog_Size; i++) {
+            option_t found = ioopm_concurrent_hash_table_lookup(args->ht, int_elem(i));
+            if (!found.success || found.value.i != i * 3) args->misses++;
+        }
+    }
+    return NULL;
+}
+
+void test_concurrent_lock_free_reads(void)
+{
+    ioopm_concurrent_hash_table_t *ht = ioopm_concurrent_hash_table_create(hash_int, int_eq, NULL);
+    for (int i = 0; i < Catalog_Size; i++) ioopm_concurrent_hash_table_insert(ht, int_elem(i), int_elem(i * 3));
+
+    bool done = false;
+    reader_args_t args[Counting_Threads];
+    pthread_t threads[Counting_Threads];
+    for (int i = 0; i < Counting_Threads; i++) {
+        args[i] = (reader_args_t){ .ht = ht, .done = &done };
+        pthread_create(&threads[i], NULL, read_catalog, &args[i]);
+    }
+
+    // One writer grows the table, rewrites values and removes entries under the readers
+    for (int i = Catalog_Size; i < 20 * Catalog_Size; i++) {
+        ioopm_concurrent_hash_table_insert(ht, int_elem(i), int_elem(0));
+        ioopm_concurrent_hash_table_insert(ht, int_elem(i % Catalog_Size), int_elem(i % Catalog_Size * 3));
+        if (i % 2 == 0) ioopm_concurrent_hash_table_remove(ht, int_elem(i));
+    }
+    __atomic_store_n(&done, true, __ATOMIC_RELEASE);
+
+    for (int i = 0; i < Counting_Threads; i++) {
+        pthread_join(threads[i], NULL);
+        CU_ASSERT_EQUAL(args[i].misses, 0);
+    }
+    CU_ASSERT_EQUAL(ioopm_concurrent_hash_table_size(ht), Catalog_Size + 19 * Catalog_Size / 2);
+
+    // With no readers left everything retired can be freed
+    ioopm_epoch_reclaim(ht->epoch);
+    CU_ASSERT_EQUAL(ioopm_epoch_pending(ht->epoch), 0);
+    ioopm_concurrent_hash_table_destroy(ht);
+}
+
+#define Many_Tables 1100 // more than PTHREAD_KEYS_MAX, which a key per epoch domain ran out at
+
+static void *read_every_table(void *arg)
+{
+    ioopm_concurrent_hash_table_t **tables = arg;
+    int misses = 0;
+    for (int i = 0; i < Many_Tables; i++) {
+        if (tables[i] == NULL) continue;
+        if (ioopm_concurrent_hash_table_lookup(tables[i], int_elem(i)).value.i != i) misses++;
+    }
+    return (void *) (intptr_t) misses;
+}
+
+void test_concurrent_many_tables(void)
+{
+    ioopm_concurrent_hash_table_t **tables = calloc(Many_Tables, sizeof(ioopm_concurrent_hash_table_t *));
+    for (int i = 0; i < Many_Tables; i++) {
+        tables[i] = ioopm_concurrent_hash_table_create(hash_int, int_eq, NULL);
+        CU_ASSERT_PTR_NOT_NULL(tables[i]);
+        ioopm_concurrent_hash_table_insert(tables[i], int_elem(i), int_elem(i));
+    }
+
+    // Every thread enters every domain, then some domains go while the threads still hold records
+    pthread_t threads[Counting_Threads];
+    for (int t = 0; t < Counting_Threads; t++) pthread_create(&threads[t], NULL, read_every_table, tables);
+    for (int t = 0; t < Counting_Threads; t++) {
+        void *misses;
+        pthread_join(threads[t], &misses);
+        CU_ASSERT_EQUAL((intptr_t) misses, 0);
+    }
+    CU_ASSERT_EQUAL((intptr_t) read_every_table(tables), 0);
+
+    for (int i = 0; i < Many_Tables; i += 2) {
+        ioopm_concurrent_hash_table_destroy(tables[i]);
+        tables[i] = NULL;
+    }
+    // A new table may land where a destroyed one was, it must not get that one's records
+    for (int i = 0; i < Many_Tables; i += 4) {
+        tables[i] = ioopm_concurrent_hash_table_create(hash_int, int_eq, NULL);
+        ioopm_concurrent_hash_table_insert(tables[i], int_elem(i), int_elem(i));
+    }
+    CU_ASSERT_EQUAL((intptr_t) read_every_table(tables), 0);
+    for (int t = 0; t < Counting_Threads; t++) pthread_create(&threads[t], NULL, read_every_table, tables);
+    for (int t = 0; t < Counting_Threads; t++) pthread_join(threads[t], NULL);
+
+    for (int i = 0; i < Many_Tables; i++) ioopm_concurrent_hash_table_destroy(tables[i]);
+    free(tables);
+}
+
   int main()
   {
       if (CU_initialize_registry() != CUE_SUCCESS) return CU_get_error();
@@ -232,6 +1674,33 @@ void test_ioopm_hash_table_any(void) {
       CU_add_test(suite, "Test adding on same key", test_duplicate_keys); 
       CU_add_test(suite, "Has key and value test", test_has_key_and_value); 
       CU_add_test(suite, "Test any using greater than", test_ioopm_hash_table_any); 
+      CU_add_test(suite, "Table grows and shrinks", test_hash_grow_and_shrink);
+      CU_add_test(suite, "Create with capacity hint", test_hash_create_with_capacity);
+      CU_add_test(suite, "Robin Hood backend", test_robin_hood_backend);
+      CU_add_test(suite, "Swiss table backend", test_swiss_backend);
+      CU_add_test(suite, "Insertion ordered backend", test_ordered_backend);
+      CU_add_test(suite, "Cached hash checked before eq", test_hash_checked_before_eq);
+      CU_add_test(suite, "Entries from a slab", test_pooled_entries);
+      CU_add_test(suite, "Incremental resize", test_incremental_resize);
+      CU_add_test(suite, "Concurrent counting", test_concurrent_counting);
+      CU_add_test(suite, "Lock-free concurrent lookups", test_concurrent_lock_free_reads);
+      CU_add_test(suite, "Many concurrent tables", test_concurrent_many_tables);
+      CU_add_test(suite, "Batched lookup and insert", test_batches);
+      CU_add_test(suite, "Export keys and values to arrays", test_export_arrays);
+      CU_add_test(suite, "Seeded hash functions", test_hash_family);
+      CU_add_test(suite, "String view keys", test_string_views);
+      CU_add_test(suite, "Copied keys", test_copied_keys);
+      CU_add_test(suite, "Upsert", test_upsert);
+      CU_add_test(suite, "Table files", test_table_file);
+      CU_add_test(suite, "Statistics", test_stats);
+      CU_add_test(suite, "Parallel traversal", test_parallel_traversal);
+      CU_add_test(suite, "Frozen tables", test_frozen_table);
+      CU_add_test(suite, "Generated hash tables", test_hash_table_template);
+      CU_add_test(suite, "Key filter", test_key_filter);
+      CU_add_test(suite, "Value index", test_value_index);
+      CU_add_test(suite, "Remove if and drain", test_remove_if_and_drain);
+      CU_add_test(suite, "Merge", test_merge);
+      CU_add_test(suite, "Interned strings", test_intern_pool);
 
 
 
@@ -1,33 +1,82 @@
 #define _POSIX_C_SOURCE 200809L
 #include "linked_list.h"
 #include "hash_table.h"
+#include "hash_table_template.h"
 #include "sort.h"
+#include "intern.h"
 #include "db.h"
 
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 
-/* Helper: insert a duplicated key into a hash table.
-* The function strdup's the key so the hash table owns its copy.
+/* Carts by id. Every cart operation starts here, so the table is specialised for int keys. */
+#define hash_cart_id(id) ((uint64_t) (unsigned) (id))
+#define cart_id_eq(a, b) ((a) == (b))
+IOOPM_DEFINE_HASH_TABLE(cart_table, int, cart_t *, hash_cart_id, cart_id_eq)
+
+static cart_t *find_cart(db_t *db, int cart_id)
+{
+    cart_t **cart = cart_table_find(db->cart_ids, cart_id);
+    return cart != NULL ? *cart : NULL;
+}
+
+/* Helper: take a reference to the pooled copy of a string.
+* Every name and shelf in the db is interned, so equal strings are the same pointer.
+*/
+static char *intern(db_t *db, const char *str)
+{
+    return (char *) ioopm_intern(db->strings, str);
+}
+
+static void release(db_t *db, const char *handle)
+{
+    ioopm_intern_release(db->strings, handle);
+}
+
+/* Helper for ioopm_hash_table_upsert: intern a key only when it is about to be stored.
+* The table holds its own reference, given back with release() when the key is removed.
 */
-static void hash_insert_dup(ioopm_hash_table_t *ht, const char *key, elem_t value)
+static elem_t intern_key(elem_t key, void *db)
 {
-    char *kdup = strdup(key);
-    ioopm_hash_table_insert(ht, ptr_elem(kdup), value);
+    return ptr_elem(intern(db, key.p));
+}
+
+static void release_key(elem_t key, elem_t *value, void *db)
+{
+    (void) value;
+    release(db, key.p);
+}
+
+/* Destroy a cart that is no longer in db->carts, releasing its keys */
+static void destroy_cart(db_t *db, cart_t *cart)
+{
+    cart_table_remove(db->cart_ids, cart->id, NULL, NULL);
+    ioopm_hash_table_apply_to_all(cart->items, release_key, db);
+    ioopm_hash_table_destroy(cart->items);
+    free(cart);
 }
 
 /* Create / destroy database */
 db_t *create_db(void) {
     db_t *db = calloc(1, sizeof(db_t));
+    db->strings = ioopm_intern_pool_create();
+
+    // The indexes are lookup heavy (every cart item hits merch_ht), so keep them in flat arrays.
+    // add_merch and replenish_stock mostly look up names and shelves that are not there yet,
+    // the key filter answers those without probing.
+    ioopm_hash_table_options_t index_opts = { .backend = IOOPM_HT_ROBIN_HOOD, .incremental_resize = true,
+                                              .key_filter = true };
 
-    db->merch_ht = ioopm_hash_table_create(hash_str, str_eq);
-    db->merch_ht->should_free_keys = true;
+    // Keys are the merch's name and the stock's shelf handles, released along with those
+    db->merch_ht = ioopm_hash_table_create_with(hash_str, str_eq, &index_opts);
+    db->merch_ht->should_free_keys = false;
 
-    db->shelf_ht = ioopm_hash_table_create(hash_str, str_eq);
-    db->shelf_ht->should_free_keys = true;
+    db->shelf_ht = ioopm_hash_table_create_with(hash_str, str_eq, &index_opts);
+    db->shelf_ht->should_free_keys = false;
 
     db->carts = ioopm_linked_list_create(NULL);
+    db->cart_ids = cart_table_create(0);
     db->next_cart_id = 1;
 
     return db;
@@ -47,6 +96,20 @@ db_t *create_db(void) {
 //     }
 // }
 
+/* Helper for draining a shelf_map: free a stock taken out of it and its shelf handle */
+static void free_stock(elem_t shelf, elem_t stock, void *db)
+{
+    release(db, shelf.p);
+    free(stock.p);
+}
+
+/* Helper for draining a shelf_map: also drop the shelf from shelf_ht */
+static void free_stock_and_shelf(elem_t shelf, elem_t stock, void *db)
+{
+    ioopm_hash_table_remove(((db_t *) db)->shelf_ht, shelf);
+    free_stock(shelf, stock, db);
+}
+
 /* Destroy one merch and its stocks; also remove corresponding shelf_ht entries.
 * NOTE: caller must ensure merch is removed from merch_ht (or that it's safe that merch->name is freed here).
 */
@@ -54,42 +117,36 @@ static void destroy_merch_and_shelves(db_t *db, merch_t *merch)
 {
     if (!merch) return;
 
-    // For every stock, remove shelf_ht entry (by string content) before freeing stock->shelf
-    while (merch->locations->size > 0) {
-        stock_t *stock = ioopm_linked_list_get(merch->locations, 0).p;
-        // remove mapping from shelf_ht (this will free the duplicate key that was inserted into shelf_ht)
-        ioopm_hash_table_remove(db->shelf_ht, ptr_elem(stock->shelf));
-        // free the stock-owned copy
-        free(stock->shelf);
-        free(stock);
-        ioopm_linked_list_remove(merch->locations, 0);
-    }
-
-    ioopm_linked_list_destroy(merch->locations);
-    
-    // NEW: Destroy the shelf map (no need to free keys - they're owned by stock entries)
+    // shelf_map holds every stock: take them all out in one pass, removing their
+    // shelf_ht entries before the shelf handles are released
+    ioopm_hash_table_drain(merch->shelf_map, free_stock_and_shelf, db);
     ioopm_hash_table_destroy(merch->shelf_map);
+    ioopm_linked_list_destroy(merch->locations);
     
-    free(merch->name);
+    release(db, merch->name);
     free(merch->desc);
     free(merch);
 }
 
+/* Helper for draining merch_ht: its key is m->name, which is released with m */
+static void destroy_taken_merch(elem_t name, elem_t merch, void *db)
+{
+    (void) name;
+    destroy_merch_and_shelves(db, merch.p);
+}
+
 void destroy_db(db_t *db) {
     if (!db) return;
 
-    // Destroy all merch structs and their stocks (also remove shelf_ht mappings)
-    if (db->merch_ht && db->merch_ht->size > 0) {
-        elem_t *merch_keys = get_keys(db->merch_ht);
-        size_t merch_count = ioopm_hash_table_size(db->merch_ht);
-        for (size_t i = 0; i < merch_count; ++i) {
-            option_t res = ioopm_hash_table_lookup(db->merch_ht, merch_keys[i]);
-            if (res.success) {
-                merch_t *m = res.value.p;
-                destroy_merch_and_shelves(db, m);
-            }
-        }
-        free(merch_keys);
+    // Every shelf goes anyway; emptied first, the removes destroy_merch_and_shelves
+    // does are answered by its key filter
+    if (db->shelf_ht) {
+        ioopm_hash_table_clear(db->shelf_ht);
+    }
+
+    // Destroy all merch structs and their stocks, taking them out of merch_ht in one pass
+    if (db->merch_ht) {
+        ioopm_hash_table_drain(db->merch_ht, destroy_taken_merch, db);
     }
 
     // Destroy the merch hash table (frees duplicated keys)
@@ -107,22 +164,21 @@ void destroy_db(db_t *db) {
         while (db->carts->size > 0) {
             cart_t *cart = ioopm_linked_list_get(db->carts, 0).p;
             ioopm_linked_list_remove(db->carts, 0);
-            if (cart->items) {
-                ioopm_hash_table_destroy(cart->items); // frees duplicated keys
-            }
-            free(cart);
+            destroy_cart(db, cart); // releases its keys
         }
         ioopm_linked_list_destroy(db->carts);
     }
+    cart_table_destroy(db->cart_ids);
 
+    ioopm_intern_pool_destroy(db->strings);
     free(db);
 }
 
 /* Helper to create a merch */
-static merch_t *create_merch(char *name, char *desc, int price) {
+static merch_t *create_merch(db_t *db, char *name, char *desc, int price) {
     merch_t *merch = calloc(1, sizeof(merch_t));
 
-    merch->name = strdup(name);
+    merch->name = intern(db, name);
     merch->desc = strdup(desc);
     merch->price = price;
     merch->locations = ioopm_linked_list_create(NULL);
@@ -138,7 +194,7 @@ static merch_t *create_merch(char *name, char *desc, int price) {
 }
 
 /* Add merchandise: create merch struct and insert into merch_ht.
-* We duplicate the name into merch struct and also duplicate key into hash via hash_insert_dup.
+* merch_ht's key is the merch's own interned name.
 */
 bool add_merch(db_t *db, char *name, char *desc, int price) {
     if (ioopm_hash_table_has_key(db->merch_ht, ptr_elem(name))) {
@@ -146,11 +202,10 @@ bool add_merch(db_t *db, char *name, char *desc, int price) {
         return false;
     }
 
-    merch_t *merch = create_merch(name, desc, price);
+    merch_t *merch = create_merch(db, name, desc, price);
     if (!merch) return false;
 
-    // Insert into merch_ht: duplicate key for hash ownership (separate from merch->name)
-    hash_insert_dup(db->merch_ht, merch->name, ptr_elem(merch));
+    ioopm_hash_table_insert(db->merch_ht, ptr_elem(merch->name), ptr_elem(merch));
     return true;
 }
 
@@ -182,7 +237,7 @@ void print_merchandise(db_t *db) {
 }
 
 /* Remove merchandise: require confirmation; reject if any cart references the merch.
-* Removes merch from merch_ht (which frees the duplicate key) and destroys merch & shelves.
+* Removes merch from merch_ht and destroys merch & shelves (which releases the name).
 */
 bool remove_merch(db_t *db, char *name, char *conf_string) {
     if (!(conf_string[0] == 'Y' || conf_string[0] == 'y')) {
@@ -209,7 +264,7 @@ bool remove_merch(db_t *db, char *name, char *conf_string) {
         c = c->next;
     }
 
-    // Remove merch key from hash (frees the duplicated key in merch_ht)
+    // Remove merch key from hash (the key is merch->name, released below)
     ioopm_hash_table_remove(db->merch_ht, ptr_elem(name));
 
     // Destroy merch and remove corresponding shelf entries
@@ -233,43 +288,45 @@ bool change_merch(db_t *db, char *old_name, char *new_name, int new_price, char
         return false;
     }
 
-    // If new name differs, ensure it doesn't exist already
-    if (strcmp(old_name, new_name) != 0) {
-        option_t res_new = ioopm_hash_table_lookup(db->merch_ht, ptr_elem(new_name));
-        if (res_new.success) {
+    merch_t *merch = res_old.value.p;
+    char *old_handle = merch->name; // old_name may be this very string, keep it until the end
+    char *new_handle = intern(db, new_name);
+
+    // If new name differs, claim it in merch_ht (one probe), unless it exists already
+    if (new_handle != old_handle) {
+        bool inserted;
+        elem_t *slot = ioopm_hash_table_upsert(db->merch_ht, ptr_elem(new_handle), NULL, NULL, &inserted);
+        if (!inserted) {
+            release(db, new_handle);
             printf("Merchandise with this new name already exist\n");
             return false;
         }
+        *slot = ptr_elem(merch);
+        ioopm_hash_table_remove(db->merch_ht, ptr_elem(old_handle));
     }
 
-    merch_t *merch = res_old.value.p;
-
-    // rekey merch_ht: remove old key and insert new duplicate under new_name
-    ioopm_hash_table_remove(db->merch_ht, ptr_elem(old_name)); // frees old duplicate key
     // update merch struct strings
-    free(merch->name);
     free(merch->desc);
-    merch->name = strdup(new_name);
+    merch->name = new_handle;
     merch->desc = strdup(new_desc);
     merch->price = new_price;
-    // insert new duplicate key for merch_ht
-    hash_insert_dup(db->merch_ht, merch->name, ptr_elem(merch));
 
     // Update carts: for each cart, if old_name present rekey entry to new_name
     ioopm_link_t *cur = db->carts->head;
     while (cur) {
         cart_t *cart = cur->element.p;
-        option_t q = ioopm_hash_table_lookup(cart->items, ptr_elem(old_name));
-        if (q.success) {
-            int qty = q.value.i;
-            // remove old key (frees its duplicate)
-            ioopm_hash_table_remove(cart->items, ptr_elem(old_name));
-            // insert new duplicated key
-            hash_insert_dup(cart->items, merch->name, int_elem(qty));
+        elem_t *q = ioopm_hash_table_lookup_slot(cart->items, ptr_elem(old_handle));
+        if (q && new_handle != old_handle) {
+            elem_t qty = *q;
+            // remove old key and give back the cart's reference to it
+            ioopm_hash_table_remove(cart->items, ptr_elem(old_handle));
+            release(db, old_handle);
+            *ioopm_hash_table_upsert(cart->items, ptr_elem(new_handle), intern_key, db, NULL) = qty;
         }
         cur = cur->next;
     }
 
+    release(db, old_handle);
     return true;
 }
 
@@ -305,16 +362,33 @@ void print_stock(db_t *db, elem_t merch_name) {
 }
 
 /* Create stock entry */
-static stock_t *create_stock(const char *shelf, int no_items) {
+static stock_t *create_stock(db_t *db, const char *shelf, int no_items) {
     stock_t *stock = calloc(1, sizeof(stock_t));
-    stock->shelf = strdup(shelf);
+    stock->shelf = intern(db, shelf);
     stock->quantity = no_items;
     return stock;
 }
 
+/* Helper for ioopm_hash_table_upsert on shelf_ht: create the stock of a new shelf,
+* whose interned shelf name becomes the key.
+*/
+struct new_stock
+{
+    db_t *db;
+    int no_items;
+    stock_t *stock; // set once the stock is created
+};
+
+static elem_t stock_shelf(elem_t key, void *arg)
+{
+    struct new_stock *fresh = arg;
+    fresh->stock = create_stock(fresh->db, key.p, fresh->no_items);
+    return ptr_elem(fresh->stock->shelf);
+}
+
 /* Replenish: add items to storage location (existing or new).
 * We ensure a shelf cannot contain different merch.
-* shelf_ht keys are duplicated here (hash_insert_dup) and values are merch*.
+* shelf_ht keys are the stocks' interned shelf names and values are merch*.
 */
 bool replenish_stock(db_t *db, char *storage_loc, elem_t merch_name, int no_item)
 {
@@ -331,54 +405,52 @@ bool replenish_stock(db_t *db, char *storage_loc, elem_t merch_name, int no_item
 
     merch_t *merch = res.value.p;
 
-    // If storage location already present in shelf_ht, make sure it belongs to this merch
-    option_t shelf_lookup = ioopm_hash_table_lookup(db->shelf_ht, ptr_elem(storage_loc));
-    if (shelf_lookup.success) {
-        merch_t *existing_merch = shelf_lookup.value.p;
-        if (existing_merch != merch) {
+    // Look up the shelf and claim it if it is free, in one probe of shelf_ht.
+    // The stock (and its interned shelf, the key) is only created for a new shelf.
+    struct new_stock fresh = { .db = db, .no_items = no_item };
+    bool new_shelf;
+    elem_t *owner = ioopm_hash_table_upsert(db->shelf_ht, ptr_elem(storage_loc), stock_shelf, &fresh, &new_shelf);
+
+    if (!new_shelf) {
+        // The shelf must belong to this merch, its stock is then in shelf_map
+        if (owner->p != merch) {
             printf("Storage location %s already stores a different merchandise\n", storage_loc);
             return false;
         }
-    }
-
-    // NEW: O(1) lookup using shelf_map instead of O(n) linear search!
-    option_t stock_res = ioopm_hash_table_lookup(merch->shelf_map, ptr_elem(storage_loc));
-    if (stock_res.success) {
-        // Found existing stock - update quantity
-        stock_t *stock = stock_res.value.p;
+        stock_t *stock = ioopm_hash_table_lookup(merch->shelf_map, ptr_elem(storage_loc)).value.p;
         stock->quantity += no_item;
         merch->total_stock += no_item;
         return true;
     }
 
-    // NEW STOCK - create and add to both data structures
-    stock_t *new_stock = create_stock(storage_loc, no_item);
+    // NEW STOCK - shelf_ht has it, add it to the merch's structures too
+    *owner = ptr_elem(merch);
     
     // Add to linked list (for ordered iteration)
-    ioopm_linked_list_append(merch->locations, ptr_elem(new_stock));
+    ioopm_linked_list_append(merch->locations, ptr_elem(fresh.stock));
     
     // NEW: Add to shelf_map for O(1) lookups
-    ioopm_hash_table_insert(merch->shelf_map, ptr_elem(new_stock->shelf), ptr_elem(new_stock));
-    
-    // Add to global shelf_ht
-    hash_insert_dup(db->shelf_ht, new_stock->shelf, ptr_elem(merch));
+    ioopm_hash_table_insert(merch->shelf_map, ptr_elem(fresh.stock->shelf), ptr_elem(fresh.stock));
     
     merch->total_stock += no_item;
 
     return true;
 }
 
-/* Create Cart: cart->items must duplicate keys for the strings inserted into it */
+/* Create Cart: cart->items holds a reference to each merch name inserted into it.
+* Items are kept in the order they were added, which is the order cost and checkout walk them. */
 cart_t *create_cart(db_t *db) {
     cart_t *cart = calloc(1, sizeof(cart_t));
-    cart->items = ioopm_hash_table_create(hash_str, str_eq);
-    cart->items->should_free_keys = true;
+    ioopm_hash_table_options_t items_opts = { .backend = IOOPM_HT_ORDERED };
+    cart->items = ioopm_hash_table_create_with(hash_str, str_eq, &items_opts);
+    cart->items->should_free_keys = false;
     cart->id = db->next_cart_id++;
     ioopm_linked_list_append(db->carts, ptr_elem(cart));
+    cart_table_insert(db->cart_ids, cart->id, cart);
     return cart;
 }
 
-/* Helper: find cart index by id */
+/* Helper: find cart index by id, for removing it from db->carts */
 static int cart_index(db_t *db, int cart_id) {
     ioopm_list_t *list = db->carts;
     ioopm_link_t *current = list->head;
@@ -410,16 +482,13 @@ bool remove_cart(db_t *db, int cart_id, char *conf_string) {
     }
 
     elem_t removed = ioopm_linked_list_remove(db->carts, index);
-    cart_t *cart = removed.p;
-
-    ioopm_hash_table_destroy(cart->items);
-    free(cart);
+    destroy_cart(db, removed.p);
 
     return true;
 }
 
 /* Add to cart: checks reservation invariants and updates merch->reserved.
-* We use strdup-on-insert for cart->items keys: remove old key before insert to avoid leaking duplicate keys.
+* cart->items keys are interned: a new item takes a reference, updates keep the existing key.
 */
 bool add_to_cart(db_t *db, merch_t *merch, int amnt, cart_t *cart)
 {
@@ -430,8 +499,7 @@ bool add_to_cart(db_t *db, merch_t *merch, int amnt, cart_t *cart)
     }
 
     // verify that the cart exists in db
-    int index = cart_index(db, cart->id);
-    if (index == -1)
+    if (find_cart(db, cart->id) != cart)
     {
         printf("Cart does not exist in this database\n");
         return false;
@@ -446,33 +514,19 @@ bool add_to_cart(db_t *db, merch_t *merch, int amnt, cart_t *cart)
     // available stock (excluding currently reserved)
     int available = merch->total_stock - merch->reserved;
 
-    option_t res = ioopm_hash_table_lookup(cart->items, ptr_elem(merch->name));
-
-    if (!res.success)
+    if (amnt > available)
     {
-        if (amnt > available)
-        {
+        if (ioopm_hash_table_has_key(cart->items, ptr_elem(merch->name)))
+            printf("Not enough stock for requested quantity.\n");
+        else
             printf("The wanted quantity is more than quantity in stock\n");
-            return false;
-        }
-        hash_insert_dup(cart->items, merch->name, int_elem(amnt));
-        merch->reserved += amnt;
-        return true;
+        return false;
     }
-    else
-    {
-        int cart_amnt = res.value.i;
-        if (amnt > available)
-        {
-            printf("Not enough stock for requested quantity.\n");
-            return false;
-        }
 
-        // Update existing entry without remove/reinsert to avoid memory leak
-        ioopm_hash_table_insert(cart->items, ptr_elem(merch->name), int_elem(cart_amnt + amnt));
-        merch->reserved += amnt;
-        return true;
-    }
+    // Add to the existing quantity, or to 0 for a new item (whose name is then interned)
+    ioopm_hash_table_upsert(cart->items, ptr_elem(merch->name), intern_key, db, NULL)->i += amnt;
+    merch->reserved += amnt;
+    return true;
 }
 
 /* Remove from cart: update reserved and remove/replace key accordingly */
@@ -483,29 +537,29 @@ bool remove_from_cart(db_t *db, merch_t *merch, int amnt, int cart_id)
         return false;
     }
 
-    int index = cart_index(db, cart_id);
-    if (index == -1) {
+    cart_t *cart = find_cart(db, cart_id);
+    if (cart == NULL) {
         printf("The requested cart does not exist\n");
         return false;
     }
 
-    cart_t *cart = ioopm_linked_list_get(db->carts, index).p;
-    option_t res = ioopm_hash_table_lookup(cart->items, ptr_elem(merch->name));
+    elem_t *slot = ioopm_hash_table_lookup_slot(cart->items, ptr_elem(merch->name));
 
-    if (!res.success) {
+    if (!slot) {
         printf("Merchandise not in cart\n");
         return false;
     }
 
-    int cart_amnt = res.value.i;
+    int cart_amnt = slot->i;
 
     if (amnt >= cart_amnt) {
-        // remove the entry (frees duplicated key)
+        // remove the entry and give back the cart's reference to the name
         ioopm_hash_table_remove(cart->items, ptr_elem(merch->name));
+        release(db, merch->name);
         merch->reserved -= cart_amnt;
     } else {
-        // Update existing entry without remove/reinsert to avoid memory leak
-        ioopm_hash_table_insert(cart->items, ptr_elem(merch->name), int_elem(cart_amnt - amnt));
+        // Update existing entry in place, no second probe
+        slot->i = cart_amnt - amnt;
         merch->reserved -= amnt;
     }
 
@@ -514,35 +568,48 @@ bool remove_from_cart(db_t *db, merch_t *merch, int amnt, int cart_id)
 
 /* Calculate cost: iterate cart keys via get_keys() */
 int calculate_cost(db_t *db, int cart_id) {
-    int index = cart_index(db, cart_id);
-    if (index == -1) {
+    cart_t *cart = find_cart(db, cart_id);
+    if (cart == NULL) {
         printf("Cart does not exist\n");
         return -1;
     }
 
     int sum = 0;
-    cart_t *cart = ioopm_linked_list_get(db->carts, index).p;
     ioopm_hash_table_t *items = cart->items;
 
     size_t n = ioopm_hash_table_size(items);
     if (n == 0) return 0;
 
+    // Quantities come out in the same order as the names, no lookups needed for them;
+    // the merch are resolved as one batch so the lookups overlap their misses
     elem_t *keys = get_keys(items);
+    elem_t *qtys = ioopm_hash_table_values_array(items, NULL);
+    option_t *merchs = calloc(n, sizeof(option_t));
+    ioopm_hash_table_lookup_batch(db->merch_ht, keys, n, merchs);
+
     for (size_t i = 0; i < n; ++i) {
-        option_t q = ioopm_hash_table_lookup(items, keys[i]);
-        int qty = q.value.i;
-        option_t res = ioopm_hash_table_lookup(db->merch_ht, keys[i]);
-        if (res.success) {
-            merch_t *merch = res.value.p;
+        int qty = qtys[i].i;
+        if (merchs[i].success) {
+            merch_t *merch = merchs[i].value.p;
             sum += merch->price * qty;
         } else {
             printf("Warning: merchandise %s in cart no longer exists\n", (char *)keys[i].p);
         }
     }
+    free(qtys);
+    free(merchs);
     free(keys);
     return sum;
 }
 
+/* Helper for ioopm_hash_table_remove_if on a shelf_map */
+static bool stock_is_empty(elem_t shelf, elem_t stock, void *arg)
+{
+    (void) shelf;
+    (void) arg;
+    return ((stock_t *) stock.p)->quantity == 0;
+}
+
 /* Checkout: validate availability, remove quantity from shelves deterministically (left-to-right),
 * remove shelf_ht entries when shelf becomes empty, update total_stock and reserved, remove cart.
 */
@@ -560,25 +627,31 @@ bool checkout_cart(db_t *db, int cart_id) {
     if (n == 0) {
         // empty cart: simply remove it
         ioopm_linked_list_remove(db->carts, index);
-        ioopm_hash_table_destroy(cart->items);
-        free(cart);
+        destroy_cart(db, cart);
         return true;
     }
 
+    // Both passes use the same lookups, so do them once, as a batch; the quantities
+    // come out of the cart in the same order as the names
     elem_t *keys = get_keys(items);
+    elem_t *qtys = ioopm_hash_table_values_array(items, NULL);
+    option_t *merchs = calloc(n, sizeof(option_t));
+    ioopm_hash_table_lookup_batch(db->merch_ht, keys, n, merchs);
 
     // Validation pass: ensure all quantities available
     for (size_t i = 0; i < n; ++i) {
-        option_t q = ioopm_hash_table_lookup(items, keys[i]);
-        int qty = q.value.i;
-        option_t res = ioopm_hash_table_lookup(db->merch_ht, keys[i]);
-        if (!res.success) {
+        int qty = qtys[i].i;
+        if (!merchs[i].success) {
             printf("Merchandise %s no longer exists\n", (char*)keys[i].p);
+            free(qtys);
+            free(merchs);
             free(keys);
             return false;
         }
-        merch_t *merch = res.value.p;
+        merch_t *merch = merchs[i].value.p;
         if (qty > merch->total_stock) {
+            free(qtys);
+            free(merchs);
             free(keys);
             printf("Not enough stock for %s\n", merch->name);
             return false;
@@ -587,11 +660,11 @@ bool checkout_cart(db_t *db, int cart_id) {
 
     // Apply pass: remove stock from shelves and update totals/reserved
     for (size_t i = 0; i < n; ++i) {
-        option_t q = ioopm_hash_table_lookup(items, keys[i]);
-        int qty = q.value.i;
-        merch_t *merch = ioopm_hash_table_lookup(db->merch_ht, keys[i]).value.p;
+        int qty = qtys[i].i;
+        merch_t *merch = merchs[i].value.p;
 
         int remaining = qty;
+        size_t used_up = 0;
         // iterate over locations, removing or decrementing stock
         size_t j = 0;
         while (j < merch->locations->size && remaining > 0) {
@@ -601,22 +674,25 @@ bool checkout_cart(db_t *db, int cart_id) {
                 remaining = 0;
                 j++;
             } else {
-                // Use up this shelf completely
+                // Use up this shelf completely; its stock is freed below, with the others
                 remaining -= stock->quantity;
-                
-                // NEW: Remove from shelf_map first
-                ioopm_hash_table_remove(merch->shelf_map, ptr_elem(stock->shelf));
-                
+                stock->quantity = 0;
+                used_up++;
+
                 // Remove from global shelf_ht
                 ioopm_hash_table_remove(db->shelf_ht, ptr_elem(stock->shelf));
-                
-                free(stock->shelf);
-                free(stock);
                 ioopm_linked_list_remove(merch->locations, j); // don't increment j
             }
         }
 
+        // Take the emptied stocks out of shelf_map in one pass and free them
+        if (used_up > 0) {
+            ioopm_hash_table_remove_if(merch->shelf_map, stock_is_empty, free_stock, db);
+        }
+
         if (remaining != 0) {
+            free(qtys);
+            free(merchs);
             free(keys);
             printf("Checkout failed: inconsistent stock for %s\n", merch->name);
             return false;
@@ -626,12 +702,13 @@ bool checkout_cart(db_t *db, int cart_id) {
         merch->reserved -= qty;
     }
 
+    free(qtys);
+    free(merchs);
     free(keys);
 
     // remove cart from db and free it
     ioopm_linked_list_remove(db->carts, index);
-    ioopm_hash_table_destroy(cart->items);
-    free(cart);
+    destroy_cart(db, cart);
 
     return true;
 }
@@ -3,15 +3,16 @@
 
 #include "linked_list.h"
 #include "hash_table.h"
+#include "intern.h"
 #include <stdbool.h>
 
 typedef struct stock {
-    char *shelf;      
+    char *shelf;      // interned in db->strings
     int quantity;
 } stock_t; 
 
 typedef struct merch {
-    char *name;       
+    char *name;       // interned in db->strings
     char *desc;       
     int price;
     ioopm_list_t *locations;     // list of stock_t* (for ordered iteration)
@@ -29,7 +30,9 @@ typedef struct db {
     ioopm_hash_table_t *merch_ht;  // name -> merch_t*
     ioopm_hash_table_t *shelf_ht;  // shelf -> merch_t*
     ioopm_list_t *carts;           // list of cart_t*
+    struct cart_table *cart_ids;   // id -> cart_t*, so finding a cart does not walk the list
     int next_cart_id;
+    ioopm_intern_pool_t *strings;  // names and shelves, each stored once and reference counted
 } db_t;
 
 // Function declarations remain the same...
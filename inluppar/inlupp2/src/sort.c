@@ -36,22 +36,10 @@ int cmp_str_num(const void *a, const void *b)
     return nx - ny;
 }
 
-// Convert hash table keys into a sorted array
+// Copy the hash table keys into an array (sorted by the caller), one pass over the buckets
 elem_t *get_keys(ioopm_hash_table_t *ht)
 {
-
-    ioopm_list_t *keys_list = ioopm_hash_table_keys(ht);
-    size_t size = keys_list->size;
-
-
-    elem_t *arr = calloc(size, sizeof(elem_t));
-    for (size_t i = 0; i < size; i++)
-    {
-        arr[i] = ioopm_linked_list_get(keys_list, i);
-    }
-
-    ioopm_linked_list_destroy(keys_list);
-    return arr;
+    return ioopm_hash_table_keys_array(ht, NULL);
 }
 
 